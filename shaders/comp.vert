@@ -1,18 +1,31 @@
 #version 140
 
-in vec3 in_Position;
+in vec4 in_Position;
 in vec3 in_Normal;
 in vec2 in_Texcoord;
 
 out vec2 share_texcoord;
 out vec3 share_normal;
 
-uniform mat4 mvp;
-uniform mat4 imt;
+// Must match ObjectBlock in src/UniformRing.h
+layout(std140, row_major) uniform Object {
+    mat4 model, imt;
+    vec4 color;
+};
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+// Drawn with GL_EQUAL over depth.vert's output
+invariant gl_Position;
 
 void main()
 {
-    gl_Position = mvp * vec4(in_Position * vec3(1,4,1), 1.0);
+    gl_Position = vp * model * in_Position;
     share_texcoord = in_Texcoord;
     vec4 normal4 = imt * vec4(in_Normal, 0.0);
     share_normal = normal4.xyz / normal4.w;
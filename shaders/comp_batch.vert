@@ -0,0 +1,39 @@
+#version 140
+
+in vec4 in_Position;
+in vec3 in_Normal;
+in vec2 in_Texcoord;
+in uint in_DrawID;
+
+out vec2 share_texcoord;
+out vec3 share_normal;
+
+// Per-draw rows of model and imt, see DrawBatch.h
+uniform samplerBuffer draws;
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+mat4 draw_mat(int n)
+{
+    int i = int(in_DrawID) * 9 + n;
+    return transpose(mat4(texelFetch(draws, i), texelFetch(draws, i + 1),
+                          texelFetch(draws, i + 2), texelFetch(draws, i + 3)));
+}
+
+// Drawn with GL_EQUAL over depth_batch.vert's output
+invariant gl_Position;
+
+void main()
+{
+    mat4 model = draw_mat(0);
+    mat4 imt = draw_mat(4);
+    gl_Position = vp * model * in_Position;
+    share_texcoord = in_Texcoord;
+    vec4 normal4 = imt * vec4(in_Normal, 0.0);
+    share_normal = normal4.xyz / normal4.w;
+}
@@ -0,0 +1,33 @@
+#version 140
+
+in vec2 share_texcoord;
+in vec3 share_normal;
+
+out vec4 out_Albedo;
+out vec2 out_Normal;
+out vec4 out_Material;
+
+uniform sampler2D tex_Albedo;
+uniform sampler2D tex_Normal;
+uniform sampler2D tex_Refraction;
+uniform sampler2D tex_Emission;
+
+// See Deferred.h for the compact G-buffer layout
+vec2 oct_encode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 s = vec2(n.x >= 0.0? 1.0 : -1.0, n.y >= 0.0? 1.0 : -1.0);
+    vec2 p = n.z >= 0.0? n.xy : (1.0 - abs(n.yx)) * s;
+    return p * 0.5 + 0.5;
+}
+
+void main()
+{
+    vec3 albedo = texture(tex_Albedo, share_texcoord).xyz;
+    vec3 emission = texture(tex_Emission, share_texcoord).xyz;
+    float emission_l = dot(vec3(0.30, 0.59, 0.11), emission);
+    out_Albedo = vec4(mix(albedo, emission, emission_l), 1.0);
+    out_Normal = oct_encode(normalize(share_normal));
+    float refraction = texture(tex_Refraction, share_texcoord).x * 2.0;
+    out_Material = vec4(50.0 / 255.0, refraction / 4.0, emission_l, 0.0);
+}
@@ -0,0 +1,21 @@
+#version 140
+
+out vec3 out_Color;
+
+uniform sampler2D tex_Depth;
+uniform sampler2D tex_Albedo;
+uniform sampler2D tex_Material;
+uniform vec3 color;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 albedo = texelFetch(tex_Albedo, pixel, 0).rgb;
+    // Nothing but the skybox reaches the far plane, and it isn't lit
+    if (texelFetch(tex_Depth, pixel, 0).r == 1.0) {
+        out_Color = albedo;
+        return;
+    }
+    float emission = texelFetch(tex_Material, pixel, 0).b;
+    out_Color = albedo * (color + emission);
+}
@@ -0,0 +1,26 @@
+#version 150
+
+out vec3 out_Color;
+
+uniform sampler2DMS tex_Depth;
+uniform sampler2DMS tex_Albedo;
+uniform sampler2DMS tex_Material;
+uniform vec3 color;
+// 1 on interior pixels, the MSAA sample count on edges
+uniform int shade_samples;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 sum = vec3(0.0);
+    for (int s = 0; s < shade_samples; s++) {
+        vec3 albedo = texelFetch(tex_Albedo, pixel, s).rgb;
+        // Nothing but the skybox reaches the far plane, and it isn't lit
+        if (texelFetch(tex_Depth, pixel, s).r == 1.0) {
+            sum += albedo;
+        } else {
+            sum += albedo * (color + texelFetch(tex_Material, pixel, s).b);
+        }
+    }
+    out_Color = sum / float(shade_samples);
+}
@@ -0,0 +1,21 @@
+#version 150
+
+uniform sampler2DMS tex_Depth;
+uniform sampler2DMS tex_Normal;
+uniform int shade_samples;
+
+// Keeps (and so stencils) pixels whose samples don't all see the same surface
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(tex_Depth, pixel, 0).r;
+    vec2 normal = texelFetch(tex_Normal, pixel, 0).xy;
+    for (int s = 1; s < shade_samples; s++) {
+        float d = texelFetch(tex_Depth, pixel, s).r;
+        vec2 n = texelFetch(tex_Normal, pixel, s).xy;
+        if (abs(d - depth) > 0.0005 || dot(abs(n - normal), vec2(1.0)) > 0.02) {
+            return;
+        }
+    }
+    discard;
+}
@@ -0,0 +1,71 @@
+#version 140
+
+out vec3 out_Color;
+
+uniform vec3 center;
+uniform float radius;
+uniform vec3 color;
+
+uniform sampler2D tex_Depth;
+uniform sampler2D tex_Albedo;
+uniform sampler2D tex_Normal;
+uniform sampler2D tex_Material;
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+vec3 oct_decode(vec2 e)
+{
+    vec2 p = e * 2.0 - 1.0;
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0.0) {
+        vec2 s = vec2(n.x >= 0.0? 1.0 : -1.0, n.y >= 0.0? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
+
+vec3 world_position(ivec2 pixel, float depth)
+{
+    vec2 ndc = (vec2(pixel) + 0.5) / vec2(textureSize(tex_Depth, 0)) * 2.0 - 1.0;
+    vec4 p = inverse_vp * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    return p.xyz / p.w;
+}
+
+// Blinn-Phong with a Schlick Fresnel term from the refraction index
+vec3 shade(ivec2 pixel, vec3 position, vec3 L, vec3 radiance)
+{
+    vec3 albedo = texelFetch(tex_Albedo, pixel, 0).rgb;
+    vec3 N = oct_decode(texelFetch(tex_Normal, pixel, 0).xy);
+    vec4 material = texelFetch(tex_Material, pixel, 0);
+    float gloss = material.r * 255.0;
+    float ior = max(material.g * 4.0, 1.0);
+    float f0 = pow((ior - 1.0) / (ior + 1.0), 2.0);
+    vec3 V = normalize(camera_position.xyz - position);
+    vec3 H = normalize(L + V);
+    float ndl = max(dot(N, L), 0.0);
+    float fresnel = f0 + (1.0 - f0) * pow(1.0 - max(dot(H, V), 0.0), 5.0);
+    float spec = fresnel * pow(max(dot(N, H), 0.0), gloss) * (gloss + 8.0) / 25.13;
+    return radiance * ndl * (albedo * (1.0 - fresnel) + spec);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(tex_Depth, pixel, 0).r;
+    if (depth == 1.0) {
+        discard;
+    }
+    vec3 position = world_position(pixel, depth);
+    vec3 to_light = center - position;
+    float dist = length(to_light);
+    if (dist >= radius) {
+        discard;
+    }
+    float falloff = 1.0 - dist / radius;
+    out_Color = shade(pixel, position, to_light / dist, color * falloff * falloff);
+}
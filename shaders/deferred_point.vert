@@ -0,0 +1,18 @@
+#version 140
+
+in vec3 in_Position;
+
+uniform vec3 center;
+uniform float radius;
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+void main()
+{
+    gl_Position = vp * vec4(center + in_Position * radius, 1.0);
+}
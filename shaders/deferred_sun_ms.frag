@@ -0,0 +1,68 @@
+#version 150
+
+out vec3 out_Color;
+
+uniform vec3 direction;
+uniform vec3 color;
+
+uniform sampler2DMS tex_Depth;
+uniform sampler2DMS tex_Albedo;
+uniform sampler2DMS tex_Normal;
+uniform sampler2DMS tex_Material;
+// 1 on interior pixels, the MSAA sample count on edges
+uniform int shade_samples;
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+vec3 oct_decode(vec2 e)
+{
+    vec2 p = e * 2.0 - 1.0;
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0.0) {
+        vec2 s = vec2(n.x >= 0.0? 1.0 : -1.0, n.y >= 0.0? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
+
+vec3 world_position(ivec2 pixel, float depth)
+{
+    vec2 ndc = (vec2(pixel) + 0.5) / vec2(textureSize(tex_Depth)) * 2.0 - 1.0;
+    vec4 p = inverse_vp * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    return p.xyz / p.w;
+}
+
+// Blinn-Phong with a Schlick Fresnel term from the refraction index
+vec3 shade(ivec2 pixel, int s, vec3 position, vec3 L, vec3 radiance)
+{
+    vec3 albedo = texelFetch(tex_Albedo, pixel, s).rgb;
+    vec3 N = oct_decode(texelFetch(tex_Normal, pixel, s).xy);
+    vec4 material = texelFetch(tex_Material, pixel, s);
+    float gloss = material.r * 255.0;
+    float ior = max(material.g * 4.0, 1.0);
+    float f0 = pow((ior - 1.0) / (ior + 1.0), 2.0);
+    vec3 V = normalize(camera_position.xyz - position);
+    vec3 H = normalize(L + V);
+    float ndl = max(dot(N, L), 0.0);
+    float fresnel = f0 + (1.0 - f0) * pow(1.0 - max(dot(H, V), 0.0), 5.0);
+    float spec = fresnel * pow(max(dot(N, H), 0.0), gloss) * (gloss + 8.0) / 25.13;
+    return radiance * ndl * (albedo * (1.0 - fresnel) + spec);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 sum = vec3(0.0);
+    for (int s = 0; s < shade_samples; s++) {
+        float depth = texelFetch(tex_Depth, pixel, s).r;
+        if (depth < 1.0) {
+            sum += shade(pixel, s, world_position(pixel, depth), direction, color);
+        }
+    }
+    out_Color = sum / float(shade_samples);
+}
@@ -0,0 +1,14 @@
+#version 140
+
+out vec3 out_Color;
+
+uniform sampler2D tex_Accum;
+uniform float exposure;
+uniform float gamma;
+
+void main()
+{
+    vec3 color = texelFetch(tex_Accum, ivec2(gl_FragCoord.xy), 0).rgb;
+    color = vec3(1.0) - exp(-color * exposure);
+    out_Color = pow(color, vec3(1.0 / gamma));
+}
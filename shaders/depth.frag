@@ -0,0 +1,6 @@
+#version 140
+
+// Depth only; the G-buffer's color writes are masked off
+void main()
+{
+}
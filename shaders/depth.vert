@@ -0,0 +1,25 @@
+#version 140
+
+in vec4 in_Position;
+
+// Must match ObjectBlock in src/UniformRing.h
+layout(std140, row_major) uniform Object {
+    mat4 model, imt;
+    vec4 color;
+};
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+/* Materials drawn over this depth with GL_EQUAL compute gl_Position with the
+ * same expression and declare it invariant too. */
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = vp * model * in_Position;
+}
@@ -0,0 +1,25 @@
+#version 140
+
+in vec4 in_Position;
+in uint in_DrawID;
+
+// Per-draw rows of model, see DrawBatch.h
+uniform samplerBuffer draws;
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+// See depth.vert
+invariant gl_Position;
+
+void main()
+{
+    int i = int(in_DrawID) * 9;
+    mat4 model = transpose(mat4(texelFetch(draws, i), texelFetch(draws, i + 1),
+                              texelFetch(draws, i + 2), texelFetch(draws, i + 3)));
+    gl_Position = vp * model * in_Position;
+}
@@ -2,10 +2,15 @@
 
 out vec3 out_Normal;
 out vec3 out_Albedo;
-uniform vec3 col;
+
+// Must match ObjectBlock in src/UniformRing.h
+layout(std140, row_major) uniform Object {
+    mat4 model, imt;
+    vec4 color;
+};
 
 void main()
 {
     out_Normal = vec3(0.5);
-    out_Albedo = col;
+    out_Albedo = color.rgb;
 }
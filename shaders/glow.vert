@@ -1,10 +1,24 @@
 #version 140
 
-in vec3 in_Position;
+in vec4 in_Position;
 
-uniform mat4 mvp;
+// Must match ObjectBlock in src/UniformRing.h
+layout(std140, row_major) uniform Object {
+    mat4 model, imt;
+    vec4 color;
+};
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+// Drawn with GL_EQUAL over depth.vert's output
+invariant gl_Position;
 
 void main()
 {
-    gl_Position = mvp * vec4(in_Position, 1.0);
+    gl_Position = vp * model * in_Position;
 }
@@ -0,0 +1,12 @@
+#version 140
+
+flat in vec3 col;
+
+out vec3 out_Normal;
+out vec3 out_Albedo;
+
+void main()
+{
+    out_Normal = vec3(0.5);
+    out_Albedo = col;
+}
@@ -0,0 +1,28 @@
+#version 140
+
+in vec4 in_Position;
+in uint in_DrawID;
+
+flat out vec3 col;
+
+// Per-draw rows of model, then the color in texel 8, see DrawBatch.h
+uniform samplerBuffer draws;
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+// Drawn with GL_EQUAL over depth_batch.vert's output
+invariant gl_Position;
+
+void main()
+{
+    int i = int(in_DrawID) * 9;
+    mat4 model = transpose(mat4(texelFetch(draws, i), texelFetch(draws, i + 1),
+                              texelFetch(draws, i + 2), texelFetch(draws, i + 3)));
+    gl_Position = vp * model * in_Position;
+    col = texelFetch(draws, i + 8).rgb;
+}
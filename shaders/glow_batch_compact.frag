@@ -0,0 +1,15 @@
+#version 140
+
+flat in vec3 col;
+
+out vec4 out_Albedo;
+out vec2 out_Normal;
+out vec4 out_Material;
+
+void main()
+{
+    // Fully emissive, the normal is never used
+    out_Albedo = vec4(col, 1.0);
+    out_Normal = vec2(0.5);
+    out_Material = vec4(0.0, 0.0, 1.0, 0.0);
+}
@@ -0,0 +1,19 @@
+#version 140
+
+out vec4 out_Albedo;
+out vec2 out_Normal;
+out vec4 out_Material;
+
+// Must match ObjectBlock in src/UniformRing.h
+layout(std140, row_major) uniform Object {
+    mat4 model, imt;
+    vec4 color;
+};
+
+void main()
+{
+    // Fully emissive, the normal is never used
+    out_Albedo = vec4(color.rgb, 1.0);
+    out_Normal = vec2(0.5);
+    out_Material = vec4(0.0, 0.0, 1.0, 0.0);
+}
@@ -0,0 +1,21 @@
+#version 140
+
+out float out_Depth;
+
+// The G-buffer's depth, or the pyramid with only the level above visible
+uniform sampler2D tex_Depth;
+
+// Farthest depth under this texel: a 2x2 block, widened to 3 at odd edges
+void main()
+{
+    ivec2 size = textureSize(tex_Depth, 0);
+    ivec2 lo = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 hi = min(lo + 2 + ivec2(equal(lo + 3, size)), size);
+    float depth = 0.0;
+    for (int y = lo.y; y < hi.y; y++) {
+        for (int x = lo.x; x < hi.x; x++) {
+            depth = max(depth, texelFetch(tex_Depth, ivec2(x, y), 0).r);
+        }
+    }
+    out_Depth = depth;
+}
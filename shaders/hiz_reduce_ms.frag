@@ -0,0 +1,23 @@
+#version 150
+
+out float out_Depth;
+
+uniform sampler2DMS tex_Depth;
+uniform int samples;
+
+// As hiz_reduce.frag, over every sample of a multisampled G-buffer
+void main()
+{
+    ivec2 size = textureSize(tex_Depth);
+    ivec2 lo = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 hi = min(lo + 2 + ivec2(equal(lo + 3, size)), size);
+    float depth = 0.0;
+    for (int y = lo.y; y < hi.y; y++) {
+        for (int x = lo.x; x < hi.x; x++) {
+            for (int s = 0; s < samples; s++) {
+                depth = max(depth, texelFetch(tex_Depth, ivec2(x, y), s).r);
+            }
+        }
+    }
+    out_Depth = depth;
+}
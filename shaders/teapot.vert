@@ -9,12 +9,25 @@ in vec4 in_Specular;
 out vec2 texcoord;
 out vec3 normal;
 
-uniform mat4 mvp;
-uniform mat4 imt;
+// Must match ObjectBlock in src/UniformRing.h
+layout(std140, row_major) uniform Object {
+    mat4 model, imt;
+    vec4 color;
+};
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+// Drawn with GL_EQUAL over depth.vert's output
+invariant gl_Position;
 
 void main()
 {
-    gl_Position = mvp * in_Position;
+    gl_Position = vp * model * in_Position;
     texcoord = in_Texcoord;
     vec4 normal4 = vec4(in_Normal, 0.0) * imt;
     normal = normal4.xyz;
@@ -0,0 +1,26 @@
+#version 140
+
+in vec2 texcoord;
+in vec3 normal;
+
+out vec4 out_Albedo;
+out vec2 out_Normal;
+out vec4 out_Material;
+
+uniform sampler2D tex_Color;
+
+// See Deferred.h for the compact G-buffer layout
+vec2 oct_encode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 s = vec2(n.x >= 0.0? 1.0 : -1.0, n.y >= 0.0? 1.0 : -1.0);
+    vec2 p = n.z >= 0.0? n.xy : (1.0 - abs(n.yx)) * s;
+    return p * 0.5 + 0.5;
+}
+
+void main()
+{
+    out_Albedo = vec4(texture(tex_Color, texcoord).rgb, 1.0);
+    out_Normal = oct_encode(normalize(normal));
+    out_Material = vec4(16.0 / 255.0, 1.5 / 4.0, 0.0, 0.0);
+}
@@ -0,0 +1,33 @@
+#version 140
+
+in vec3 in_Position;
+in vec2 in_Texcoord;
+
+out vec2 texcoord;
+out vec3 normal;
+
+uniform sampler2D tex_Height;
+uniform sampler2D tex_Normal;
+
+// Must match ObjectBlock in src/UniformRing.h
+layout(std140, row_major) uniform Object {
+    mat4 model, imt;
+    vec4 color;
+};
+
+// Must match CameraBlock in src/Camera.h
+layout(std140, row_major) uniform Camera {
+    mat4 view, projection, vp;
+    mat4 inverse_view, inverse_projection, inverse_vp;
+    vec4 camera_position;
+};
+
+void main()
+{
+    float height = textureLod(tex_Height, in_Texcoord, 0.0).r;
+    gl_Position = vp * model * vec4(in_Position.x, height - 0.5, in_Position.z, 1.0);
+    texcoord = in_Texcoord;
+    // The normal map is z-up
+    vec3 n = textureLod(tex_Normal, in_Texcoord, 0.0).xzy * 2.0 - 1.0;
+    normal = (vec4(n, 0.0) * imt).xyz;
+}
@@ -0,0 +1,43 @@
+#version 140
+
+// rgb: weighted sum of samples, a: sum of weights
+out vec4 out_History;
+
+// The shader's samples, in the lower left scene_size texels
+uniform sampler2D tex_Scene;
+uniform sampler2D tex_History;
+uniform vec2 scene_size;
+// Offset of this frame's samples within their pixels
+uniform vec2 jitter;
+// Restart from a bilinear upscale of this frame alone
+uniform bool reset;
+
+void main()
+{
+    vec2 out_size = vec2(textureSize(tex_History, 0));
+    vec2 tex_size = vec2(textureSize(tex_Scene, 0));
+    // Sample k was shaded at k + 0.5 + jitter
+    vec2 pos = gl_FragCoord.xy / out_size * scene_size - jitter;
+    if (reset) {
+        vec2 tc = clamp(pos, vec2(0.5), scene_size - 0.5) / tex_size;
+        // Light weight, so the first real samples take over
+        out_History = vec4(texture(tex_Scene, tc).rgb, 1.0) * 0.05;
+        return;
+    }
+
+    vec4 sum = texelFetch(tex_History, ivec2(gl_FragCoord.xy), 0);
+    vec2 base = floor(pos - 0.5);
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            vec2 k = base + vec2(x, y);
+            if (any(lessThan(k, vec2(0.0))) || any(greaterThanEqual(k, scene_size))) {
+                continue;
+            }
+            // Distance in output pixels; a Gaussian of half a pixel
+            vec2 d = (k + 0.5 + jitter) / scene_size * out_size - gl_FragCoord.xy;
+            float w = exp(-2.0 * dot(d, d));
+            sum += vec4(texelFetch(tex_Scene, ivec2(k), 0).rgb * w, w);
+        }
+    }
+    out_History = sum;
+}
@@ -0,0 +1,11 @@
+#version 140
+
+out vec3 out_Color;
+
+uniform sampler2D tex_History;
+
+void main()
+{
+    vec4 sum = texelFetch(tex_History, ivec2(gl_FragCoord.xy), 0);
+    out_Color = sum.rgb / max(sum.a, 1e-6);
+}
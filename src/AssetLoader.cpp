@@ -0,0 +1,386 @@
+#include "AssetLoader.h"
+
+#include <fcntl.h>
+#include <chrono>
+
+#include "Demo.h"
+
+extern "C" {
+#include "asset/node.h"
+#include "util/log.h"
+}
+
+#include "tgl/tgl.h"
+
+using namespace std;
+
+AssetLoader::AssetLoader()
+    : compress(demo_compress_textures)
+{
+    uv_loop_init(&loop);
+}
+
+AssetLoader::~AssetLoader()
+{
+    uv_run(&loop, UV_RUN_DEFAULT);
+    uv_loop_close(&loop);
+}
+
+static int readfile(uv_loop_t *loop, const char *path, vector<char> &out)
+{
+    uv_fs_t req;
+    int fd = uv_fs_open(loop, &req, path, O_RDONLY, 0, nullptr);
+    uv_fs_req_cleanup(&req);
+    if (fd < 0) {
+        return fd;
+    }
+    int res = uv_fs_fstat(loop, &req, fd, nullptr);
+    size_t size = size_t(req.statbuf.st_size);
+    uv_fs_req_cleanup(&req);
+    if (res == 0) {
+        out.resize(size);
+        size_t pos = 0;
+        while (pos < size) {
+            uv_buf_t buf = uv_buf_init(out.data() + pos, unsigned(size - pos));
+            res = uv_fs_read(loop, &req, fd, &buf, 1, int64_t(pos), nullptr);
+            uv_fs_req_cleanup(&req);
+            if (res <= 0) {
+                res = res? res : UV_EOF;
+                break;
+            }
+            pos += size_t(res);
+            res = 0;
+        }
+    }
+    uv_fs_close(loop, &req, fd, nullptr);
+    uv_fs_req_cleanup(&req);
+    return res;
+}
+
+void AssetLoader::decode_work(uv_work_t *work)
+{
+    File &file = *reinterpret_cast<File*>(work->data);
+    Request &req = *file.req;
+    vector<char> data;
+    if ((file.ioerr = readfile(work->loop, file.path.c_str(), data)) < 0) {
+        return;
+    }
+    file.err = ilA_img_fromdata(&req.imgs[file.index], data.data(), data.size());
+}
+
+void AssetLoader::decode_after(uv_work_t *work, int status)
+{
+    File &file = *reinterpret_cast<File*>(work->data);
+    Request &req = *file.req;
+    const char *name = req.names[file.index].c_str();
+    if (status == UV_ECANCELED) {
+        req.ok = false;
+    } else if (file.ioerr < 0) {
+        il_error("%s: %s", name, uv_strerror(file.ioerr));
+        req.ok = false;
+    } else if (file.err) {
+        il_error("%s: %s", name, ilA_img_strerror(file.err));
+        req.ok = false;
+    }
+    release(&req);
+}
+
+void AssetLoader::release(Request *req)
+{
+    if (--req->pending > 0) {
+        return;
+    }
+    if (req->ok && req->process) {
+        req->work.data = req;
+        uv_queue_work(&req->loader->loop, &req->work, process_work, process_after);
+        return;
+    }
+    req->loader->finish(req);
+}
+
+void AssetLoader::process_work(uv_work_t *work)
+{
+    Request &req = *reinterpret_cast<Request*>(work->data);
+    req.ok = req.process(req.imgs);
+}
+
+void AssetLoader::process_after(uv_work_t *work, int status)
+{
+    Request &req = *reinterpret_cast<Request*>(work->data);
+    if (status == UV_ECANCELED) {
+        req.ok = false;
+    }
+    req.loader->finish(&req);
+}
+
+void AssetLoader::finish(Request *req)
+{
+    if (req->ok) {
+        req->ok = req->done(req->imgs);
+    } else {
+        for (unsigned i = 0; i < req->files.size(); i++) {
+            if (!req->files[i].err && req->files[i].ioerr >= 0) {
+                ilA_img_free(req->imgs[i]);
+            }
+        }
+    }
+    failed |= !req->ok;
+    completed++;
+    delete req;
+}
+
+static bool resolve(const string &name, string &path)
+{
+    ilA_file f;
+    if (!ilA_fileopen(&demo_fs, &f, name.c_str(), -1)) {
+        ilA_printerror(&f.err);
+        return false;
+    }
+    path = f.name;
+    ilA_fileclose(&f);
+    return true;
+}
+
+void AssetLoader::images(vector<string> names, Done done, Process process)
+{
+    Request *req = new Request;
+    req->loader = this;
+    req->names = move(names);
+    req->done = move(done);
+    req->process = move(process);
+    // One extra reference so a request can't finish while still queueing
+    req->pending = unsigned(req->names.size()) + 1;
+    req->imgs.resize(req->names.size());
+    req->files.resize(req->names.size());
+
+    for (unsigned i = 0; i < req->names.size(); i++) {
+        File &file = req->files[i];
+        file.req = req;
+        file.index = i;
+        file.work.data = &file;
+        // Path lookup only walks the search directories, so it is cheap
+        // enough to do here instead of touching demo_fs from the workers.
+        if (!resolve(req->names[i], file.path)) {
+            file.err = ILA_IMG_NOT_FOUND;
+        }
+    }
+    for (unsigned i = 0; i < req->files.size(); i++) {
+        File &file = req->files[i];
+        if (file.err) {
+            // Still goes through decode_after so the request completes
+            file.ioerr = 0;
+            decode_after(&file.work, 0);
+            continue;
+        }
+        uv_queue_work(&loop, &file.work, decode_work, decode_after);
+    }
+    release(req);
+}
+
+void AssetLoader::image(const char *name, Done done, Process process)
+{
+    images(vector<string>{name}, move(done), move(process));
+}
+
+static void stat_source(uv_loop_t *loop, const string &path, uint64_t &mtime, uint64_t &size)
+{
+    uv_fs_t fs;
+    if (uv_fs_stat(loop, &fs, path.c_str(), nullptr) == 0) {
+        uint64_t t = uint64_t(fs.statbuf.st_mtim.tv_sec) * 1000000000
+            + uint64_t(fs.statbuf.st_mtim.tv_nsec);
+        mtime = max(mtime, t);
+        size += fs.statbuf.st_size;
+    }
+    uv_fs_req_cleanup(&fs);
+}
+
+void AssetLoader::probe_work(uv_work_t *work)
+{
+    TexRequest &req = *reinterpret_cast<TexRequest*>(work->data);
+    // The cache is keyed on the newest mtime and total size of the sources
+    for (auto &path : req.paths) {
+        stat_source(work->loop, path, req.mtime, req.size);
+    }
+    string cache = req.paths[0] + ".iltex";
+    req.hit = req.baked->load(cache.c_str(), req.compress, req.mtime, req.size);
+}
+
+void AssetLoader::probe_after(uv_work_t *work, int status)
+{
+    TexRequest *req = reinterpret_cast<TexRequest*>(work->data);
+    AssetLoader &self = *req->loader;
+    if (status == UV_ECANCELED) {
+        self.failed = true;
+        self.completed++;
+    } else if (req->hit) {
+        ilG_tex tex;
+        req->baked->upload(&tex);
+        req->baked->free();
+        self.failed |= !req->done(tex);
+        self.completed++;
+        self.cached++;
+    } else {
+        self.bake(req);
+    }
+    delete req;
+}
+
+void AssetLoader::bake(TexRequest *req)
+{
+    auto baked = req->baked;
+    auto done = move(req->done);
+    string cache = req->paths[0] + ".iltex";
+    bool compress = req->compress;
+    uint64_t mtime = req->mtime, size = req->size;
+    auto saved = make_shared<bool>(false);
+    images(move(req->names), [=](Images &imgs) {
+        ilG_tex tex;
+        if (baked->size() > 0) {
+            baked->upload(&tex);
+            baked->free();
+            if (!*saved) {
+                il_warning("Failed to write texture cache %s", cache.c_str());
+            }
+        } else if (imgs.size() == 6) {
+            // Formats the cache can't represent are uploaded as before
+            ilG_tex_loadcube(&tex, imgs.data());
+        } else {
+            ilG_tex_loadimage(&tex, imgs[0]);
+        }
+        return done(tex);
+    }, [=](Images &imgs) {
+        if (imgs.size() != 1 && imgs.size() != 6) {
+            return false;
+        }
+        if (baked->bake(imgs.data(), unsigned(imgs.size()), compress, mtime, size)) {
+            for (auto &img : imgs) {
+                ilA_img_free(img);
+            }
+            imgs.clear();
+            *saved = baked->save(cache.c_str());
+        }
+        return true;
+    });
+}
+
+void AssetLoader::textures(vector<string> names, TexDone done)
+{
+    TexRequest *req = new TexRequest;
+    req->loader = this;
+    req->names = move(names);
+    req->done = move(done);
+    // RGTC is core, but the colour formats still need S3TC
+    req->compress = compress && TGL_EXTENSION(EXT_texture_compression_s3tc);
+    req->baked = make_shared<BakedTex>();
+    req->paths.resize(req->names.size());
+    for (unsigned i = 0; i < req->names.size(); i++) {
+        if (!resolve(req->names[i], req->paths[i])) {
+            failed = true;
+            completed++;
+            delete req;
+            return;
+        }
+    }
+    req->work.data = req;
+    uv_queue_work(&loop, &req->work, probe_work, probe_after);
+}
+
+void AssetLoader::texture(ilG_tex *tex, const char *name)
+{
+    textures(vector<string>{name}, [=](ilG_tex &t) {
+        *tex = t;
+        return true;
+    });
+}
+
+void AssetLoader::mesh_work(uv_work_t *work)
+{
+    MeshRequest &req = *reinterpret_cast<MeshRequest*>(work->data);
+    uint64_t mtime = 0, size = 0;
+    stat_source(work->loop, req.path, mtime, size);
+    string cache = req.path + ".mesh";
+    if ((req.hit = req.baked.load(cache.c_str(), mtime, size))) {
+        return;
+    }
+    MappedFile file;
+    if (!file.open(req.path.c_str())) {
+        req.error = "failed to map file";
+        return;
+    }
+    MeshData data;
+    if (!parse_obj(reinterpret_cast<const char*>(file.data()), file.size(), data, req.error)) {
+        return;
+    }
+    req.stats = optimize_mesh(data);
+    req.baked.bake(data, mtime, size);
+    if (!req.baked.save(cache.c_str())) {
+        req.error = "failed to write mesh cache";
+    }
+}
+
+void AssetLoader::mesh_after(uv_work_t *work, int status)
+{
+    MeshRequest *req = reinterpret_cast<MeshRequest*>(work->data);
+    AssetLoader &self = *req->loader;
+    if (status == UV_ECANCELED) {
+        self.failed = true;
+    } else if (req->baked.size() == 0) {
+        il_error("%s: %s", req->name.c_str(), req->error.c_str());
+        self.failed = true;
+    } else {
+        if (!req->error.empty()) {
+            // Only the cache write failed, the mesh itself is fine
+            il_warning("%s: %s", req->name.c_str(), req->error.c_str());
+        }
+        if (!req->hit) {
+            il_log("%s: ACMR %.3f -> %.3f", req->name.c_str(),
+                   req->stats.acmr_before, req->stats.acmr_after);
+        }
+        req->mesh->upload(req->baked);
+        self.cached += req->hit;
+    }
+    self.completed++;
+    delete req;
+}
+
+void AssetLoader::mesh(Mesh *mesh, const char *name)
+{
+    MeshRequest *req = new MeshRequest;
+    req->loader = this;
+    req->name = name;
+    req->mesh = mesh;
+    if (!resolve(req->name, req->path)) {
+        failed = true;
+        completed++;
+        delete req;
+        return;
+    }
+    req->work.data = req;
+    uv_queue_work(&loop, &req->work, mesh_work, mesh_after);
+}
+
+void AssetLoader::after(function<bool()> fn)
+{
+    deferred.push_back(move(fn));
+}
+
+bool AssetLoader::wait()
+{
+    typedef chrono::steady_clock clock;
+    typedef chrono::duration<double, milli> duration;
+    clock::time_point start = clock::now();
+
+    unsigned before = completed, before_cached = cached;
+    uv_run(&loop, UV_RUN_DEFAULT);
+    for (auto &fn : deferred) {
+        failed |= !fn();
+    }
+    deferred.clear();
+
+    duration delta = clock::now() - start;
+    il_log("Loaded %u assets (%u from cache) in %.1f ms",
+           completed - before, cached - before_cached, delta.count());
+    bool ok = !failed;
+    failed = false;
+    return ok;
+}
@@ -0,0 +1,122 @@
+#ifndef DEMO_ASSETLOADER_H
+#define DEMO_ASSETLOADER_H
+
+#include <uv.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MeshOpt.h"
+#include "TexCache.h"
+
+extern "C" {
+#include "asset/image.h"
+#include "graphics/tex.h"
+}
+
+/* Reads and decodes assets on the libuv thread pool.
+ *
+ * Each file is read and decoded in its own work request, so independent
+ * assets load in parallel. Completion callbacks are invoked from wait() on
+ * the calling thread, which has to be the one owning the GL context; that is
+ * where uploads happen.
+ *
+ * Textures are baked into a .iltex cache next to their (first) source file
+ * the first time they are loaded. Later runs map the cache and upload the
+ * stored mip chain directly, skipping PNG decoding entirely. OBJ meshes are
+ * parsed from a mapping, reordered for the vertex cache and cached as .mesh
+ * files the same way.
+ */
+class AssetLoader {
+public:
+    typedef std::vector<ilA_img> Images;
+    // Runs on a worker thread once every image of a request is decoded
+    typedef std::function<bool(Images &imgs)> Process;
+    // Runs on the GL thread, takes ownership of the images
+    typedef std::function<bool(Images &imgs)> Done;
+    typedef std::function<bool(ilG_tex &tex)> TexDone;
+
+    AssetLoader();
+    ~AssetLoader();
+
+    void images(std::vector<std::string> names, Done done, Process process = nullptr);
+    void image(const char *name, Done done, Process process = nullptr);
+    /* One name gives a 2D texture, six give a cube map in the face order
+     * ilG_tex_loadcube expects. */
+    void textures(std::vector<std::string> names, TexDone done);
+    void texture(ilG_tex *tex, const char *name);
+    void mesh(Mesh *mesh, const char *name);
+    // Runs from wait() after every request has completed, in queue order
+    void after(std::function<bool()> fn);
+    /* Runs the loop until every queued request has completed. Returns false
+     * if any of them failed. */
+    bool wait();
+
+    // Block compress newly baked textures (BC1/BC3/RGTC)
+    bool compress = false;
+
+private:
+    struct Request;
+    struct File {
+        Request *req;
+        unsigned index;
+        std::string path;
+        ilA_imgerr err = ILA_IMG_SUCCESS;
+        int ioerr = 0;
+        uv_work_t work;
+    };
+    struct Request {
+        AssetLoader *loader;
+        std::vector<std::string> names;
+        std::vector<File> files;
+        Images imgs;
+        Process process;
+        Done done;
+        unsigned pending;
+        bool ok = true;
+        uv_work_t work;
+    };
+
+    struct TexRequest {
+        AssetLoader *loader;
+        std::vector<std::string> names, paths;
+        TexDone done;
+        bool compress;
+        uint64_t mtime = 0, size = 0;
+        bool hit = false;
+        std::shared_ptr<BakedTex> baked;
+        uv_work_t work;
+    };
+
+    struct MeshRequest {
+        AssetLoader *loader;
+        std::string name, path;
+        Mesh *mesh;
+        BakedMesh baked;
+        bool hit = false;
+        MeshOptStats stats;
+        std::string error;
+        uv_work_t work;
+    };
+
+    static void decode_work(uv_work_t *work);
+    static void decode_after(uv_work_t *work, int status);
+    static void release(Request *req);
+    static void process_work(uv_work_t *work);
+    static void process_after(uv_work_t *work, int status);
+    void finish(Request *req);
+    static void probe_work(uv_work_t *work);
+    static void probe_after(uv_work_t *work, int status);
+    void bake(TexRequest *req);
+    static void mesh_work(uv_work_t *work);
+    static void mesh_after(uv_work_t *work, int status);
+
+    uv_loop_t loop;
+    std::vector<std::function<bool()>> deferred;
+    unsigned completed = 0, cached = 0;
+    bool failed = false;
+};
+
+#endif
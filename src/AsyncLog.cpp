@@ -0,0 +1,204 @@
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <string.h>
+
+extern "C" {
+#include "util/log.h"
+}
+
+using namespace std;
+
+AsyncLog demo_async_log;
+
+AsyncLog::AsyncLog()
+{
+    for (unsigned i = 0; i < capacity; i++) {
+        slots[i].sequence.store(i, memory_order_relaxed);
+    }
+}
+
+void AsyncLog::start(Writer writer)
+{
+    if (running) {
+        return;
+    }
+    this->writer = writer;
+    tokens = rate;
+    refilled = clock::now();
+    running = true;
+    thread = std::thread(&AsyncLog::run, this);
+}
+
+void AsyncLog::stop()
+{
+    if (!running) {
+        return;
+    }
+    running = false;
+    thread.join();
+}
+
+bool AsyncLog::push(const Record &record)
+{
+    unsigned pos = head.load(memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &slots[pos % capacity];
+        const unsigned sequence = slot->sequence.load(memory_order_acquire);
+        const int diff = int(sequence - pos);
+        if (diff == 0) {
+            // Free for this position; claim it unless another producer did
+            if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Still holds the message from a lap ago
+            overflowed.fetch_add(1, memory_order_relaxed);
+            return false;
+        } else {
+            pos = head.load(memory_order_relaxed);
+        }
+    }
+    slot->record = record;
+    slot->sequence.store(pos + 1, memory_order_release);
+    return true;
+}
+
+bool AsyncLog::pop(Record &record)
+{
+    Slot &slot = slots[tail % capacity];
+    if (int(slot.sequence.load(memory_order_acquire) - (tail + 1)) < 0) {
+        return false;
+    }
+    record = slot.record;
+    slot.sequence.store(tail + capacity, memory_order_release);
+    tail++;
+    return true;
+}
+
+uint16_t AsyncLog::group(const char *name, size_t length)
+{
+    auto find = [&](unsigned from, unsigned count) {
+        for (unsigned i = from; i < count; i++) {
+            if (strncmp(names[i], name, length) == 0 && names[i][length] == 0) {
+                return int(i);
+            }
+        }
+        return -1;
+    };
+    // Published names never change, so known ones are found without the lock
+    const unsigned seen = name_count.load(memory_order_acquire);
+    int found = find(0, seen);
+    if (found >= 0) {
+        return uint16_t(found);
+    }
+    lock_guard<mutex> guard(names_lock);
+    const unsigned count = name_count.load(memory_order_relaxed);
+    found = find(seen, count);
+    if (found >= 0) {
+        return uint16_t(found);
+    }
+    if (count == max_groups) {
+        return uint16_t(max_groups - 1);
+    }
+    names[count] = strndup(name, length);
+    name_count.store(count + 1, memory_order_release);
+    return uint16_t(count);
+}
+
+void AsyncLog::run()
+{
+    Record record;
+    bool more = true;
+    while (more) {
+        // Drains once more after stop() so nothing queued is lost
+        more = running;
+        while (pop(record)) {
+            handle(record);
+        }
+        sweep(!more);
+        const unsigned long lost = overflowed.exchange(0, memory_order_relaxed);
+        if (lost) {
+            il_warning("Log ring full, %lu messages lost", lost);
+        }
+        if (more) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+    }
+}
+
+void AsyncLog::handle(const Record &record)
+{
+    uint64_t key;
+    if (record.id) {
+        key = uint64_t(record.id) << 32 ^ uint64_t(record.source) << 16 ^ record.type
+            ^ uint64_t(record.kind) << 63;
+    } else {
+        // FNV-1a
+        key = 14695981039346656037ull;
+        for (uint16_t i = 0; i < record.length; i++) {
+            key = (key ^ uint8_t(record.text[i])) * 1099511628211ull;
+        }
+    }
+    const clock::time_point now = clock::now();
+    auto it = seen.find(key);
+    if (it != seen.end()
+        && chrono::duration<double>(now - it->second.since).count() < dedup_seconds) {
+        it->second.last = record;
+        it->second.repeats++;
+        return;
+    }
+
+    tokens = min(double(rate), tokens + chrono::duration<double>(now - refilled).count() * rate);
+    refilled = now;
+    if (tokens < 1) {
+        limited++;
+        return;
+    }
+    tokens--;
+    if (limited) {
+        il_warning("%lu messages over %u per second dropped", limited, rate);
+        limited = 0;
+    }
+    if (it != seen.end() && it->second.repeats) {
+        write(it->second.last, it->second.repeats);
+    }
+    write(record, 0);
+    Seen &entry = seen[key];
+    entry.last = record;
+    entry.repeats = 0;
+    entry.since = now;
+}
+
+void AsyncLog::sweep(bool all)
+{
+    const clock::time_point now = clock::now();
+    for (auto it = seen.begin(); it != seen.end();) {
+        Seen &entry = it->second;
+        const bool over = chrono::duration<double>(now - entry.since).count() >= dedup_seconds;
+        if (entry.repeats && (over || all)) {
+            write(entry.last, entry.repeats);
+            entry.repeats = 0;
+            entry.since = now;
+        } else if (over) {
+            // Quiet for a whole period, so the next one is logged in full
+            it = seen.erase(it);
+            continue;
+        }
+        ++it;
+    }
+}
+
+void AsyncLog::write(const Record &record, unsigned long repeats)
+{
+    const unsigned count = name_count.load(memory_order_acquire);
+    string groups;
+    for (unsigned i = 0; i < record.depth; i++) {
+        if (i) {
+            groups += '.';
+        }
+        groups += record.groups[i] < count? names[record.groups[i]] : "?";
+    }
+    writer(record, groups, repeats);
+}
@@ -0,0 +1,116 @@
+#ifndef DEMO_ASYNCLOG_H
+#define DEMO_ASYNCLOG_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/* Moves logging of driver and SDL messages off the threads that raise them.
+ * push() copies a message's raw ids, severity, open debug groups and the
+ * first bytes of its text into a fixed ring, without locking or allocating;
+ * a background thread pops them, turns them into text through the writer
+ * and logs them.
+ *
+ * The ring takes any number of producers and the one consumer: each slot
+ * carries a sequence number saying whether it's free for the position a
+ * producer claimed by compare-and-swap, or holds a finished message. When it
+ * is full, messages are dropped and counted rather than waited for.
+ *
+ * The background thread also keeps floods readable. A message id logged in
+ * the last dedup_seconds is only counted, and its count is logged once the
+ * period is over; and beyond rate messages per second, messages are dropped
+ * and counted too. */
+class AsyncLog {
+public:
+    struct Record {
+        enum Kind : uint8_t {
+            GL,
+            SDL
+        };
+        Kind kind;
+        // Debug groups open when the message was raised, outermost first,
+        // as far as they fit
+        uint8_t depth;
+        uint16_t groups[8];
+        // GL enums, or an SDL category and priority with type unused
+        uint32_t source, type, severity;
+        // Repeats of an id are deduplicated; 0 uses a hash of the text instead
+        uint32_t id;
+        uint16_t length;
+        char text[218];
+    };
+
+    /* Logs a record with its groups' names joined by dots; repeats is 0 the
+     * first time, then how many more times it was raised. */
+    typedef void (*Writer)(const Record &record, const std::string &groups,
+                           unsigned long repeats);
+
+    AsyncLog();
+    ~AsyncLog() {
+        stop();
+    }
+
+    // Starts the thread; records pushed before then wait in the ring
+    void start(Writer writer);
+    // Logs everything still queued and joins the thread; exit() runs it too
+    void stop();
+    // Returns false if the ring is full and the record was dropped
+    bool push(const Record &record);
+    /* Id of a debug group name, for Record::groups. Known names are looked
+     * up without locking; new ones are copied under a lock, which is only
+     * taken the first time a name is seen. */
+    uint16_t group(const char *name, size_t length);
+
+    float dedup_seconds = 5.f;
+    unsigned rate = 50;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct Seen {
+        Record last;
+        unsigned long repeats;
+        clock::time_point since;
+    };
+
+    static const unsigned capacity = 1024, max_groups = 256;
+
+    void run();
+    bool pop(Record &record);
+    void handle(const Record &record);
+    void write(const Record &record, unsigned long repeats);
+    void sweep(bool all);
+
+    struct Slot {
+        std::atomic<unsigned> sequence;
+        Record record;
+    };
+    Slot slots[capacity];
+    // Producers claim positions at head; only the background thread reads tail
+    alignas(64) std::atomic<unsigned> head{0};
+    alignas(64) unsigned tail = 0;
+    std::atomic<unsigned long> overflowed{0};
+
+    const char *names[max_groups];
+    std::atomic<unsigned> name_count{0};
+    std::mutex names_lock;
+
+    Writer writer = nullptr;
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    // Background thread only
+    std::unordered_map<uint64_t, Seen> seen;
+    double tokens = 0;
+    clock::time_point refilled;
+    unsigned long limited = 0;
+};
+
+extern AsyncLog demo_async_log;
+
+#endif
@@ -0,0 +1,45 @@
+#include "Camera.h"
+
+#include "GLState.h"
+
+static_assert(sizeof(CameraBlock) == 6 * 64 + 16, "CameraBlock must match std140");
+
+void CameraBuffer::update(const il_mat &view, const il_mat &projection, il_vec3 position)
+{
+    data.view = view;
+    data.projection = projection;
+    data.vp = il_mat_mul(projection, view);
+    data.inverse_view = il_mat_invert(view);
+    data.inverse_projection = il_mat_invert(projection);
+    data.inverse_vp = il_mat_invert(data.vp);
+    data.position[0] = position.x;
+    data.position[1] = position.y;
+    data.position[2] = position.z;
+    data.position[3] = 1.f;
+
+    if (!ubo) {
+        glGenBuffers(1, &ubo);
+    }
+    demo_gl.bind_buffer(GL_UNIFORM_BUFFER, ubo);
+    // Orphaned every frame so the update never waits on the GPU
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(data), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), &data);
+    glBindBufferBase(GL_UNIFORM_BUFFER, DEMO_CAMERA_BINDING, ubo);
+}
+
+void CameraBuffer::free()
+{
+    if (ubo) {
+        demo_gl.forget_buffer(ubo);
+        glDeleteBuffers(1, &ubo);
+    }
+    ubo = 0;
+}
+
+void CameraBuffer::attach(ilG_material *mat)
+{
+    GLuint index = glGetUniformBlockIndex(mat->program, "Camera");
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(mat->program, index, DEMO_CAMERA_BINDING);
+    }
+}
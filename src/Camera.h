@@ -0,0 +1,49 @@
+#ifndef DEMO_CAMERA_H
+#define DEMO_CAMERA_H
+
+#include "tgl/tgl.h"
+
+extern "C" {
+#include "graphics/material.h"
+#include "math/matrix.h"
+#include "math/vector.h"
+}
+
+enum {
+    // Uniform buffer binding point of the Camera block
+    DEMO_CAMERA_BINDING = 0,
+};
+
+/* std140 layout of the Camera uniform block. Shaders declare it as
+ *
+ *     layout(std140, row_major) uniform Camera {
+ *         mat4 view, projection, vp;
+ *         mat4 inverse_view, inverse_projection, inverse_vp;
+ *         vec4 camera_position;
+ *     };
+ *
+ * row_major matches il_mat, so matrices are copied as they are. */
+struct CameraBlock {
+    il_mat view, projection, vp;
+    il_mat inverse_view, inverse_projection, inverse_vp;
+    float position[4];
+};
+
+// Camera matrices computed once per frame and uploaded to a single UBO
+class CameraBuffer {
+public:
+    void update(const il_mat &view, const il_mat &projection, il_vec3 position);
+    void free();
+    // Points the material's Camera block, if it has one, at DEMO_CAMERA_BINDING
+    static void attach(ilG_material *mat);
+
+    const CameraBlock &block() const {
+        return data;
+    }
+
+private:
+    CameraBlock data;
+    GLuint ubo = 0;
+};
+
+#endif
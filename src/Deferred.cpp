@@ -0,0 +1,520 @@
+#include "Deferred.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "Camera.h"
+#include "GLState.h"
+
+extern "C" {
+#include "util/log.h"
+}
+
+enum {
+    TEX_DEPTH,
+    // The tonemapper only reads the accumulation buffer
+    TEX_ACCUM = TEX_DEPTH,
+    TEX_ALBEDO,
+    TEX_NORMAL,
+    TEX_MATERIAL,
+};
+
+// Bits of the accumulation buffer's stencil
+enum {
+    STENCIL_EDGE = 1,
+    STENCIL_VOLUME = 2,
+};
+
+/* Once-subdivided icosahedron, pushed out so its faces enclose the unit
+ * sphere. Returns the resulting vertex radius. */
+static float light_sphere(MeshData &data)
+{
+    const float t = (1.f + sqrtf(5.f)) / 2.f;
+    const float base[12][3] = {
+        {-1,  t,  0}, { 1,  t,  0}, {-1, -t,  0}, { 1, -t,  0},
+        { 0, -1,  t}, { 0,  1,  t}, { 0, -1, -t}, { 0,  1, -t},
+        { t,  0, -1}, { t,  0,  1}, {-t,  0, -1}, {-t,  0,  1},
+    };
+    static const uint32_t faces[20][3] = {
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+        {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1},
+    };
+    auto vertex = [&](float x, float y, float z) {
+        float len = sqrtf(x * x + y * y + z * z);
+        MeshVertex v;
+        memset(&v, 0, sizeof(v));
+        v.pos[0] = v.norm[0] = x / len;
+        v.pos[1] = v.norm[1] = y / len;
+        v.pos[2] = v.norm[2] = z / len;
+        data.vertices.push_back(v);
+        return uint32_t(data.vertices.size() - 1);
+    };
+    data.vertices.clear();
+    data.indices.clear();
+    for (auto &p : base) {
+        vertex(p[0], p[1], p[2]);
+    }
+    for (auto &f : faces) {
+        uint32_t mid[3];
+        for (unsigned i = 0; i < 3; i++) {
+            const float *a = data.vertices[f[i]].pos, *b = data.vertices[f[(i + 1) % 3]].pos;
+            mid[i] = vertex(a[0] + b[0], a[1] + b[1], a[2] + b[2]);
+        }
+        const uint32_t tris[4][3] = {
+            {f[0], mid[0], mid[2]}, {f[1], mid[1], mid[0]}, {f[2], mid[2], mid[1]},
+            {mid[0], mid[1], mid[2]},
+        };
+        for (auto &tri : tris) {
+            data.indices.insert(data.indices.end(), tri, tri + 3);
+        }
+    }
+    // Scale by the inverse of the closest face plane distance
+    float inner = 1.f;
+    for (size_t i = 0; i < data.indices.size(); i += 3) {
+        float c[3];
+        for (unsigned k = 0; k < 3; k++) {
+            c[k] = (data.vertices[data.indices[i]].pos[k] + data.vertices[data.indices[i + 1]].pos[k]
+                    + data.vertices[data.indices[i + 2]].pos[k]) / 3.f;
+        }
+        inner = fminf(inner, sqrtf(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]));
+    }
+    for (auto &v : data.vertices) {
+        for (float &p : v.pos) {
+            p /= inner;
+        }
+    }
+    return 1.f / inner;
+}
+
+bool Deferred::pass(Pass &pass, const char *name, const char *vert, const char *frag, char **error)
+{
+    ilG_material m;
+    ilG_material_init(&m);
+    ilG_material_name(&m, name);
+    ilG_material_arrayAttrib(&m, ILG_MESH_POS, "in_Position");
+    ilG_material_textureUnit(&m, TEX_DEPTH, "tex_Depth");
+    ilG_material_textureUnit(&m, TEX_ALBEDO, "tex_Albedo");
+    ilG_material_textureUnit(&m, TEX_NORMAL, "tex_Normal");
+    ilG_material_textureUnit(&m, TEX_MATERIAL, "tex_Material");
+    ilG_material_textureUnit(&m, TEX_ACCUM, "tex_Accum");
+    ilG_material_fragData(&m, 0, "out_Color");
+    if (!ilG_renderman_addMaterialFromFile(rm, m, vert, frag, &pass.mat, error)) {
+        return false;
+    }
+    ilG_material *mat = ilG_renderman_findMaterial(rm, pass.mat);
+    pass.program = mat->program;
+    pass.shade_samples = ilG_material_getLoc(mat, "shade_samples");
+    CameraBuffer::attach(mat);
+    return true;
+}
+
+bool Deferred::build(ilG_renderman *rm, bool hdr, unsigned msaa, bool volumes, char **error)
+{
+    this->rm = rm;
+    this->hdr = hdr;
+    this->volumes = volumes;
+    depth_bounds = volumes && TGL_EXTENSION(EXT_depth_bounds_test);
+    samples = msaa > 1? msaa : 0;
+    const bool ms = samples != 0;
+    if (!pass(ambient_pass, "Deferred Ambient", "deferred.vert",
+              ms? "deferred_ambient_ms.frag" : "deferred_ambient.frag", error)
+        || !pass(sun_pass, "Deferred Sun", "deferred.vert",
+                 ms? "deferred_sun_ms.frag" : "deferred_sun.frag", error)
+        || !pass(point_pass, "Deferred Point", "deferred_point.vert",
+                 ms? "deferred_point_ms.frag" : "deferred_point.frag", error)
+        || !pass(tonemap_pass, "Deferred Tonemap", "deferred.vert", "deferred_tonemap.frag",
+                 error)
+        || (ms && !pass(classify_pass, "Deferred Classify", "deferred.vert",
+                        "deferred_classify.frag", error))) {
+        return false;
+    }
+    built = true;
+    auto loc = [&](Pass &p, const char *name) {
+        return ilG_material_getLoc(ilG_renderman_findMaterial(rm, p.mat), name);
+    };
+    ambient_color = loc(ambient_pass, "color");
+    sun_direction = loc(sun_pass, "direction");
+    sun_color = loc(sun_pass, "color");
+    point_center = loc(point_pass, "center");
+    point_radius = loc(point_pass, "radius");
+    point_color = loc(point_pass, "color");
+    tone_exposure = loc(tonemap_pass, "exposure");
+    tone_gamma = loc(tonemap_pass, "gamma");
+
+    tgl_vao_init(&empty);
+    MeshData data;
+    sphere_scale = light_sphere(data);
+    sphere.upload(data);
+
+    resize(800, 600);
+    il_log("Compact G-buffer: %u bytes per pixel, %s accumulation", bytes_per_pixel(),
+           hdr? "R11G11B10F" : "RGBA8");
+    if (volumes) {
+        il_log("Stencil light volumes, %s depth bounds", depth_bounds? "with" : "without");
+    }
+    return true;
+}
+
+unsigned Deferred::bytes_per_pixel() const
+{
+    // depth/stencil + albedo + normal + material, per sample
+    return (4 + 4 + 4 + 4) * (samples? samples : 1);
+}
+
+void Deferred::resize(unsigned width, unsigned height)
+{
+    this->width = width;
+    this->height = height;
+    const GLenum target = samples? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    auto texture = [&](GLuint &tex, GLenum target, GLenum internal, GLenum format,
+                       GLenum type) {
+        if (!tex) {
+            glGenTextures(1, &tex);
+        }
+        demo_gl.bind_texture(0, target, tex);
+        // The bind may be elided, so make sure unit 0 is the one being set up
+        demo_gl.active_texture(0);
+        if (target == GL_TEXTURE_2D_MULTISAMPLE) {
+            glTexImage2DMultisample(target, GLsizei(samples), internal, GLsizei(width),
+                                    GLsizei(height), GL_TRUE);
+            return;
+        }
+        glTexImage2D(target, 0, GLint(internal), GLsizei(width), GLsizei(height), 0,
+                     format, type, NULL);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    };
+    texture(depth_tex, target, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+    texture(albedo_tex, target, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    texture(normal_tex, target, GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+    texture(material_tex, target, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    texture(accum_tex, GL_TEXTURE_2D, hdr? GL_R11F_G11F_B10F : GL_RGBA8, GL_RGB, GL_FLOAT);
+    if (!accum_stencil) {
+        glGenRenderbuffers(1, &accum_stencil);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, accum_stencil);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, GLsizei(width), GLsizei(height));
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (!gbuffer) {
+        glGenFramebuffers(1, &gbuffer);
+        glGenFramebuffers(1, &accum);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, gbuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, target, depth_tex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + DEMO_GBUFFER_ALBEDO,
+                           target, albedo_tex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + DEMO_GBUFFER_NORMAL,
+                           target, normal_tex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + DEMO_GBUFFER_MATERIAL,
+                           target, material_tex, 0);
+    static const GLenum buffers[] = {
+        GL_COLOR_ATTACHMENT0 + DEMO_GBUFFER_ALBEDO,
+        GL_COLOR_ATTACHMENT0 + DEMO_GBUFFER_NORMAL,
+        GL_COLOR_ATTACHMENT0 + DEMO_GBUFFER_MATERIAL,
+    };
+    glDrawBuffers(3, buffers);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        il_error("G-buffer incomplete: %#x", status);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, accum);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accum_tex, 0);
+    // Holds the stencil classes and, with light volumes, a copy of the scene's depth
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                              accum_stencil);
+    status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        il_error("Accumulation buffer incomplete: %#x", status);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Deferred::free()
+{
+    if (built) {
+        ilG_renderman_delMaterial(rm, ambient_pass.mat);
+        ilG_renderman_delMaterial(rm, sun_pass.mat);
+        ilG_renderman_delMaterial(rm, point_pass.mat);
+        ilG_renderman_delMaterial(rm, tonemap_pass.mat);
+        if (samples) {
+            ilG_renderman_delMaterial(rm, classify_pass.mat);
+        }
+        tgl_vao_free(&empty);
+        sphere.free();
+    }
+    built = false;
+    GLuint texes[] = {depth_tex, albedo_tex, normal_tex, material_tex, accum_tex};
+    glDeleteTextures(5, texes);
+    depth_tex = albedo_tex = normal_tex = material_tex = accum_tex = 0;
+    GLuint fbos[] = {gbuffer, accum};
+    glDeleteFramebuffers(2, fbos);
+    gbuffer = accum = 0;
+    glDeleteRenderbuffers(1, &accum_stencil);
+    accum_stencil = 0;
+    edges.free();
+    demo_gl.invalidate();
+}
+
+void Deferred::outputs(ilG_material &m)
+{
+    ilG_material_fragData(&m, DEMO_GBUFFER_ALBEDO, "out_Albedo");
+    ilG_material_fragData(&m, DEMO_GBUFFER_NORMAL, "out_Normal");
+    ilG_material_fragData(&m, DEMO_GBUFFER_MATERIAL, "out_Material");
+}
+
+void Deferred::bind_geometry()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, gbuffer);
+    glViewport(0, 0, GLsizei(width), GLsizei(height));
+    demo_gl.enable(GL_BLEND, false);
+    demo_gl.enable(GL_DEPTH_TEST, true);
+    demo_gl.depth_func(GL_LESS);
+    demo_gl.depth_mask(true);
+    glClearColor(0, 0, 0, 0);
+    glClearDepth(1.0);
+    glClearStencil(0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+}
+
+void Deferred::bind_gbuffer()
+{
+    const GLenum target = samples? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    demo_gl.bind_texture(TEX_DEPTH, target, depth_tex);
+    demo_gl.bind_texture(TEX_ALBEDO, target, albedo_tex);
+    demo_gl.bind_texture(TEX_NORMAL, target, normal_tex);
+    demo_gl.bind_texture(TEX_MATERIAL, target, material_tex);
+}
+
+void Deferred::fullscreen()
+{
+    demo_gl.bind_vao(empty.object);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void Deferred::copy_depth()
+{
+    // The G-buffer's depth can't be attached here while the passes sample it.
+    // A multisampled source resolves to a depth within each pixel's range
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer);
+    glBlitFramebuffer(0, 0, GLint(width), GLint(height), 0, 0, GLint(width), GLint(height),
+                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, accum);
+}
+
+void Deferred::classify()
+{
+    // The previous query is read without waiting, one frame late at best
+    GLuint passed;
+    if (edges.poll(passed)) {
+        complex_pixels = passed / float(width * height);
+    }
+
+    glClearStencil(0);
+    glClear(GL_STENCIL_BUFFER_BIT);
+    demo_gl.enable(GL_STENCIL_TEST, true);
+    glStencilFunc(GL_ALWAYS, STENCIL_EDGE, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    demo_gl.use_program(classify_pass.program);
+    glUniform1i(classify_pass.shade_samples, GLint(samples));
+    edges.begin();
+    fullscreen();
+    edges.end();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+}
+
+template<typename F>
+void Deferred::shade(Pass &pass, F draw)
+{
+    demo_gl.use_program(pass.program);
+    if (!samples) {
+        draw();
+        return;
+    }
+    glStencilFunc(GL_EQUAL, 0, STENCIL_EDGE);
+    glUniform1i(pass.shade_samples, 1);
+    draw();
+    glStencilFunc(GL_EQUAL, STENCIL_EDGE, STENCIL_EDGE);
+    glUniform1i(pass.shade_samples, GLint(samples));
+    draw();
+}
+
+void Deferred::ambient(il_vec3 color)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, accum);
+    demo_gl.enable(GL_DEPTH_TEST, false);
+    demo_gl.depth_mask(false);
+    demo_gl.enable(GL_BLEND, false);
+    demo_gl.enable(GL_CULL_FACE, false);
+    bind_gbuffer();
+    if (volumes) {
+        copy_depth();
+    }
+    if (samples) {
+        classify();
+    } else if (volumes) {
+        glClearStencil(0);
+        glClear(GL_STENCIL_BUFFER_BIT);
+        demo_gl.enable(GL_STENCIL_TEST, true);
+        // points() leaves the function testing for its volume mark
+        glStencilFunc(GL_ALWAYS, 0, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    }
+    shade(ambient_pass, [&]() {
+        glUniform3f(ambient_color, color.x, color.y, color.z);
+        fullscreen();
+    });
+}
+
+void Deferred::suns(const il_vec3 *directions, const ilG_light *lights, size_t count)
+{
+    demo_gl.enable(GL_BLEND, true);
+    demo_gl.blend_func(GL_ONE, GL_ONE);
+    shade(sun_pass, [&]() {
+        for (size_t i = 0; i < count; i++) {
+            il_vec3 d = directions[i];
+            float len = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+            if (len > 0) {
+                d.x /= len;
+                d.y /= len;
+                d.z /= len;
+            }
+            glUniform3f(sun_direction, d.x, d.y, d.z);
+            glUniform3f(sun_color, lights[i].color.x, lights[i].color.y, lights[i].color.z);
+            fullscreen();
+        }
+    });
+}
+
+void Deferred::points(const il_vec3 *positions, const ilG_light *lights, size_t count,
+                      const CameraBlock &camera)
+{
+    demo_gl.enable(GL_BLEND, true);
+    demo_gl.blend_func(GL_ONE, GL_ONE);
+    demo_gl.enable(GL_CULL_FACE, true);
+    sphere.bind();
+    if (!volumes) {
+        // Back faces, so the volume still shades when the camera is inside it
+        demo_gl.cull_face(GL_FRONT);
+        shade(point_pass, [&]() {
+            for (size_t i = 0; i < count; i++) {
+                glUniform3f(point_center, positions[i].x, positions[i].y, positions[i].z);
+                glUniform1f(point_radius, lights[i].radius);
+                glUniform3f(point_color, lights[i].color.x, lights[i].color.y,
+                            lights[i].color.z);
+                sphere.draw();
+            }
+        });
+        demo_gl.cull_face(GL_BACK);
+        demo_gl.enable(GL_CULL_FACE, false);
+        return;
+    }
+
+    // Depth of a view space z, from the projection's last two rows
+    const float *proj = camera.projection.data, *view = camera.view.data;
+    auto window_depth = [proj](float z) {
+        float d = (proj[10] * z + proj[11]) / (proj[14] * z + proj[15]) * 0.5f + 0.5f;
+        return d < 0.f? 0.f : d > 1.f? 1.f : d;
+    };
+    const float znear = proj[11] / (proj[10] - 1.f);
+    demo_gl.use_program(point_pass.program);
+    demo_gl.enable(GL_DEPTH_TEST, true);
+    demo_gl.enable(GL_STENCIL_TEST, true);
+    if (depth_bounds) {
+        glEnable(GL_DEPTH_BOUNDS_TEST_EXT);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const il_vec3 c = positions[i];
+        const float radius = lights[i].radius;
+        const float z = view[8] * c.x + view[9] * c.y + view[10] * c.z + view[11];
+        if (z - radius >= -znear) {
+            continue; // Behind the camera
+        }
+        glUniform3f(point_center, c.x, c.y, c.z);
+        glUniform1f(point_radius, radius);
+        glUniform3f(point_color, lights[i].color.x, lights[i].color.y, lights[i].color.z);
+        if (samples) {
+            glUniform1i(point_pass.shade_samples, 1);
+        }
+        if (depth_bounds) {
+            glDepthBoundsEXT(window_depth(fminf(z + radius, -znear)), window_depth(z - radius));
+        }
+
+        // Near plane corners are within 2 * znear of the eye for any sane fov
+        const float *eye = camera.position;
+        const float dx = c.x - eye[0], dy = c.y - eye[1], dz = c.z - eye[2];
+        const float reach = radius * sphere_scale + 2.f * znear;
+        if (dx * dx + dy * dy + dz * dz > reach * reach) {
+            // Mark pixels whose geometry is in front of the back faces
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            demo_gl.cull_face(GL_FRONT);
+            demo_gl.depth_func(GL_GEQUAL);
+            glStencilMask(STENCIL_VOLUME);
+            glStencilFunc(GL_ALWAYS, STENCIL_VOLUME, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            sphere.draw();
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            // Shade those with geometry behind the front faces, clearing the
+            // mark either way. Edge pixels are left to the per-sample pass
+            demo_gl.cull_face(GL_BACK);
+            demo_gl.depth_func(GL_LEQUAL);
+            glStencilFunc(GL_EQUAL, STENCIL_VOLUME, STENCIL_VOLUME | STENCIL_EDGE);
+            glStencilOp(GL_KEEP, GL_ZERO, GL_ZERO);
+            sphere.draw();
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+            glStencilMask(0xFF);
+        } else {
+            // The front faces are clipped by the near plane
+            demo_gl.cull_face(GL_FRONT);
+            demo_gl.depth_func(GL_GEQUAL);
+            glStencilFunc(GL_EQUAL, 0, STENCIL_EDGE);
+            sphere.draw();
+        }
+
+        if (samples) {
+            // The resolved depth is only a representative of an edge
+            // pixel's samples, so those test each sample in the shader
+            demo_gl.cull_face(GL_FRONT);
+            demo_gl.enable(GL_DEPTH_TEST, false);
+            if (depth_bounds) {
+                glDisable(GL_DEPTH_BOUNDS_TEST_EXT);
+            }
+            glStencilFunc(GL_EQUAL, STENCIL_EDGE, STENCIL_EDGE);
+            glUniform1i(point_pass.shade_samples, GLint(samples));
+            sphere.draw();
+            demo_gl.enable(GL_DEPTH_TEST, true);
+            if (depth_bounds) {
+                glEnable(GL_DEPTH_BOUNDS_TEST_EXT);
+            }
+        }
+    }
+    if (depth_bounds) {
+        glDisable(GL_DEPTH_BOUNDS_TEST_EXT);
+    }
+    demo_gl.enable(GL_DEPTH_TEST, false);
+    demo_gl.depth_func(GL_LESS);
+    demo_gl.cull_face(GL_BACK);
+    demo_gl.enable(GL_CULL_FACE, false);
+}
+
+void Deferred::tonemap(float exposure, float gamma)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    demo_gl.enable(GL_STENCIL_TEST, false);
+    demo_gl.enable(GL_BLEND, false);
+    demo_gl.bind_texture(TEX_ACCUM, GL_TEXTURE_2D, accum_tex);
+    demo_gl.use_program(tonemap_pass.program);
+    glUniform1f(tone_exposure, exposure);
+    glUniform1f(tone_gamma, gamma);
+    fullscreen();
+    // Leave the state IL's renderers expect
+    demo_gl.enable(GL_DEPTH_TEST, true);
+    demo_gl.depth_mask(true);
+}
@@ -0,0 +1,125 @@
+#ifndef DEMO_DEFERRED_H
+#define DEMO_DEFERRED_H
+
+#include <stddef.h>
+
+#include "Camera.h"
+#include "Mesh.h"
+#include "SampleCounter.h"
+#include "tgl/tgl.h"
+
+extern "C" {
+#include "graphics/material.h"
+#include "graphics/renderer.h"
+#include "math/vector.h"
+}
+
+enum GBufferLayout {
+    // IntenseLogic's G-buffer, lighting and tonemapper
+    GBUFFER_IL,
+    // The demo's own deferred pipeline over the compact layout below
+    GBUFFER_COMPACT,
+};
+
+/* Fragment outputs of materials drawn into the compact G-buffer:
+ *
+ *     albedo    RGBA8   rgb albedo
+ *     normal    RG16    world space normal, octahedral encoded into [0, 1]
+ *     material  RGBA8   gloss / 255, refraction index / 4, emission
+ *
+ * plus 24-bit depth and 8-bit stencil, which is 16 bytes per pixel. Lighting
+ * accumulates into R11G11B10F (RGBA8 without hdr). Material shaders pack
+ * their outputs with
+ *
+ *     vec2 oct_encode(vec3 n)
+ *     {
+ *         n /= abs(n.x) + abs(n.y) + abs(n.z);
+ *         vec2 s = vec2(n.x >= 0.0? 1.0 : -1.0, n.y >= 0.0? 1.0 : -1.0);
+ *         vec2 p = n.z >= 0.0? n.xy : (1.0 - abs(n.yx)) * s;
+ *         return p * 0.5 + 0.5;
+ *     }
+ */
+enum {
+    DEMO_GBUFFER_ALBEDO = 0,
+    DEMO_GBUFFER_NORMAL = 1,
+    DEMO_GBUFFER_MATERIAL = 2,
+};
+
+/* Deferred shading over the compact G-buffer. Per frame: bind_geometry(),
+ * draw the scene, then ambient(), suns(), points() and finally tonemap(),
+ * which writes to the default framebuffer. Lighting reconstructs positions
+ * from depth through the Camera block, so CameraBuffer::update must have run
+ * for the frame.
+ *
+ * With MSAA the G-buffer is multisampled and lighting resolves into a
+ * single-sample accumulation buffer. ambient() first classifies pixels:
+ * those whose samples differ in depth or normal (edges) get stencil 1. Each
+ * lighting pass then runs twice, shading only sample 0 where the stencil is
+ * 0 and every sample where it is 1, so interior pixels cost the same as
+ * without MSAA.
+ *
+ * With light volumes, the scene's depth is copied next to the accumulation
+ * buffer and each point light seen from outside takes two passes: its back
+ * faces mark the pixels with geometry in front of them in the stencil, then
+ * its front faces shade the marked pixels with geometry behind them, that is
+ * only those inside the volume. Lights around the camera shade behind their
+ * back faces only. EXT_depth_bounds_test, where available, also skips pixels
+ * outside each light's depth range. */
+class Deferred {
+public:
+    bool build(ilG_renderman *rm, bool hdr, unsigned msaa, bool volumes, char **error);
+    void resize(unsigned width, unsigned height);
+    void free();
+
+    // Binds and clears the G-buffer
+    void bind_geometry();
+    // Clears the accumulation buffer to ambient and emissive light
+    void ambient(il_vec3 color);
+    // directions point from the scene towards each sun
+    void suns(const il_vec3 *directions, const ilG_light *lights, size_t count);
+    void points(const il_vec3 *positions, const ilG_light *lights, size_t count,
+                const CameraBlock &camera);
+    void tonemap(float exposure, float gamma);
+
+    // Bound for materials drawn into the G-buffer
+    static void outputs(ilG_material &m);
+    unsigned bytes_per_pixel() const;
+
+    /* Share of pixels classified as edges, from the most recent frame whose
+     * query result has arrived; negative without MSAA. */
+    float complex_pixels = -1.f;
+
+private:
+    struct Pass {
+        ilG_matid mat;
+        GLuint program;
+        GLint shade_samples;
+    };
+
+    bool pass(Pass &pass, const char *name, const char *vert, const char *frag, char **error);
+    void bind_gbuffer();
+    void fullscreen();
+    void classify();
+    void copy_depth();
+    // Calls draw once per stencil class, see above
+    template<typename F>
+    void shade(Pass &pass, F draw);
+
+    ilG_renderman *rm = nullptr;
+    bool hdr = true, volumes = false, depth_bounds = false;
+    // Radius of the light sphere mesh's vertices, which enclose the unit sphere
+    float sphere_scale = 1.f;
+    unsigned samples = 0, width = 0, height = 0;
+    GLuint gbuffer = 0, accum = 0;
+    GLuint depth_tex = 0, albedo_tex = 0, normal_tex = 0, material_tex = 0, accum_tex = 0;
+    GLuint accum_stencil = 0;
+    SampleCounter edges;
+    Pass ambient_pass, sun_pass, point_pass, tonemap_pass, classify_pass;
+    GLint ambient_color, sun_direction, sun_color, point_center, point_radius, point_color,
+        tone_exposure, tone_gamma;
+    tgl_vao empty;
+    Mesh sphere;
+    bool built = false;
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <algorithm>
 #ifndef _WIN32
 #include <signal.h>
 #endif
@@ -15,6 +16,7 @@
 #include <xmmintrin.h>
 #endif
 
+#include "AsyncLog.h"
 #include "tgl/tgl.h"
 
 extern "C" {
@@ -41,16 +43,48 @@ const struct {
     {REQUIRED,  'd', "data",    "Adds a directory to look for data files"},
     {REQUIRED,  's', "shaders", "Adds a directory to look for GLSL shaders"},
     {REQUIRED,  'f', "shader",  "ShaderToy demo: Select shader to load"},
+    {REQUIRED,  'o', "output",  "ShaderToy demo: Render offline to foo%05d.png, foo.y4m or - (Y4M on stdout), or a still to foo.png"},
+    {REQUIRED,    0, "size",    "ShaderToy demo: Offline resolution as WxH (1280x720)"},
+    {REQUIRED,    0, "fps",     "ShaderToy demo: Offline frames per second (60)"},
+    {REQUIRED,    0, "duration", "ShaderToy demo: Offline length in seconds (10)"},
+    {REQUIRED,    0, "time",    "ShaderToy demo: Time of a still, in seconds (0)"},
+    {REQUIRED,    0, "tile",    "ShaderToy demo: Largest tile a still is drawn in, in pixels (1024)"},
+    {OPTIONAL,    0, "dynamic-resolution", "ShaderToy demo: Scale resolution to keep GPU time per frame under arg ms (14)"},
+    {OPTIONAL,    0, "playlist", "ShaderToy demo: Build every shader in shadertoys/, or those listed in arg, and switch between them"},
+    {REQUIRED,    0, "advance", "ShaderToy demo: Move to the next playlist shader every arg seconds"},
+    {REQUIRED,    0, "unfocused-fps", "Frames per second while the window is unfocused, 0 for no limit (5)"},
     {NO_ARG,      0, "fpe",     "Enable trapping on floating point exceptions"},
+    {NO_ARG,      0, "compress-textures", "Block compress textures when baking the texture cache"},
+    {NO_ARG,      0, "no-multidraw", "Issue one draw call per object even on GL 4.3"},
+    {NO_ARG,      0, "compact-gbuffer", "Use the demo's deferred pipeline with a compact G-buffer"},
+    {NO_ARG,      0, "depth-prepass", "Lay down depth before shading the G-buffer"},
+    {NO_ARG,      0, "no-light-volumes", "Shade every pixel a point light's sphere covers"},
+    {NO_ARG,      0, "occlusion-culling", "Skip lights and objects hidden in the last frames' depth"},
+    {REQUIRED,    0, "frames-in-flight", "Frames the GPU may lag behind, 1 to 3 (2)"},
     {NO_ARG,      0, NULL,      NULL}
 };
 
 static void sdl_error(void *ptr, int cat, SDL_LogPriority pri, const char *reason)
 {
     (void)ptr;
+    AsyncLog::Record record;
+    record.kind = AsyncLog::Record::SDL;
+    record.depth = 0;
+    record.source = uint32_t(cat);
+    record.type = 0;
+    record.severity = uint32_t(pri);
+    record.id = 0;
+    const size_t length = strlen(reason);
+    record.length = uint16_t(min(length, sizeof(record.text)));
+    memcpy(record.text, reason, record.length);
+    demo_async_log.push(record);
+}
+
+static void write_sdl(const AsyncLog::Record &record, const string &reason, unsigned long repeats)
+{
     const char *scat;
     unsigned level;
-    switch (cat) {
+    switch (record.source) {
 #define C(n, s) case n: scat = s; break;
         C(SDL_LOG_CATEGORY_APPLICATION, "application"   )
         C(SDL_LOG_CATEGORY_ERROR,       "error"         )
@@ -64,7 +98,7 @@ static void sdl_error(void *ptr, int cat, SDL_LogPriority pri, const char *reaso
         scat = "unknown";
 #undef C
     }
-    switch (pri) {
+    switch (record.severity) {
 #define C(n, l) case n: level = l; break;
         C(SDL_LOG_PRIORITY_VERBOSE,  5)
         C(SDL_LOG_PRIORITY_DEBUG,    4)
@@ -78,14 +112,121 @@ static void sdl_error(void *ptr, int cat, SDL_LogPriority pri, const char *reaso
     }
     il_logmsg log;
     memset(&log, 0, sizeof(il_logmsg));
-    char msg_str[64];
-    sprintf(msg_str, "SDL %s error", scat);
+    char msg_str[96];
+    if (repeats) {
+        sprintf(msg_str, "SDL %s error repeated %lu times", scat, repeats);
+    } else {
+        sprintf(msg_str, "SDL %s error", scat);
+    }
     log.level = il_loglevel(level);
     log.msg = il_string_new(msg_str);
-    log.reason = il_string_new((char*)reason);
+    log.reason = il_string_bin(const_cast<char*>(reason.data()), reason.size());
     il_logger_log(il_logger_cur(), log);
 }
 
+struct DebugGroupStack {
+    uint16_t ids[sizeof(AsyncLog::Record::groups) / sizeof(uint16_t)];
+    unsigned depth = 0;
+};
+
+/* Runs on the GL thread inside the call that raised the message, as debug
+ * output is synchronous: pushes and pops only nest in call order. So the
+ * group stack needs no locking, and the callback only queues messages. */
+static GLvoid APIENTRY error_cb(GLenum esource, GLenum etype, GLuint id, GLenum eseverity,
+                                GLsizei length, const GLchar* message, const GLvoid* user)
+{
+    auto &stack = *reinterpret_cast<DebugGroupStack*>(const_cast<void*>(user));
+    const unsigned max_depth = sizeof(stack.ids) / sizeof(stack.ids[0]);
+    switch (etype) {
+    case GL_DEBUG_TYPE_PUSH_GROUP:
+        if (stack.depth < max_depth) {
+            stack.ids[stack.depth] = demo_async_log.group(message, size_t(length));
+        }
+        stack.depth++;
+        return;
+    case GL_DEBUG_TYPE_POP_GROUP:
+        if (stack.depth) {
+            stack.depth--;
+        }
+        return;
+    }
+    AsyncLog::Record record;
+    record.kind = AsyncLog::Record::GL;
+    record.depth = uint8_t(min(stack.depth, max_depth));
+    memcpy(record.groups, stack.ids, record.depth * sizeof(stack.ids[0]));
+    record.source = esource;
+    record.type = etype;
+    record.severity = eseverity;
+    record.id = id;
+    record.length = uint16_t(min(size_t(length), sizeof(record.text)));
+    memcpy(record.text, message, record.length);
+    demo_async_log.push(record);
+}
+
+static void write_gl(const AsyncLog::Record &record, const string &groups, unsigned long repeats)
+{
+    const char *ssource;
+    switch(record.source) {
+        case GL_DEBUG_SOURCE_API_ARB:               ssource=" API";              break;
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM_ARB:     ssource=" Window System";    break;
+        case GL_DEBUG_SOURCE_SHADER_COMPILER_ARB:   ssource=" Shader Compiler";  break;
+        case GL_DEBUG_SOURCE_THIRD_PARTY_ARB:       ssource=" Third Party";      break;
+        case GL_DEBUG_SOURCE_APPLICATION_ARB:       ssource=" Application";      break;
+        case GL_DEBUG_SOURCE_OTHER_ARB:             ssource="";            break;
+        default: ssource="???";
+    }
+    const char *stype;
+    switch(record.type) {
+        case GL_DEBUG_TYPE_ERROR_ARB:               stype=" error";                 break;
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR_ARB: stype=" deprecated behaviour";  break;
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR_ARB:  stype=" undefined behaviour";   break;
+        case GL_DEBUG_TYPE_PORTABILITY_ARB:         stype=" portability issue";     break;
+        case GL_DEBUG_TYPE_PERFORMANCE_ARB:         stype=" performance issue";     break;
+        case GL_DEBUG_TYPE_OTHER_ARB:               stype="";                       break;
+        default: stype="???";
+    }
+    const char *sseverity;
+    switch(record.severity) {
+        case GL_DEBUG_SEVERITY_HIGH_ARB:    sseverity="high";   break;
+        case GL_DEBUG_SEVERITY_MEDIUM_ARB:  sseverity="medium"; break;
+        case GL_DEBUG_SEVERITY_LOW_ARB:     sseverity="low";    break;
+        default: sseverity="???";
+    }
+    string msg(record.text, record.length);
+    if (!msg.empty() && msg.back() == '\n') {
+        msg.pop_back();
+    }
+
+    string buf = string(sseverity) + stype + " #" + to_string(record.id);
+    if (!groups.empty()) {
+        buf += " in " + groups;
+    }
+    if (repeats) {
+        buf += " repeated " + to_string(repeats) + " times";
+    }
+    buf += ": " + msg;
+    string source = string("OpenGL") + ssource;
+
+    il_logmsg lmsg;
+    memset(&lmsg, 0, sizeof(il_logmsg));
+    lmsg.level = IL_NOTIFY;
+    lmsg.msg = il_string_bin(const_cast<char*>(buf.data()), buf.size());
+    lmsg.func = il_string_bin(const_cast<char*>(source.data()), source.size());
+
+    il_logger_log(il_logger_cur(), lmsg);
+}
+
+// Runs on the log's thread
+static void write_message(const AsyncLog::Record &record, const string &groups,
+                          unsigned long repeats)
+{
+    if (record.kind == AsyncLog::Record::SDL) {
+        write_sdl(record, string(record.text, record.length), repeats);
+    } else {
+        write_gl(record, groups, repeats);
+    }
+}
+
 void demoLoad(int argc, char **argv)
 {
     size_t i;
@@ -132,6 +273,67 @@ void demoLoad(int argc, char **argv)
         option("f", "shader") {
             demo_shader = std::move(arg);
         }
+        option("o", "output") {
+            demo_output = std::move(arg);
+        }
+        option("", "size") {
+            unsigned width, height;
+            if (sscanf(arg.c_str(), "%ux%u", &width, &height) == 2 && width && height) {
+                demo_size = std::make_pair(width, height);
+            } else {
+                il_error("Expected WxH, got %s", arg.c_str());
+            }
+        }
+        option("", "fps") {
+            float fps = float(atof(arg.c_str()));
+            if (fps > 0) {
+                demo_fps = fps;
+            } else {
+                il_error("Expected a positive frame rate, got %s", arg.c_str());
+            }
+        }
+        option("", "duration") {
+            float duration = float(atof(arg.c_str()));
+            if (duration > 0) {
+                demo_duration = duration;
+            } else {
+                il_error("Expected a positive duration, got %s", arg.c_str());
+            }
+        }
+        option("", "time") {
+            demo_time = float(atof(arg.c_str()));
+        }
+        option("", "dynamic-resolution") {
+            float budget = arg.empty()? 14.f : float(atof(arg.c_str()));
+            if (budget > 0) {
+                demo_frame_budget = budget;
+            } else {
+                il_error("Expected a positive frame time, got %s", arg.c_str());
+            }
+        }
+        option("", "playlist") {
+            demo_playlist = true;
+            demo_playlist_file = arg;
+        }
+        option("", "advance") {
+            float advance = float(atof(arg.c_str()));
+            if (advance > 0) {
+                demo_advance = advance;
+            } else {
+                il_error("Expected a positive interval, got %s", arg.c_str());
+            }
+        }
+        option("", "tile") {
+            unsigned tile = unsigned(strtoul(arg.c_str(), NULL, 10));
+            if (tile > 0) {
+                demo_tile = tile;
+            } else {
+                il_error("Expected a positive tile size, got %s", arg.c_str());
+            }
+        }
+        option("", "unfocused-fps") {
+            demo_unfocused_fps = float(atof(arg.c_str()));
+        }
         option("", "fpe") {
 #ifdef _WIN32
             _controlfp(_EM_INVALID | _EM_ZERODIVIDE | _EM_OVERFLOW, _MCW_EM);
@@ -142,6 +344,32 @@ void demoLoad(int argc, char **argv)
 #endif
             il_log("Floating point exceptions enabled");
         }
+        option("", "compress-textures") {
+            demo_compress_textures = true;
+        }
+        option("", "no-multidraw") {
+            demo_multidraw = false;
+        }
+        option("", "compact-gbuffer") {
+            demo_compact_gbuffer = true;
+        }
+        option("", "depth-prepass") {
+            demo_depth_prepass = true;
+        }
+        option("", "no-light-volumes") {
+            demo_light_volumes = false;
+        }
+        option("", "occlusion-culling") {
+            demo_occlusion_culling = true;
+        }
+        option("", "frames-in-flight") {
+            const unsigned long frames = strtoul(arg.c_str(), NULL, 10);
+            if (frames < 1 || frames > 3) {
+                il_warning("--frames-in-flight takes 1 to 3, keeping %u", demo_frames_in_flight);
+            } else {
+                demo_frames_in_flight = unsigned(frames);
+            }
+        }
     }
 
     ilG_shaders_addPath("shaders");
@@ -157,79 +385,11 @@ void demoLoad(int argc, char **argv)
     signal(SIGINT, SIG_DFL);
     signal(SIGTERM, SIG_DFL);
 #endif
+    demo_async_log.start(write_message);
     SDL_LogSetOutputFunction(sdl_error, NULL);
     il_log("Using SDL %s", SDL_GetRevision());
 }
 
-struct DebugGroupStack {
-    vector<string> entries;
-};
-
-static GLvoid APIENTRY error_cb(GLenum esource, GLenum etype, GLuint id, GLenum eseverity,
-                                GLsizei length, const GLchar* message, const GLvoid* user)
-{
-    auto &stack = *reinterpret_cast<DebugGroupStack*>(const_cast<void*>(user));
-    const char *ssource;
-    switch(esource) {
-        case GL_DEBUG_SOURCE_API_ARB:               ssource=" API";              break;
-        case GL_DEBUG_SOURCE_WINDOW_SYSTEM_ARB:     ssource=" Window System";    break;
-        case GL_DEBUG_SOURCE_SHADER_COMPILER_ARB:   ssource=" Shader Compiler";  break;
-        case GL_DEBUG_SOURCE_THIRD_PARTY_ARB:       ssource=" Third Party";      break;
-        case GL_DEBUG_SOURCE_APPLICATION_ARB:       ssource=" Application";      break;
-        case GL_DEBUG_SOURCE_OTHER_ARB:             ssource="";            break;
-        default: ssource="???";
-    }
-    const char *stype;
-    switch(etype) {
-        case GL_DEBUG_TYPE_ERROR_ARB:               stype=" error";                 break;
-        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR_ARB: stype=" deprecated behaviour";  break;
-        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR_ARB:  stype=" undefined behaviour";   break;
-        case GL_DEBUG_TYPE_PORTABILITY_ARB:         stype=" portability issue";     break;
-        case GL_DEBUG_TYPE_PERFORMANCE_ARB:         stype=" performance issue";     break;
-        case GL_DEBUG_TYPE_OTHER_ARB:               stype="";                       break;
-        case GL_DEBUG_TYPE_PUSH_GROUP: {
-            stack.entries.push_back(message);
-            return;
-        }
-        case GL_DEBUG_TYPE_POP_GROUP: {
-            stack.entries.pop_back();
-            return;
-        }
-        default: stype="???";
-    }
-    const char *sseverity;
-    switch(eseverity) {
-        case GL_DEBUG_SEVERITY_HIGH_ARB:    sseverity="high";   break;
-        case GL_DEBUG_SEVERITY_MEDIUM_ARB:  sseverity="medium"; break;
-        case GL_DEBUG_SEVERITY_LOW_ARB:     sseverity="low";    break;
-        default: sseverity="???";
-    }
-    string msg(message, length);
-    if (msg.back() == '\n') {
-        msg.pop_back();
-    }
-
-    string groups;
-    if (!stack.entries.empty()) {
-        groups += " in " + stack.entries.front();
-        for (auto it = stack.entries.begin()+1; it != stack.entries.end(); it++) {
-            groups += ".";
-            groups += *it;
-        }
-    }
-
-    string buf = string(sseverity) + stype + " #" + to_string(id) + groups + ": " + msg;
-    string source = string("OpenGL") + ssource;
-
-    il_logmsg lmsg;
-    memset(&lmsg, 0, sizeof(il_logmsg));
-    lmsg.level = IL_NOTIFY;
-    lmsg.msg = il_string_bin(const_cast<char*>(buf.data()), buf.size());
-    lmsg.func = il_string_bin(const_cast<char*>(source.data()), source.size());
-
-    il_logger_log(il_logger_cur(), lmsg);
-}
-
 Window createWindow(const char *title, unsigned msaa)
 {
     Window window;
@@ -268,6 +428,7 @@ Window createWindow(const char *title, unsigned msaa)
         glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, NULL, true);
         glDebugMessageCallback(&error_cb, new DebugGroupStack);
         glEnable(GL_DEBUG_OUTPUT);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
         il_log("KHR_debug present, enabling advanced errors");
         tgl_check("glDebugMessageCallback()");
     } else {
@@ -289,3 +450,21 @@ extern "C" FILE * __cdecl __iob_func(void)
 
 ilA_fs demo_fs;
 std::string demo_shader;
+std::string demo_output;
+std::pair<unsigned, unsigned> demo_size(1280, 720);
+float demo_fps = 60.f;
+float demo_duration = 10.f;
+float demo_time = 0.f;
+unsigned demo_tile = 1024;
+float demo_frame_budget = 0.f;
+bool demo_playlist = false;
+std::string demo_playlist_file;
+float demo_advance = 0.f;
+float demo_unfocused_fps = 5.f;
+bool demo_compress_textures = false;
+bool demo_multidraw = true;
+bool demo_compact_gbuffer = false;
+bool demo_depth_prepass = false;
+bool demo_light_volumes = true;
+bool demo_occlusion_culling = false;
+unsigned demo_frames_in_flight = 2;
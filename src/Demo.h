@@ -34,5 +34,28 @@ Window createWindow(const char *title, unsigned msaa = 0);
 
 extern ilA_fs demo_fs;
 extern std::string demo_shader;
+extern std::string demo_output;
+extern std::pair<unsigned, unsigned> demo_size;
+extern float demo_fps;
+extern float demo_duration;
+extern float demo_time;
+extern unsigned demo_tile;
+// GPU milliseconds per frame for dynamic resolution, 0 when disabled
+extern float demo_frame_budget;
+extern bool demo_playlist;
+// Empty to scan the shadertoys directory
+extern std::string demo_playlist_file;
+// Seconds per playlist shader, 0 to only switch by key
+extern float demo_advance;
+// Frame rate limit while the window is unfocused, 0 for none
+extern float demo_unfocused_fps;
+extern bool demo_compress_textures;
+extern bool demo_multidraw;
+extern bool demo_compact_gbuffer;
+extern bool demo_depth_prepass;
+extern bool demo_light_volumes;
+extern bool demo_occlusion_culling;
+// Frames the limiter lets the driver queue before the CPU waits
+extern unsigned demo_frames_in_flight;
 
 #endif
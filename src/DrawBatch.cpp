@@ -0,0 +1,174 @@
+#include "DrawBatch.h"
+
+#include "GLState.h"
+
+using namespace std;
+
+static_assert(sizeof(DrawBatch::DrawData) == 9 * 4 * sizeof(float),
+              "DrawData must be 9 RGBA32F texels");
+
+bool DrawBatch::supported()
+{
+    return epoxy_gl_version() >= 43;
+}
+
+unsigned DrawBatch::group(Bind bind)
+{
+    groups.push_back(Group());
+    groups.back().bind = move(bind);
+    return unsigned(groups.size() - 1);
+}
+
+void DrawBatch::add(unsigned group, const Mesh &mesh, const DrawData &data)
+{
+    const GeometryArena::Range &range = mesh.range();
+    if (range.count == 0) {
+        return;
+    }
+    Group &g = groups[group];
+    Command cmd;
+    cmd.count = GLuint(range.count);
+    cmd.instance_count = 1;
+    cmd.first_index = range.first_index;
+    cmd.base_vertex = range.base_vertex;
+    cmd.base_instance = 0;
+    g.commands.push_back(cmd);
+    g.data.push_back(data);
+}
+
+void DrawBatch::reserve(size_t count)
+{
+    if (count <= capacity) {
+        return;
+    }
+    if (!indirect) {
+        glGenBuffers(1, &indirect);
+        glGenBuffers(1, &data_buffer);
+        glGenBuffers(1, &ids);
+        glGenTextures(1, &data_tex);
+    }
+    size_t cap = capacity? capacity : 64;
+    while (cap < count) {
+        cap *= 2;
+    }
+    capacity = cap;
+
+    vector<GLuint> seq(cap);
+    for (size_t i = 0; i < cap; i++) {
+        seq[i] = GLuint(i);
+    }
+    demo_gl.bind_buffer(GL_ARRAY_BUFFER, ids);
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(sizeof(GLuint) * cap), seq.data(), GL_STATIC_DRAW);
+    demo_gl.bind_buffer(GL_TEXTURE_BUFFER, data_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, GLsizeiptr(sizeof(DrawData) * cap), NULL, GL_STREAM_DRAW);
+    demo_gl.bind_texture(DEMO_DRAW_DATA_UNIT, GL_TEXTURE_BUFFER, data_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, data_buffer);
+}
+
+size_t DrawBatch::upload()
+{
+    if (uploaded) {
+        return draws;
+    }
+    uploaded = true;
+    draws = calls = 0;
+    for (auto &g : groups) {
+        draws += g.commands.size();
+    }
+    if (draws == 0) {
+        return 0;
+    }
+    reserve(draws);
+
+    // Number draws in submission order; that is their DrawData index
+    vector<Command> commands;
+    commands.reserve(draws);
+    data.clear();
+    for (auto &g : groups) {
+        for (auto cmd : g.commands) {
+            cmd.base_instance = GLuint(commands.size());
+            commands.push_back(cmd);
+        }
+        data.insert(data.end(), g.data.begin(), g.data.end());
+    }
+
+    // Orphan, then fill, so the driver doesn't stall on last frame's draws
+    demo_gl.bind_buffer(GL_DRAW_INDIRECT_BUFFER, indirect);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, GLsizeiptr(sizeof(Command) * capacity), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, GLsizeiptr(sizeof(Command) * draws), commands.data());
+    demo_gl.bind_buffer(GL_TEXTURE_BUFFER, data_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, GLsizeiptr(sizeof(DrawData) * capacity), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, GLsizeiptr(sizeof(DrawData) * draws), data.data());
+    return draws;
+}
+
+void DrawBatch::attach_ids()
+{
+    // Goes into whichever VAO is bound
+    demo_gl.bind_buffer(GL_ARRAY_BUFFER, ids);
+    glVertexAttribIPointer(DEMO_DRAW_ID_ATTRIB, 1, GL_UNSIGNED_INT, 0, NULL);
+    glVertexAttribDivisor(DEMO_DRAW_ID_ATTRIB, 1);
+    glEnableVertexAttribArray(DEMO_DRAW_ID_ATTRIB);
+}
+
+void DrawBatch::prepass(const Bind &bind)
+{
+    if (upload() == 0) {
+        return;
+    }
+    bind();
+    demo_geometry.bind_positions();
+    attach_ids();
+    demo_gl.bind_buffer(GL_DRAW_INDIRECT_BUFFER, indirect);
+    demo_gl.bind_texture(DEMO_DRAW_DATA_UNIT, GL_TEXTURE_BUFFER, data_tex);
+    // Every group shares the depth program, so one call covers them all
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, GLsizei(draws), 0);
+    calls++;
+}
+
+void DrawBatch::submit()
+{
+    const bool empty = upload() == 0;
+    uploaded = false;
+    if (empty) {
+        return;
+    }
+
+    demo_geometry.bind();
+    attach_ids();
+    demo_gl.bind_buffer(GL_DRAW_INDIRECT_BUFFER, indirect);
+
+    size_t offset = 0;
+    for (auto &g : groups) {
+        if (g.commands.empty()) {
+            continue;
+        }
+        g.bind();
+        demo_gl.bind_texture(DEMO_DRAW_DATA_UNIT, GL_TEXTURE_BUFFER, data_tex);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                   (GLvoid*)(sizeof(Command) * offset),
+                                   GLsizei(g.commands.size()), 0);
+        calls++;
+        offset += g.commands.size();
+        g.commands.clear();
+        g.data.clear();
+    }
+}
+
+void DrawBatch::free()
+{
+    if (indirect) {
+        demo_gl.forget_buffer(indirect);
+        demo_gl.forget_buffer(data_buffer);
+        demo_gl.forget_buffer(ids);
+        demo_gl.invalidate();
+        glDeleteBuffers(1, &indirect);
+        glDeleteBuffers(1, &data_buffer);
+        glDeleteBuffers(1, &ids);
+        glDeleteTextures(1, &data_tex);
+    }
+    indirect = data_buffer = ids = data_tex = 0;
+    capacity = 0;
+    uploaded = false;
+    data.clear();
+}
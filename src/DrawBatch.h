@@ -0,0 +1,85 @@
+#ifndef DEMO_DRAWBATCH_H
+#define DEMO_DRAWBATCH_H
+
+#include <functional>
+#include <vector>
+
+#include "Mesh.h"
+#include "tgl/tgl.h"
+
+extern "C" {
+#include "math/matrix.h"
+}
+
+enum {
+    // Instanced uint attribute holding the index of the draw's DrawData
+    DEMO_DRAW_ID_ATTRIB = 15,
+    // Texture unit of the samplerBuffer holding every DrawData
+    DEMO_DRAW_DATA_UNIT = 15,
+};
+
+/* Multi-draw-indirect submission for meshes in the geometry arena (needs GL
+ * 4.3). Drawables record (group, mesh, per-draw data) triples during the
+ * frame; submit() uploads all commands and data at once, then issues one
+ * glMultiDrawElementsIndirect per group.
+ *
+ * A group is a material plus its textures, set up by a callback registered
+ * once. Batched shaders read their matrices with
+ *
+ *     in uint in_DrawID;
+ *     uniform samplerBuffer draws;
+ *     texelFetch(draws, int(in_DrawID) * 9 + n)
+ *
+ * where texels 0-3 are the rows of model, 4-7 the rows of imt and 8 the
+ * color. in_DrawID is fed by an instanced attribute, using each command's
+ * baseInstance as the draw index. View and projection come from the Camera
+ * uniform block (Camera.h). */
+class DrawBatch {
+public:
+    struct DrawData {
+        il_mat model, imt;
+        float color[4];
+    };
+    typedef std::function<void()> Bind;
+
+    static bool supported();
+
+    // Registers a material group; bind is called before its draws are issued
+    unsigned group(Bind bind);
+    void add(unsigned group, const Mesh &mesh, const DrawData &data);
+    /* Depth-only draw of everything recorded so far as a single multi-draw
+     * over the arena's position VAO; bind sets up the depth program. The
+     * upload is kept for the following submit(). */
+    void prepass(const Bind &bind);
+    // Issues and clears everything recorded since the last submit
+    void submit();
+    void free();
+
+    // Last submit: draws recorded and GL draw calls issued for them
+    size_t draws = 0, calls = 0;
+
+private:
+    struct Command {
+        GLuint count, instance_count, first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+    struct Group {
+        Bind bind;
+        std::vector<Command> commands;
+        std::vector<DrawData> data;
+    };
+
+    void reserve(size_t count);
+    // Uploads commands and data once per submit, returns the draw count
+    size_t upload();
+    void attach_ids();
+
+    std::vector<Group> groups;
+    std::vector<DrawData> data;
+    GLuint indirect = 0, data_buffer = 0, data_tex = 0, ids = 0;
+    size_t capacity = 0;
+    bool uploaded = false;
+};
+
+#endif
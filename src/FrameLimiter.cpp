@@ -0,0 +1,95 @@
+#include "FrameLimiter.h"
+
+#include <SDL.h>
+#include <algorithm>
+
+void FrameLimiter::input(uint32_t timestamp)
+{
+    // The oldest input waits the longest
+    if (!input_pending) {
+        input_pending = true;
+        input_timestamp = timestamp;
+    }
+}
+
+void FrameLimiter::retire(const Frame &frame)
+{
+    glDeleteSync(frame.fence);
+    double done_ms = SDL_GetTicks();
+    if (frame.query) {
+        // Written before the fence, so the result is there once it signals
+        GLuint64 gl_ns;
+        glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &gl_ns);
+        glDeleteQueries(1, &frame.query);
+        done_ms = gl_ns / 1e6 + frame.clock_offset;
+    }
+    if (!frame.input) {
+        return;
+    }
+    const double ms = std::max(0.0, done_ms - frame.timestamp);
+    stats.inputs++;
+    stats.latency_ms += ms;
+    stats.worst_ms = std::max(stats.worst_ms, ms);
+}
+
+void FrameLimiter::retire_finished()
+{
+    while (!frames.empty()
+           && glClientWaitSync(frames.front().fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+        retire(frames.front());
+        frames.pop_front();
+    }
+}
+
+void FrameLimiter::begin_frame()
+{
+    retire_finished();
+}
+
+void FrameLimiter::end_frame()
+{
+    if (!checked) {
+        timestamps = epoxy_gl_version() >= 33 || TGL_EXTENSION(ARB_timer_query);
+        checked = true;
+    }
+    Frame frame;
+    frame.query = 0;
+    frame.clock_offset = 0;
+    if (timestamps) {
+        glGenQueries(1, &frame.query);
+        glQueryCounter(frame.query, GL_TIMESTAMP);
+        GLint64 gl_now;
+        glGetInteger64v(GL_TIMESTAMP, &gl_now);
+        frame.clock_offset = SDL_GetTicks() - gl_now / 1e6;
+    }
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame.input = input_pending;
+    frame.timestamp = input_timestamp;
+    input_pending = false;
+    frames.push_back(frame);
+    stats.frames++;
+
+    retire_finished();
+    while (frames.size() > max_frames) {
+        stats.waits++;
+        const uint64_t start = SDL_GetPerformanceCounter();
+        while (glClientWaitSync(frames.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                1000000000) == GL_TIMEOUT_EXPIRED) {}
+        stats.wait_ms += double(SDL_GetPerformanceCounter() - start) * 1000
+            / double(SDL_GetPerformanceFrequency());
+        retire(frames.front());
+        frames.pop_front();
+    }
+}
+
+void FrameLimiter::free()
+{
+    for (const Frame &frame : frames) {
+        glDeleteSync(frame.fence);
+        if (frame.query) {
+            glDeleteQueries(1, &frame.query);
+        }
+    }
+    frames.clear();
+    input_pending = false;
+}
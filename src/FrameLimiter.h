@@ -0,0 +1,63 @@
+#ifndef DEMO_FRAMELIMITER_H
+#define DEMO_FRAMELIMITER_H
+
+#include <deque>
+#include <stdint.h>
+
+#include "tgl/tgl.h"
+
+/* Bounds how many frames the driver may queue ahead of the GPU. Left alone,
+ * it buffers several, and input read at the start of a frame only reaches the
+ * screen once all of them have been shown. After each swap a fence is placed,
+ * and end_frame() waits until no more than max_frames are unfinished, so the
+ * next frame's input is read as late as the GPU allows.
+ *
+ * It also measures input-to-present latency: input() marks the SDL timestamp
+ * of input the next frame reflects, and the latency runs from there to when
+ * the GPU finished the frame, which with vsync is within a refresh of it
+ * reaching the screen. With ARB_timer_query that is a GL_TIMESTAMP written
+ * after the swap, moved onto SDL's clock by comparing the GL's and SDL's
+ * clocks as the frame ends. Without it, it is when the frame's fence was
+ * first seen signalled, at most a frame late, so the numbers are upper
+ * bounds. */
+class FrameLimiter {
+public:
+    struct Stats {
+        unsigned long frames = 0, waits = 0, inputs = 0;
+        double wait_ms = 0, latency_ms = 0, worst_ms = 0;
+    };
+
+    // Marks input, timestamped by SDL in milliseconds, that the next frame shows
+    void input(uint32_t timestamp);
+    // Call before drawing; retires frames the GPU has finished
+    void begin_frame();
+    // Call after the swap
+    void end_frame();
+    void free();
+
+    // Between 1 and 3; 1 lets the CPU run no further ahead than the frame it's drawing
+    unsigned max_frames = 2;
+    Stats stats;
+    // Whether latency comes from GPU timestamps rather than fence polling
+    bool timestamps = false;
+
+private:
+    struct Frame {
+        GLsync fence;
+        GLuint query;
+        bool input;
+        uint32_t timestamp;
+        // SDL milliseconds minus GL milliseconds as the frame ended
+        double clock_offset;
+    };
+
+    void retire(const Frame &frame);
+    void retire_finished();
+
+    std::deque<Frame> frames;
+    bool input_pending = false;
+    uint32_t input_timestamp = 0;
+    bool checked = false;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+
+FrameScheduler::FrameScheduler(const Window &window)
+{
+    const uint32_t flags = SDL_GetWindowFlags(window.window);
+    visible = !(flags & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN));
+    // A new window may get focus a little later; the event says so
+    focused = (flags & SDL_WINDOW_INPUT_FOCUS) != 0;
+}
+
+int FrameScheduler::idle_ms() const
+{
+    if (!visible || (!animating && !damaged)) {
+        return int(max_sleep_ms);
+    }
+    if (!focused && demo_unfocused_fps > 0) {
+        const std::chrono::duration<double> period(1 / demo_unfocused_fps);
+        const std::chrono::duration<double> left = last + period - clock::now();
+        if (left.count() > 0) {
+            // Rounded up, so the frame is due on waking
+            return std::min(int(max_sleep_ms), int(left.count() * 1000) + 1);
+        }
+    }
+    return -1;
+}
+
+bool FrameScheduler::poll(SDL_Event &ev)
+{
+    const int ms = waited? -1 : idle_ms();
+    waited = true;
+    const bool got = ms >= 0? SDL_WaitEventTimeout(&ev, ms) != 0 : SDL_PollEvent(&ev) != 0;
+    if (got) {
+        track(ev);
+    }
+    return got;
+}
+
+bool FrameScheduler::draw()
+{
+    waited = false;
+    if (!visible || !(animating || damaged) || idle_ms() >= 0) {
+        return false;
+    }
+    damaged = false;
+    last = clock::now();
+    return true;
+}
+
+void FrameScheduler::track(const SDL_Event &ev)
+{
+    if (ev.type != SDL_WINDOWEVENT) {
+        damaged = true;
+        return;
+    }
+    switch (ev.window.event) {
+    case SDL_WINDOWEVENT_MINIMIZED:
+    case SDL_WINDOWEVENT_HIDDEN:
+        visible = false;
+        break;
+    case SDL_WINDOWEVENT_FOCUS_GAINED:
+        focused = true;
+        break;
+    case SDL_WINDOWEVENT_FOCUS_LOST:
+        focused = false;
+        break;
+    case SDL_WINDOWEVENT_SHOWN:
+    case SDL_WINDOWEVENT_RESTORED:
+    case SDL_WINDOWEVENT_MAXIMIZED:
+        visible = true;
+        damaged = true;
+        break;
+    default:
+        // Exposed, resized, and the like need the contents drawn again
+        damaged = true;
+        break;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef DEMO_FRAMESCHEDULER_H
+#define DEMO_FRAMESCHEDULER_H
+
+#include <SDL.h>
+#include <chrono>
+
+#include "Demo.h"
+
+/* Decides when a demo's loop draws, so idle windows stop costing power and
+ * GPU time. A loop reads its events through poll() instead of SDL_PollEvent,
+ * then draws only if draw() says so:
+ *
+ *     while (frames.poll(ev)) { ... }
+ *     if (!frames.draw()) {
+ *         continue;
+ *     }
+ *
+ * Nothing is drawn while the window is minimised or hidden. While it is
+ * unfocused, frames are limited to demo_unfocused_fps. And a scene that isn't
+ * animating is only drawn again once something damaged it: any input or
+ * window event does, and so does the loop calling damage(). Until then the
+ * first poll() of an iteration sleeps in SDL_WaitEventTimeout, waking at
+ * least every max_sleep_ms so the loop can still do background work, such as
+ * reloading shaders, that may call damage(). */
+class FrameScheduler {
+public:
+    explicit FrameScheduler(const Window &window);
+
+    // Like SDL_PollEvent, but blocks on the first call while there's nothing to draw
+    bool poll(SDL_Event &ev);
+    // Whether to draw this iteration; true clears the damage
+    bool draw();
+    // Asks for another frame of a scene that isn't animating
+    void damage() {
+        damaged = true;
+    }
+
+    // The scene changes every frame by itself, so every frame is drawn
+    bool animating = true;
+    unsigned max_sleep_ms = 100;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    void track(const SDL_Event &ev);
+    // Milliseconds to sleep before anything can be drawn, or -1 for none
+    int idle_ms() const;
+
+    bool visible, focused, damaged = true, waited = false;
+    clock::time_point last;
+};
+
+#endif
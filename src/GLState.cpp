@@ -0,0 +1,202 @@
+#include "GLState.h"
+
+GLState demo_gl;
+
+void GLState::invalidate()
+{
+    program = vao = active = unknown;
+    for (auto &b : buffers) {
+        b = unknown;
+    }
+    for (auto &unit : textures) {
+        for (auto &t : unit) {
+            t = unknown;
+        }
+    }
+    for (auto &c : caps) {
+        c = unknown;
+    }
+    blend_src = blend_dst = depth = mask = cull = unknown;
+    valid = true;
+}
+
+bool GLState::update(GLuint &shadow, GLuint value)
+{
+    if (!valid) {
+        invalidate();
+    }
+    if (shadow == value) {
+        counters.elided++;
+        return false;
+    }
+    shadow = value;
+    counters.issued++;
+    return true;
+}
+
+int GLState::buffer_slot(GLenum target)
+{
+    switch (target) {
+    case GL_ARRAY_BUFFER:         return BUF_ARRAY;
+    case GL_COPY_READ_BUFFER:     return BUF_COPY_READ;
+    case GL_COPY_WRITE_BUFFER:    return BUF_COPY_WRITE;
+    case GL_DRAW_INDIRECT_BUFFER: return BUF_INDIRECT;
+    case GL_TEXTURE_BUFFER:       return BUF_TEXTURE;
+    case GL_UNIFORM_BUFFER:       return BUF_UNIFORM;
+    default:                      return -1;
+    }
+}
+
+int GLState::texture_slot(GLenum target)
+{
+    switch (target) {
+    case GL_TEXTURE_2D:             return TEX_2D;
+    case GL_TEXTURE_CUBE_MAP:       return TEX_CUBE;
+    case GL_TEXTURE_BUFFER:         return TEX_BUFFER;
+    case GL_TEXTURE_2D_ARRAY:       return TEX_2D_ARRAY;
+    case GL_TEXTURE_2D_MULTISAMPLE: return TEX_2D_MS;
+    case GL_TEXTURE_RECTANGLE:      return TEX_RECT;
+    case GL_TEXTURE_3D:             return TEX_3D;
+    default:                        return -1;
+    }
+}
+
+int GLState::cap_slot(GLenum cap)
+{
+    switch (cap) {
+    case GL_BLEND:        return CAP_BLEND;
+    case GL_DEPTH_TEST:   return CAP_DEPTH_TEST;
+    case GL_CULL_FACE:    return CAP_CULL_FACE;
+    case GL_STENCIL_TEST: return CAP_STENCIL_TEST;
+    case GL_SCISSOR_TEST: return CAP_SCISSOR_TEST;
+    default:              return -1;
+    }
+}
+
+void GLState::material(ilG_material *mat)
+{
+    if (update(program, mat->program)) {
+        ilG_material_bind(mat);
+    }
+}
+
+void GLState::use_program(GLuint program)
+{
+    if (update(this->program, program)) {
+        glUseProgram(program);
+    }
+}
+
+void GLState::bind_vao(GLuint vao)
+{
+    if (update(this->vao, vao)) {
+        glBindVertexArray(vao);
+    }
+}
+
+void GLState::bind_buffer(GLenum target, GLuint buffer)
+{
+    int slot = buffer_slot(target);
+    if (slot < 0) {
+        counters.issued++;
+        glBindBuffer(target, buffer);
+    } else if (update(buffers[slot], buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLState::forget_buffer(GLuint buffer)
+{
+    for (auto &b : buffers) {
+        if (b == buffer) {
+            b = unknown;
+        }
+    }
+}
+
+void GLState::active_texture(unsigned unit)
+{
+    if (update(active, unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+}
+
+void GLState::bind_texture(unsigned unit, GLenum target, GLuint texture)
+{
+    int slot = texture_slot(target);
+    if (slot < 0 || unit >= units) {
+        active_texture(unit);
+        counters.issued++;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (!valid) {
+        invalidate();
+    }
+    if (textures[unit][slot] == texture) {
+        counters.elided++;
+        return;
+    }
+    active_texture(unit);
+    update(textures[unit][slot], texture);
+    glBindTexture(target, texture);
+}
+
+void GLState::texture(unsigned unit, const ilG_tex *tex)
+{
+    bind_texture(unit, tex->target, tex->object);
+}
+
+void GLState::enable(GLenum cap, bool on)
+{
+    int slot = cap_slot(cap);
+    if (slot < 0) {
+        counters.issued++;
+        on? glEnable(cap) : glDisable(cap);
+    } else if (update(caps[slot], on)) {
+        on? glEnable(cap) : glDisable(cap);
+    }
+}
+
+void GLState::blend_func(GLenum src, GLenum dst)
+{
+    if (!valid) {
+        invalidate();
+    }
+    if (blend_src == src && blend_dst == dst) {
+        counters.elided++;
+        return;
+    }
+    blend_src = src;
+    blend_dst = dst;
+    counters.issued++;
+    glBlendFunc(src, dst);
+}
+
+void GLState::depth_func(GLenum func)
+{
+    if (update(depth, func)) {
+        glDepthFunc(func);
+    }
+}
+
+void GLState::depth_mask(bool on)
+{
+    if (update(mask, on)) {
+        glDepthMask(on? GL_TRUE : GL_FALSE);
+    }
+}
+
+void GLState::cull_face(GLenum mode)
+{
+    if (update(cull, mode)) {
+        glCullFace(mode);
+    }
+}
+
+GLState::Counters GLState::frame()
+{
+    Counters c = counters;
+    counters = Counters();
+    return c;
+}
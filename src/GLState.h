@@ -0,0 +1,73 @@
+#ifndef DEMO_GLSTATE_H
+#define DEMO_GLSTATE_H
+
+#include <stdint.h>
+
+#include "tgl/tgl.h"
+
+extern "C" {
+#include "graphics/material.h"
+#include "graphics/tex.h"
+}
+
+/* Shadow copy of the GL state the demos touch, so redundant binds and
+ * enables never reach the driver. Only calls made through this object are
+ * tracked: after anything else (IntenseLogic's renderers, raw GL) changes
+ * state, call invalidate() and the next call of each kind is issued
+ * unconditionally.
+ *
+ * Element array bindings belong to the VAO and are not shadowed. */
+class GLState {
+public:
+    struct Counters {
+        unsigned issued = 0, elided = 0;
+    };
+
+    void invalidate();
+
+    // Calls ilG_material_bind only if a different program is current
+    void material(ilG_material *mat);
+    void use_program(GLuint program);
+    void bind_vao(GLuint vao);
+    void bind_buffer(GLenum target, GLuint buffer);
+    // Call before glDeleteBuffers so a recycled name isn't mistaken as bound
+    void forget_buffer(GLuint buffer);
+    void active_texture(unsigned unit);
+    void bind_texture(unsigned unit, GLenum target, GLuint texture);
+    void texture(unsigned unit, const ilG_tex *tex);
+    void enable(GLenum cap, bool on);
+    void blend_func(GLenum src, GLenum dst);
+    void depth_func(GLenum func);
+    void depth_mask(bool on);
+    void cull_face(GLenum mode);
+
+    // Returns the counters since the last call and resets them
+    Counters frame();
+
+private:
+    static const GLuint unknown = ~GLuint(0);
+    static const unsigned units = 16;
+    enum { BUF_ARRAY, BUF_COPY_READ, BUF_COPY_WRITE, BUF_INDIRECT, BUF_TEXTURE, BUF_UNIFORM,
+           BUF_COUNT };
+    enum { TEX_2D, TEX_CUBE, TEX_BUFFER, TEX_2D_ARRAY, TEX_2D_MS, TEX_RECT, TEX_3D, TEX_COUNT };
+    enum { CAP_BLEND, CAP_DEPTH_TEST, CAP_CULL_FACE, CAP_STENCIL_TEST, CAP_SCISSOR_TEST,
+           CAP_COUNT };
+
+    static int buffer_slot(GLenum target);
+    static int texture_slot(GLenum target);
+    static int cap_slot(GLenum cap);
+    bool update(GLuint &shadow, GLuint value);
+
+    GLuint program = unknown, vao = unknown, active = unknown;
+    GLuint buffers[BUF_COUNT];
+    GLuint textures[units][TEX_COUNT];
+    GLuint caps[CAP_COUNT];
+    GLuint blend_src = unknown, blend_dst = unknown, depth = unknown, mask = unknown,
+        cull = unknown;
+    Counters counters;
+    bool valid = false;
+};
+
+extern GLState demo_gl;
+
+#endif
@@ -0,0 +1,244 @@
+#include "Geometry.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "GLState.h"
+
+extern "C" {
+#include "graphics/mesh.h"
+}
+
+using namespace std;
+
+GeometryArena demo_geometry;
+
+void RangeAllocator::reset(size_t capacity)
+{
+    spans.clear();
+    cap = capacity;
+    if (capacity) {
+        spans.push_back(Span{0, capacity});
+    }
+}
+
+size_t RangeAllocator::alloc(size_t count)
+{
+    for (size_t i = 0; i < spans.size(); i++) {
+        Span &s = spans[i];
+        if (s.count < count) {
+            continue;
+        }
+        size_t offset = s.offset;
+        s.offset += count;
+        s.count -= count;
+        if (s.count == 0) {
+            spans.erase(spans.begin() + i);
+        }
+        return offset;
+    }
+    return none;
+}
+
+void RangeAllocator::release(size_t offset, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    auto it = lower_bound(spans.begin(), spans.end(), offset, [](const Span &s, size_t o) {
+        return s.offset < o;
+    });
+    it = spans.insert(it, Span{offset, count});
+    // Merge with the following span, then the preceding one
+    auto next = it + 1;
+    if (next != spans.end() && it->offset + it->count == next->offset) {
+        it->count += next->count;
+        spans.erase(next);
+    }
+    if (it != spans.begin()) {
+        auto prev = it - 1;
+        if (prev->offset + prev->count == it->offset) {
+            prev->count += it->count;
+            spans.erase(it);
+        }
+    }
+}
+
+void RangeAllocator::grow(size_t capacity)
+{
+    if (capacity > cap) {
+        size_t old = cap;
+        cap = capacity;
+        release(old, capacity - old);
+    }
+}
+
+GLuint GeometryArena::resize(GLuint old, size_t old_size, size_t new_size)
+{
+    // The copy targets leave the VAO's element array binding alone
+    GLuint buf;
+    glGenBuffers(1, &buf);
+    demo_gl.bind_buffer(GL_COPY_WRITE_BUFFER, buf);
+    glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(new_size), NULL, GL_STATIC_DRAW);
+    if (old) {
+        demo_gl.bind_buffer(GL_COPY_READ_BUFFER, old);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, GLsizeiptr(old_size));
+        demo_gl.forget_buffer(old);
+        glDeleteBuffers(1, &old);
+    }
+    return buf;
+}
+
+void GeometryArena::init()
+{
+    tgl_vao_init(&vao);
+    tgl_vao_init(&pos_vao);
+    vertex_space.reset(0);
+    index_space.reset(0);
+}
+
+void GeometryArena::reserve(size_t vertices, size_t indices)
+{
+    if (!vbo) {
+        init();
+    }
+    const size_t vcap = vertex_space.capacity(), icap = index_space.capacity();
+    size_t new_vcap = max<size_t>(vcap, 1 << 16), new_icap = max<size_t>(icap, 1 << 18);
+    // Only free space at the end is guaranteed to be contiguous with growth,
+    // so size for the worst case of appending the whole mesh
+    while (new_vcap < vcap + vertices) {
+        new_vcap *= 2;
+    }
+    while (new_icap < icap + indices) {
+        new_icap *= 2;
+    }
+    bool changed = false;
+    if (new_vcap != vcap || !vbo) {
+        vbo = resize(vbo, vcap * sizeof(MeshVertex), new_vcap * sizeof(MeshVertex));
+        pos_vbo = resize(pos_vbo, vcap * sizeof(MeshVertex::pos),
+                         new_vcap * sizeof(MeshVertex::pos));
+        vertex_space.grow(new_vcap);
+        changed = true;
+    }
+    if (new_icap != icap || !ibo) {
+        ibo = resize(ibo, icap * sizeof(uint32_t), new_icap * sizeof(uint32_t));
+        index_space.grow(new_icap);
+        changed = true;
+    }
+    if (!changed) {
+        return;
+    }
+
+    demo_gl.bind_vao(vao.object);
+    demo_gl.bind_buffer(GL_ARRAY_BUFFER, vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    const GLsizei stride = sizeof(MeshVertex);
+    glVertexAttribPointer(ILG_MESH_POS, 3, GL_FLOAT, GL_FALSE, stride,
+                          (GLvoid*)offsetof(MeshVertex, pos));
+    glVertexAttribPointer(ILG_MESH_TEX, 2, GL_FLOAT, GL_FALSE, stride,
+                          (GLvoid*)offsetof(MeshVertex, tex));
+    glVertexAttribPointer(ILG_MESH_NORM, 3, GL_FLOAT, GL_FALSE, stride,
+                          (GLvoid*)offsetof(MeshVertex, norm));
+    glEnableVertexAttribArray(ILG_MESH_POS);
+    glEnableVertexAttribArray(ILG_MESH_TEX);
+    glEnableVertexAttribArray(ILG_MESH_NORM);
+
+    demo_gl.bind_vao(pos_vao.object);
+    demo_gl.bind_buffer(GL_ARRAY_BUFFER, pos_vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glVertexAttribPointer(ILG_MESH_POS, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(ILG_MESH_POS);
+}
+
+GeometryArena::Range GeometryArena::add(const MeshVertex *vertices, size_t vertex_count,
+                                        const void *indices, size_t index_count,
+                                        unsigned index_size)
+{
+    if (!vbo) {
+        reserve(vertex_count, index_count);
+    }
+    size_t voff = vertex_space.alloc(vertex_count);
+    size_t ioff = index_space.alloc(index_count);
+    if (voff == RangeAllocator::none || ioff == RangeAllocator::none) {
+        reserve(voff == RangeAllocator::none? vertex_count : 0,
+                ioff == RangeAllocator::none? index_count : 0);
+        if (voff == RangeAllocator::none) {
+            voff = vertex_space.alloc(vertex_count);
+        }
+        if (ioff == RangeAllocator::none) {
+            ioff = index_space.alloc(index_count);
+        }
+    }
+
+    demo_gl.bind_buffer(GL_COPY_WRITE_BUFFER, vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(voff * sizeof(MeshVertex)),
+                    GLsizeiptr(vertex_count * sizeof(MeshVertex)), vertices);
+    vector<float> positions(vertex_count * 3);
+    for (size_t i = 0; i < vertex_count; i++) {
+        memcpy(&positions[i * 3], vertices[i].pos, sizeof(vertices[i].pos));
+    }
+    demo_gl.bind_buffer(GL_COPY_WRITE_BUFFER, pos_vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(voff * sizeof(MeshVertex::pos)),
+                    GLsizeiptr(positions.size() * sizeof(float)), positions.data());
+    demo_gl.bind_buffer(GL_COPY_WRITE_BUFFER, ibo);
+    if (index_size == 4) {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(ioff * sizeof(uint32_t)),
+                        GLsizeiptr(index_count * sizeof(uint32_t)), indices);
+    } else {
+        // One index type for the whole buffer keeps every draw batchable
+        const uint16_t *src = static_cast<const uint16_t*>(indices);
+        vector<uint32_t> wide(src, src + index_count);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(ioff * sizeof(uint32_t)),
+                        GLsizeiptr(index_count * sizeof(uint32_t)), wide.data());
+    }
+
+    Range range;
+    range.base_vertex = GLint(voff);
+    range.first_index = GLuint(ioff);
+    range.count = GLsizei(index_count);
+    range.vertex_count = GLsizei(vertex_count);
+    return range;
+}
+
+void GeometryArena::remove(Range &range)
+{
+    if (range.count == 0 && range.vertex_count == 0) {
+        return;
+    }
+    vertex_space.release(size_t(range.base_vertex), size_t(range.vertex_count));
+    index_space.release(range.first_index, size_t(range.count));
+    range = Range();
+}
+
+void GeometryArena::bind()
+{
+    demo_gl.bind_vao(vao.object);
+}
+
+void GeometryArena::bind_positions()
+{
+    demo_gl.bind_vao(pos_vao.object);
+}
+
+void GeometryArena::draw(const Range &range)
+{
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.count, GL_UNSIGNED_INT,
+                             (GLvoid*)(sizeof(uint32_t) * range.first_index),
+                             range.base_vertex);
+}
+
+void GeometryArena::free()
+{
+    if (!vbo) {
+        return;
+    }
+    tgl_vao_free(&vao);
+    tgl_vao_free(&pos_vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &pos_vbo);
+    glDeleteBuffers(1, &ibo);
+    vbo = pos_vbo = ibo = 0;
+    demo_gl.invalidate();
+    vertex_space.reset(0);
+    index_space.reset(0);
+}
@@ -0,0 +1,84 @@
+#ifndef DEMO_GEOMETRY_H
+#define DEMO_GEOMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "ObjLoader.h"
+#include "tgl/tgl.h"
+
+// First-fit allocator over [0, capacity) with coalescing frees
+class RangeAllocator {
+public:
+    static const size_t none = ~size_t(0);
+
+    void reset(size_t capacity);
+    size_t alloc(size_t count);
+    void release(size_t offset, size_t count);
+    // Extends the capacity; new space is appended to the free list
+    void grow(size_t capacity);
+    size_t capacity() const {
+        return cap;
+    }
+
+private:
+    struct Span {
+        size_t offset, count;
+    };
+    std::vector<Span> spans; // sorted by offset
+    size_t cap = 0;
+};
+
+/* Static geometry shared by every mesh with the same vertex format: one
+ * vertex buffer, one 32-bit index buffer and one VAO. Meshes are ranges of
+ * those buffers and are drawn with glDrawElementsBaseVertex, so switching
+ * between them doesn't touch any buffer bindings, and a whole batch can be
+ * issued as a single multi-draw.
+ *
+ * Positions are also kept in a tightly packed stream of their own with a
+ * second VAO over it and the same index buffer, for depth-only passes which
+ * would otherwise fetch whole vertices to use 12 bytes of them.
+ *
+ * Buffers grow by doubling (copied on the GPU) when a mesh doesn't fit. All
+ * calls must happen on the GL thread. */
+class GeometryArena {
+public:
+    struct Range {
+        GLint base_vertex = 0;
+        GLuint first_index = 0;
+        GLsizei count = 0;
+        GLsizei vertex_count = 0;
+    };
+
+    // indices are 2 or 4 bytes wide (index_size), relative to the mesh
+    Range add(const MeshVertex *vertices, size_t vertex_count,
+              const void *indices, size_t index_count, unsigned index_size);
+    void remove(Range &range);
+    void bind();
+    // Binds the position-only VAO; ranges draw the same from either
+    void bind_positions();
+    void draw(const Range &range);
+    void free();
+
+    GLuint vertex_buffer() const {
+        return vbo;
+    }
+    GLuint index_buffer() const {
+        return ibo;
+    }
+
+private:
+    void init();
+    void reserve(size_t vertices, size_t indices);
+    static GLuint resize(GLuint old, size_t old_size, size_t new_size);
+
+    tgl_vao vao, pos_vao;
+    GLuint vbo = 0, pos_vbo = 0, ibo = 0;
+    RangeAllocator vertex_space, index_space;
+};
+
+// The arena for MeshVertex, which is currently the only vertex format
+extern GeometryArena demo_geometry;
+
+#endif
@@ -1,5 +1,12 @@
 #include "Graphics.h"
 
+#include <algorithm>
+#include <math.h>
+
+#include "GLState.h"
+#include "Geometry.h"
+#include "UniformRing.h"
+
 extern "C" {
 #include "graphics/transform.h"
 #include "util/logger.h"
@@ -17,6 +24,22 @@ void Graphics::free()
     ilG_lighting_free(&sun);
     ilG_lighting_free(&point);
     ilG_tonemapper_free(&tonemapper);
+    batch.free();
+    camera.free();
+    deferred.free();
+    demo_uniforms.free();
+    limiter.free();
+    if (depth_prepass) {
+        ilG_renderman_delMaterial(rm, depth_mat);
+        if (multidraw) {
+            ilG_renderman_delMaterial(rm, depth_batch_mat);
+        }
+    }
+    depth_prepass = false;
+    gbuffer_samples.free();
+    prepass_samples.free();
+    hiz.free();
+    occlusion = false;
 
     initialized = false;
 }
@@ -34,41 +57,30 @@ bool Graphics::init(const Flags &flags)
     ilG_renderman_setup(rm, flags.msaa != 0, flags.hdr);
     ilG_renderman_resize(rm, 800, 600);
     glClampColor(GL_CLAMP_READ_COLOR, GL_FALSE);
+    multidraw = flags.multidraw && DrawBatch::supported();
+    limiter.max_frames = std::max(1u, std::min(3u, flags.frames_in_flight));
+    il_log("Multi-draw-indirect %s", multidraw? "enabled" : "disabled");
+    gbuffer = flags.gbuffer;
 
     ilG_box(&box);
     ilG_icosahedron(&ico);
 
-    {
-        ilG_tex skytex;
-        ilA_img skyfaces[6];
-        static const char *const files[6] = {
-            "north.png",
-            "south.png",
-            "up.png",
-            "down.png",
-            "west.png",
-            "east.png"
-        };
-        bool cont = true;
-        for (unsigned i = 0; i < 6; i++) {
-            ilA_imgerr res = ilA_img_loadfile(skyfaces + i, &demo_fs, files[i]);
-            if (res) {
-                il_log("%s: %s", files[i], ilA_img_strerror(res));
-                cont = false;
-                break;
-            }
-        }
-        if (!cont) {
-            return false;
-        }
-        ilG_tex_loadcube(&skytex, skyfaces);
+    loader.textures({
+        "north.png",
+        "south.png",
+        "up.png",
+        "down.png",
+        "west.png",
+        "east.png"
+    }, [=](ilG_tex &skytex) {
         char *error;
         if (!ilG_skybox_build(&skybox, rm, skytex, &box, &error)) {
             il_error("skybox: %s", error);
             ::free(error);
             return false;
         }
-    }
+        return true;
+    });
 
     char *error;
     if (!ilG_ambient_build(&ambient, rm, &error)) {
@@ -91,26 +103,113 @@ bool Graphics::init(const Flags &flags)
         ::free(error);
         return false;
     }
+    if (gbuffer == GBUFFER_COMPACT
+        && !deferred.build(rm, flags.hdr, flags.msaa, flags.light_volumes, &error)) {
+        il_error("deferred: %s", error);
+        ::free(error);
+        return false;
+    }
+    if (flags.depth_prepass) {
+        if (!build_prepass(&error)) {
+            il_error("depth pre-pass: %s", error);
+            ::free(error);
+            return false;
+        }
+        depth_prepass = true;
+    }
+    if (flags.occlusion_culling) {
+        if (!hiz.build(rm, &error)) {
+            il_error("occlusion culling: %s", error);
+            ::free(error);
+            return false;
+        }
+        occlusion = true;
+    }
+    return true;
+}
+
+bool Graphics::build_prepass(char **error)
+{
+    ilG_material m;
+    ilG_material_init(&m);
+    ilG_material_name(&m, "Depth Pre-pass");
+    ilG_material_arrayAttrib(&m, ILG_MESH_POS, "in_Position");
+    if (!ilG_renderman_addMaterialFromFile(rm, m, "depth.vert", "depth.frag", &depth_mat, error)) {
+        return false;
+    }
+    ilG_material *mat = ilG_renderman_findMaterial(rm, depth_mat);
+    CameraBuffer::attach(mat);
+    UniformRing::attach(mat);
+    if (!multidraw) {
+        return true;
+    }
+    ilG_material_init(&m);
+    ilG_material_name(&m, "Depth Pre-pass (batched)");
+    ilG_material_arrayAttrib(&m, ILG_MESH_POS, "in_Position");
+    ilG_material_arrayAttrib(&m, DEMO_DRAW_ID_ATTRIB, "in_DrawID");
+    ilG_material_textureUnit(&m, DEMO_DRAW_DATA_UNIT, "draws");
+    if (!ilG_renderman_addMaterialFromFile(rm, m, "depth_batch.vert", "depth.frag",
+                                           &depth_batch_mat, error)) {
+        ilG_renderman_delMaterial(rm, depth_mat);
+        return false;
+    }
+    CameraBuffer::attach(ilG_renderman_findMaterial(rm, depth_batch_mat));
     return true;
 }
 
+void Graphics::prepass()
+{
+    demo_gl.enable(GL_DEPTH_TEST, true);
+    demo_gl.depth_func(GL_LESS);
+    demo_gl.depth_mask(true);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    demo_gl.material(ilG_renderman_findMaterial(rm, depth_mat));
+    demo_geometry.bind_positions();
+    queue.prepass();
+    if (multidraw) {
+        batch.prepass([this]() {
+            demo_gl.material(ilG_renderman_findMaterial(rm, depth_batch_mat));
+        });
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
 void Graphics::draw(State &state)
 {
     SDL_SetWindowGrab(window.window, SDL_bool(state.mouse_grab));
     SDL_SetRelativeMouseMode(SDL_bool(state.mouse_grab));
     SDL_GL_SetSwapInterval(state.vsync);
+    limiter.begin_frame();
 
     auto s = window.resize();
     unsigned width = s.first, height = s.second;
     if (unsigned(width) != rm->width || unsigned(height) != rm->height) {
         ilG_renderman_resize(rm, width, height);
         ilG_tonemapper_resize(&tonemapper, width, height);
+        if (gbuffer == GBUFFER_COMPACT) {
+            deferred.resize(width, height);
+        }
     }
     space.projection = il_mat_perspective(state.fov, width / float(height), state.zmin, state.zfar);
+    zfar = state.zfar;
+
+    il_mat view;
+    il_vec3 eye;
+    if (camera_source) {
+        camera_source(view, eye);
+    } else {
+        view = viewmat(ILG_VIEW);
+        eye = il_pos_getPosition(&space.camera);
+    }
+    camera.update(view, space.projection, eye);
+    if (occlusion) {
+        hiz.update(camera.block());
+    }
 
     il_mat skybox_vp = viewmat(ILG_VIEW_R | ILG_PROJECTION);
     auto slocs = state.sunlight_locs;
     auto plocs = state.point_locs;
+    const unsigned plocs_count = plocs? unsigned(state.point_count) : 0;
     std::vector<il_mat>
         /* ILG_INVERSE | ILG_VIEW_R | ILG_PROJECTION
            ILG_MODEL_T | ILG_VIEW_T
@@ -118,9 +217,9 @@ void Graphics::draw(State &state)
         sun_ivp = objmats(slocs, ILG_INVERSE | ILG_VIEW_R | ILG_PROJECTION, state.sunlight_count),
         sun_mv  = objmats(slocs, ILG_MODEL_T | ILG_VIEW_T,                  state.sunlight_count),
         sun_vp  = objmats(slocs, ILG_MODEL_T | ILG_VP,                      state.sunlight_count),
-        pnt_ivp = objmats(plocs, ILG_INVERSE | ILG_VIEW_R | ILG_PROJECTION, state.point_count),
-        pnt_mv  = objmats(plocs, ILG_MODEL_T | ILG_VIEW_T,                  state.point_count),
-        pnt_vp  = objmats(plocs, ILG_MODEL_T | ILG_VP,                      state.point_count);
+        pnt_ivp = objmats(plocs, ILG_INVERSE | ILG_VIEW_R | ILG_PROJECTION, plocs_count),
+        pnt_mv  = objmats(plocs, ILG_MODEL_T | ILG_VIEW_T,                  plocs_count),
+        pnt_vp  = objmats(plocs, ILG_MODEL_T | ILG_VP,                      plocs_count);
 
     const float fovsquared = state.fov * state.fov;
     ambient.color = state.ambient_col;
@@ -149,47 +248,210 @@ void Graphics::draw(State &state)
 #define with(n) 
 #endif
 
+    const bool compact = gbuffer == GBUFFER_COMPACT;
     with("Geometry") {
-        ilG_geometry_bind(&rm->gbuffer);
-    }
-    with("Skybox") {
-        ilG_skybox_draw(&skybox, skybox_vp);
+        if (compact) {
+            deferred.bind_geometry();
+        } else {
+            ilG_geometry_bind(&rm->gbuffer);
+        }
     }
+    // IL's renderers don't go through the state cache
+    demo_gl.invalidate();
+    demo_uniforms.begin_frame();
     for (auto &d : drawables) {
-        with(d->name()) {
-            d->draw(*this);
+        if (multidraw && d->record(*this, batch)) {
+            continue;
         }
+        d->enqueue(*this, queue);
     }
-    with("Ambient Lighting") {
-        ilG_ambient_draw(&ambient);
+    queue.sort();
+    if (depth_prepass) {
+        with("Depth Pre-pass") {
+            prepass_samples.begin();
+            prepass();
+            prepass_samples.end();
+        }
+    }
+    gbuffer_samples.begin();
+    queue.execute(*this);
+    if (multidraw) {
+        with("Batched Draws") {
+            if (depth_prepass) {
+                demo_gl.depth_func(GL_EQUAL);
+                demo_gl.depth_mask(false);
+            }
+            batch.submit();
+            demo_gl.depth_func(GL_LESS);
+            demo_gl.depth_mask(true);
+        }
     }
-    with("Sunlights") {
-        ilG_lighting_draw(&sun, sun_ivp.data(), sun_mv.data(), sun_vp.data(),
-                          state.sunlight_lights, state.sunlight_count);
+    gbuffer_samples.end();
+    if (occlusion) {
+        with("Hi-Z") {
+            hiz.capture(camera.block(), width, height);
+        }
     }
-    with("Point Lights") {
-        ilG_lighting_draw(&point, pnt_ivp.data(), pnt_mv.data(), pnt_vp.data(),
-                          state.point_lights, state.point_count);
+    with("Skybox") {
+        // At the far plane behind the opaque geometry, so only uncovered
+        // pixels are shaded
+        demo_gl.enable(GL_DEPTH_TEST, true);
+        demo_gl.depth_func(GL_LEQUAL);
+        demo_gl.depth_mask(false);
+        glDepthRange(1.0, 1.0);
+        ilG_skybox_draw(&skybox, skybox_vp);
+        glDepthRange(0.0, 1.0);
+        demo_gl.depth_func(GL_LESS);
+        demo_gl.depth_mask(true);
     }
-    with("Tone Mapping") {
-        ilG_tonemapper_draw(&tonemapper);
+    demo_gl.invalidate();
+    // Light positions are the translation column of their model matrices
+    auto positions = [this](unsigned *locs, size_t count) {
+        std::vector<il_vec3> out(count);
+        std::vector<il_mat> model = objmats(locs, ILG_MODEL_T, unsigned(count));
+        for (size_t i = 0; i < count; i++) {
+            out[i] = il_vec3_new(model[i].data[3], model[i].data[7], model[i].data[11]);
+        }
+        return out;
+    };
+    std::vector<il_vec3> pnt_pos = state.point_positions
+        ? std::vector<il_vec3>(state.point_positions, state.point_positions + state.point_count)
+        : positions(plocs, plocs_count);
+    std::vector<ilG_light> pnt_lights(state.point_lights, state.point_lights + pnt_pos.size());
+    if (occlusion) {
+        // A light whose whole sphere is hidden can't reach a visible surface
+        size_t kept = 0;
+        for (size_t i = 0; i < pnt_pos.size(); i++) {
+            if (!hiz.visible(pnt_pos[i], pnt_lights[i].radius)) {
+                continue;
+            }
+            pnt_pos[kept] = pnt_pos[i];
+            pnt_lights[kept] = pnt_lights[i];
+            if (i < pnt_ivp.size()) {
+                pnt_ivp[kept] = pnt_ivp[i];
+                pnt_mv[kept] = pnt_mv[i];
+                pnt_vp[kept] = pnt_vp[i];
+            }
+            kept++;
+        }
+        pnt_pos.resize(kept);
+        pnt_lights.resize(kept);
+        pnt_ivp.resize(std::min(kept, pnt_ivp.size()));
+        pnt_mv.resize(pnt_ivp.size());
+        pnt_vp.resize(pnt_ivp.size());
     }
+    if (compact) {
+        std::vector<il_vec3> sun_pos = positions(slocs, state.sunlight_count);
+        with("Ambient Lighting") {
+            deferred.ambient(state.ambient_col);
+        }
+        with("Sunlights") {
+            deferred.suns(sun_pos.data(), state.sunlight_lights, state.sunlight_count);
+        }
+        with("Point Lights") {
+            deferred.points(pnt_pos.data(), pnt_lights.data(), pnt_lights.size(),
+                            camera.block());
+        }
+        with("Tone Mapping") {
+            deferred.tonemap(state.exposure, state.gamma);
+        }
+    } else {
+        with("Ambient Lighting") {
+            ilG_ambient_draw(&ambient);
+        }
+        with("Sunlights") {
+            ilG_lighting_draw(&sun, sun_ivp.data(), sun_mv.data(), sun_vp.data(),
+                              state.sunlight_lights, state.sunlight_count);
+        }
+        with("Point Lights") {
+            ilG_lighting_draw(&point, pnt_ivp.data(), pnt_mv.data(), pnt_vp.data(),
+                              pnt_lights.data(), pnt_ivp.size());
+        }
+        with("Tone Mapping") {
+            ilG_tonemapper_draw(&tonemapper);
+        }
+    }
+    demo_uniforms.end_frame();
     window.swap();
+    limiter.end_frame();
+
+    GLuint samples;
+    gbuffer_samples.poll(samples);
+    prepass_samples.poll(samples);
+    GLState::Counters calls = demo_gl.frame();
+    gl_issued += calls.issued;
+    gl_elided += calls.elided;
+    if (++gl_frames == 600) {
+        il_log("GL state per frame: %.1f calls issued, %.1f elided; "
+               "%lu frames waited on the uniform ring",
+               gl_issued / double(gl_frames), gl_elided / double(gl_frames), demo_uniforms.waits);
+        demo_uniforms.waits = 0;
+        if (deferred.complex_pixels >= 0) {
+            il_log("MSAA: %.1f%% of pixels shaded per sample", deferred.complex_pixels * 100);
+        }
+        log_overdraw();
+        if (hiz.tested) {
+            il_log("Occlusion culling: %.1f of %.1f spheres per frame culled",
+                   hiz.culled / double(gl_frames), hiz.tested / double(gl_frames));
+            hiz.tested = hiz.culled = 0;
+        }
+        const FrameLimiter::Stats &frames = limiter.stats;
+        il_log("Frame limiter: %u in flight, waited %.2f ms per frame (%lu frames); "
+               "input to present %s%.1f ms on average, %.1f ms worst",
+               limiter.max_frames, frames.wait_ms / double(frames.frames), frames.waits,
+               limiter.timestamps? "" : "at most ",
+               frames.inputs? frames.latency_ms / double(frames.inputs) : 0.0, frames.worst_ms);
+        limiter.stats = FrameLimiter::Stats();
+        gl_issued = gl_elided = gl_frames = 0;
+    }
 
 #undef push
 #undef pop
 #undef with
 }
 
+void Graphics::log_overdraw()
+{
+    if (gbuffer_samples.results == 0) {
+        return;
+    }
+    const double written = gbuffer_samples.total / gbuffer_samples.results;
+    if (depth_prepass && prepass_samples.results != 0) {
+        /* The pre-pass passes what a plain geometry pass would have shaded
+         * for its occluders; items it skipped add to the writes, so the
+         * difference only undercounts what was saved. */
+        const double passed = prepass_samples.total / prepass_samples.results;
+        const double saved = passed > written? passed - written : 0;
+        il_log("G-buffer: %.0f samples shaded per frame, depth pre-pass saved at least %.0f "
+               "(%.1f%%)", written, saved, passed > 0? saved / passed * 100 : 0.0);
+    } else {
+        il_log("G-buffer: %.0f samples shaded per frame", written);
+    }
+    gbuffer_samples.total = prepass_samples.total = 0;
+    gbuffer_samples.results = prepass_samples.results = 0;
+}
+
 il_mat Graphics::viewmat(int type)
 {
     return ilG_floatspace_viewmat(&space, type);
 }
 
+bool Graphics::visible(il_vec3 center, float radius)
+{
+    return !occlusion || hiz.visible(center, radius);
+}
+
+uint32_t Graphics::depth(const il_mat &model) const
+{
+    // Distance from the eye to the object's origin (il_mat is row-major)
+    const float *eye = camera.block().position;
+    float dx = model.data[3] - eye[0], dy = model.data[7] - eye[1], dz = model.data[11] - eye[2];
+    return RenderQueue::depth(sqrtf(dx * dx + dy * dy + dz * dz), zfar);
+}
+
 std::vector<il_mat> Graphics::objmats(unsigned *objects, int type, unsigned count)
 {
-    std::vector<il_mat> mats;
-    mats.reserve(count);
+    std::vector<il_mat> mats(count);
     ilG_floatspace_objmats(&space, mats.data(), objects, type, count);
     return mats;
 }
@@ -2,10 +2,19 @@
 #define DEMO_GRAPHICS_H
 
 #include <SDL.h>
+#include <functional>
 #include <vector>
 #include <string>
 
 #include "Demo.h"
+#include "AssetLoader.h"
+#include "Camera.h"
+#include "Deferred.h"
+#include "DrawBatch.h"
+#include "FrameLimiter.h"
+#include "HiZ.h"
+#include "RenderQueue.h"
+#include "SampleCounter.h"
 
 extern "C" {
 #include "graphics/renderer.h"
@@ -25,6 +34,8 @@ struct State {
     ilG_light *sunlight_lights = nullptr;
     size_t sunlight_count = 0;
     unsigned *point_locs = nullptr;
+    // Compact layout only: world positions instead of point_locs
+    il_vec3 *point_positions = nullptr;
     ilG_light *point_lights = nullptr;
     size_t point_count = 0;
 };
@@ -34,6 +45,40 @@ class Graphics;
 class Drawable {
 public:
     virtual void draw(Graphics &graphics) = 0;
+    /* Adds this frame's items to the render queue. The default submits one
+     * item of unknown state which calls draw(). */
+    virtual void enqueue(Graphics &graphics, RenderQueue &queue) {
+        (void)graphics;
+        queue.push(RenderQueue::key(RenderQueue::PASS_LEGACY, 0, 0, 0, 0), this);
+    }
+    /* Draws one queued item. changed has a RenderQueue::Changed bit for each
+     * piece of state that differs from the previous item's, the rest is still
+     * bound. */
+    virtual void execute(Graphics &graphics, const RenderQueue::Item &item, unsigned changed) {
+        (void)item;
+        (void)changed;
+        draw(graphics);
+    }
+    /* Multi-draw path: add this frame's draws to batch instead of issuing
+     * them. Draws that can't be batched go on graphics.queue as enqueue()
+     * would push them, never straight to the GL. Returning false falls back
+     * to draw(). */
+    virtual bool record(Graphics &graphics, DrawBatch &batch) {
+        (void)graphics;
+        (void)batch;
+        return false;
+    }
+    /* Depth pre-pass: sets the mesh and model matrix the item's execute()
+     * will draw, so its depth can be laid down first. execute() then runs
+     * under GL_EQUAL, so its vertex shader must compute an invariant
+     * gl_Position as vp * model * in_Position from exactly these. Items that
+     * return false are drawn with the usual depth test. */
+    virtual bool occluder(const RenderQueue::Item &item, const Mesh *&mesh, il_mat &model) {
+        (void)item;
+        (void)mesh;
+        (void)model;
+        return false;
+    }
     virtual const char *name() {
         return "Untitled";
     }
@@ -46,27 +91,74 @@ public:
         bool srgb = false;
         bool hdr = true;
         unsigned msaa = 0;
+        // Only used with GL 4.3
+        bool multidraw = demo_multidraw;
+        // hdr picks R11G11B10F accumulation for the compact layout
+        GBufferLayout gbuffer = demo_compact_gbuffer? GBUFFER_COMPACT : GBUFFER_IL;
+        // Stencil-tested point light volumes, compact layout only
+        bool light_volumes = demo_light_volumes;
+        // Depth-only pass over occluders before the G-buffer is shaded
+        bool depth_prepass = demo_depth_prepass;
+        // Cull point lights and drawables asking visible() by earlier depth
+        bool occlusion_culling = demo_occlusion_culling;
+        // Frames the GPU may lag behind before draw() waits after the swap
+        unsigned frames_in_flight = demo_frames_in_flight;
     };
 
     Graphics(Window &window)
         : window(window) {}
 
     void free();
+    /* Queues the skybox faces on the asset loader; call loader.wait() once
+     * the demo's own assets are queued as well. */
     bool init(const Flags &flags);
     void draw(State &state);
     il_mat viewmat(int type);
     std::vector<il_mat> objmats(unsigned *objects, int type, unsigned count);
+    // Render queue depth of an object from its model matrix
+    uint32_t depth(const il_mat &model) const;
+    // False if a world space sphere is certainly hidden, see HiZ
+    bool visible(il_vec3 center, float radius);
 
     Window &window;
+    AssetLoader loader;
     ilG_renderman rm[1];
     ilG_floatspace space;
     ilG_shape box, ico;
     ilG_skybox skybox;
     std::vector<Drawable*> drawables;
+    DrawBatch batch;
+    CameraBuffer camera;
+    /* Supplies the view matrix and eye position for the Camera block; by
+     * default they come from space's camera. It runs just before the
+     * G-buffer is drawn, so it can late-latch input read since the frame
+     * began. */
+    std::function<void(il_mat &view, il_vec3 &position)> camera_source;
+    RenderQueue queue;
+    bool multidraw = false;
+    // Layout in use, which materials have to be built for
+    GBufferLayout gbuffer = GBUFFER_IL;
+    Deferred deferred;
+    bool depth_prepass = false;
+    // G-buffer samples written, and those let through by the depth pre-pass
+    SampleCounter gbuffer_samples, prepass_samples;
+    bool occlusion = false;
+    HiZ hiz;
+    FrameLimiter limiter;
+    float zfar = 1024.f;
+    // State cache counters, logged every 600 frames
+    unsigned long gl_issued = 0, gl_elided = 0, gl_frames = 0;
     ilG_ambient ambient;
     ilG_lighting sun, point;
     ilG_tonemapper tonemapper;
     bool initialized = false;
+
+private:
+    bool build_prepass(char **error);
+    void prepass();
+    void log_overdraw();
+
+    ilG_matid depth_mat, depth_batch_mat;
 };
 
 #endif
@@ -0,0 +1,333 @@
+#include "HiZ.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include "GLState.h"
+
+extern "C" {
+#include "util/log.h"
+}
+
+using namespace std;
+
+enum {
+    TEX_SOURCE = 0,
+};
+
+// Window space depth of a view space z (the camera looks down -z)
+static float window_depth(const il_mat &projection, float z)
+{
+    const float *p = projection.data;
+    float d = (p[10] * z + p[11]) / (p[14] * z + p[15]) * 0.5f + 0.5f;
+    return d < 0.f? 0.f : d > 1.f? 1.f : d;
+}
+
+bool HiZ::pass(Pass &pass, const char *name, const char *frag, char **error)
+{
+    ilG_material m;
+    ilG_material_init(&m);
+    ilG_material_name(&m, name);
+    ilG_material_textureUnit(&m, TEX_SOURCE, "tex_Depth");
+    ilG_material_fragData(&m, 0, "out_Depth");
+    if (!ilG_renderman_addMaterialFromFile(rm, m, "deferred.vert", frag, &pass.mat, error)) {
+        return false;
+    }
+    ilG_material *mat = ilG_renderman_findMaterial(rm, pass.mat);
+    pass.program = mat->program;
+    pass.samples = ilG_material_getLoc(mat, "samples");
+    return true;
+}
+
+bool HiZ::build(ilG_renderman *rm, char **error)
+{
+    this->rm = rm;
+    if (!pass(reduce, "Hi-Z Reduce", "hiz_reduce.frag", error)) {
+        return false;
+    }
+    if (!pass(reduce_ms, "Hi-Z Reduce (multisampled)", "hiz_reduce_ms.frag", error)) {
+        ilG_renderman_delMaterial(rm, reduce.mat);
+        return false;
+    }
+    tgl_vao_init(&empty);
+    glGenFramebuffers(1, &fbo);
+    for (Slot &slot : slots) {
+        glGenBuffers(1, &slot.pbo);
+    }
+    built = true;
+    return true;
+}
+
+void HiZ::free()
+{
+    if (built) {
+        ilG_renderman_delMaterial(rm, reduce.mat);
+        ilG_renderman_delMaterial(rm, reduce_ms.mat);
+        tgl_vao_free(&empty);
+        glDeleteFramebuffers(1, &fbo);
+        for (Slot &slot : slots) {
+            if (slot.fence) {
+                glDeleteSync(slot.fence);
+            }
+            glDeleteBuffers(1, &slot.pbo);
+            slot = Slot();
+        }
+        glDeleteTextures(1, &pyramid);
+        demo_gl.invalidate();
+    }
+    fbo = pyramid = 0;
+    width = height = 0;
+    head = tail = 0;
+    levels.clear();
+    active = built = false;
+}
+
+void HiZ::resize(unsigned width, unsigned height)
+{
+    this->width = width;
+    this->height = height;
+    level_width.clear();
+    level_height.clear();
+    unsigned w = width, h = height;
+    do {
+        w = w > 1? w / 2 : 1;
+        h = h > 1? h / 2 : 1;
+        level_width.push_back(w);
+        level_height.push_back(h);
+    } while (w > readback_size || h > readback_size);
+
+    if (!pyramid) {
+        glGenTextures(1, &pyramid);
+    }
+    demo_gl.bind_texture(TEX_SOURCE, GL_TEXTURE_2D, pyramid);
+    demo_gl.active_texture(TEX_SOURCE);
+    for (size_t i = 0; i < level_width.size(); i++) {
+        glTexImage2D(GL_TEXTURE_2D, GLint(i), GL_R32F, GLsizei(level_width[i]),
+                     GLsizei(level_height[i]), 0, GL_RED, GL_FLOAT, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(level_width.size() - 1));
+    // Readbacks of the old size describe a different screen
+    levels.clear();
+    active = false;
+}
+
+void HiZ::draw_level(unsigned level)
+{
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid,
+                           GLint(level));
+    glViewport(0, 0, GLsizei(level_width[level]), GLsizei(level_height[level]));
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void HiZ::capture(const CameraBlock &camera, unsigned width, unsigned height)
+{
+    Slot &slot = slots[head];
+    if (!built || slot.fence) {
+        // The ring is full of readbacks still in flight; never wait for one
+        return;
+    }
+    GLint source = 0, samples = 0, type = GL_NONE, depth = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &source);
+    glGetIntegerv(GL_SAMPLES, &samples);
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                          GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+    if (type != GL_TEXTURE) {
+        if (!warned) {
+            il_warning("Occlusion culling needs a depth texture in the G-buffer");
+            warned = true;
+        }
+        return;
+    }
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                          GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &depth);
+    if (width != this->width || height != this->height) {
+        resize(width, height);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    demo_gl.enable(GL_DEPTH_TEST, false);
+    demo_gl.enable(GL_BLEND, false);
+    demo_gl.bind_vao(empty.object);
+    // Level 0 straight from the G-buffer, taking every sample
+    if (samples > 0) {
+        demo_gl.bind_texture(TEX_SOURCE, GL_TEXTURE_2D_MULTISAMPLE, GLuint(depth));
+        demo_gl.use_program(reduce_ms.program);
+        glUniform1i(reduce_ms.samples, samples);
+    } else {
+        demo_gl.bind_texture(TEX_SOURCE, GL_TEXTURE_2D, GLuint(depth));
+        demo_gl.use_program(reduce.program);
+    }
+    draw_level(0);
+    // Then each level from the one above, which is the only one sampled
+    demo_gl.use_program(reduce.program);
+    demo_gl.bind_texture(TEX_SOURCE, GL_TEXTURE_2D, pyramid);
+    demo_gl.active_texture(TEX_SOURCE);
+    const unsigned last = unsigned(level_width.size() - 1);
+    for (unsigned i = 1; i <= last; i++) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, GLint(i - 1));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(i - 1));
+        draw_level(i);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(last));
+
+    // The last level is still attached
+    const size_t size = sizeof(float) * level_width[last] * level_height[last];
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(size), NULL, GL_STREAM_READ);
+    glReadPixels(0, 0, GLsizei(level_width[last]), GLsizei(level_height[last]), GL_RED,
+                 GL_FLOAT, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = level_width[last];
+    slot.height = level_height[last];
+    slot.scale = 2u << last;
+    slot.frame = frame;
+    slot.camera = camera;
+    head = (head + 1) % ring;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, GLuint(source));
+    glViewport(0, 0, GLsizei(width), GLsizei(height));
+    demo_gl.enable(GL_DEPTH_TEST, true);
+}
+
+void HiZ::collect(Slot &slot)
+{
+    const size_t count = size_t(slot.width) * slot.height;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const float *data = static_cast<const float*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(sizeof(float) * count),
+                         GL_MAP_READ_BIT));
+    if (!data) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return;
+    }
+    levels.resize(1);
+    levels[0].width = slot.width;
+    levels[0].height = slot.height;
+    levels[0].depth.assign(data, data + count);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    seen = slot.camera;
+    seen_scale = slot.scale;
+    seen_frame = slot.frame;
+
+    // Continue the pyramid down to a single texel, the same way the GPU did
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const Level &src = levels.back();
+        Level dst;
+        dst.width = src.width > 1? src.width / 2 : 1;
+        dst.height = src.height > 1? src.height / 2 : 1;
+        dst.depth.resize(size_t(dst.width) * dst.height);
+        for (unsigned y = 0; y < dst.height; y++) {
+            const unsigned y1 = y + 1 == dst.height? src.height : y * 2 + 2;
+            for (unsigned x = 0; x < dst.width; x++) {
+                const unsigned x1 = x + 1 == dst.width? src.width : x * 2 + 2;
+                float d = 0.f;
+                for (unsigned sy = y * 2; sy < y1; sy++) {
+                    for (unsigned sx = x * 2; sx < x1; sx++) {
+                        d = fmaxf(d, src.depth[size_t(sy) * src.width + sx]);
+                    }
+                }
+                dst.depth[size_t(y) * dst.width + x] = d;
+            }
+        }
+        levels.push_back(move(dst));
+    }
+}
+
+void HiZ::update(const CameraBlock &camera)
+{
+    frame++;
+    // Oldest first, so the newest finished readback is the one kept
+    while (slots[tail].fence) {
+        Slot &slot = slots[tail];
+        if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        collect(slot);
+        tail = (tail + 1) % ring;
+    }
+    if (levels.empty()) {
+        active = false;
+        return;
+    }
+    const float dx = camera.position[0] - seen.position[0],
+        dy = camera.position[1] - seen.position[1],
+        dz = camera.position[2] - seen.position[2];
+    moved = sqrtf(dx * dx + dy * dy + dz * dz);
+    active = moved <= cut;
+}
+
+bool HiZ::visible(il_vec3 c, float radius)
+{
+    if (!active) {
+        return true;
+    }
+    tested++;
+    const float r = radius + pad * float(frame - seen_frame) + moved;
+    const float *view = seen.view.data, *proj = seen.projection.data, *vp = seen.vp.data;
+    const float z = view[8] * c.x + view[9] * c.y + view[10] * c.z + view[11];
+    const float znear = proj[11] / (proj[10] - 1.f);
+    if (z + r >= -znear) {
+        return true;
+    }
+
+    // Bounds of the box around the sphere, in the old view's NDC
+    float x0 = 1.f, y0 = 1.f, x1 = -1.f, y1 = -1.f;
+    for (unsigned i = 0; i < 8; i++) {
+        const float p[3] = {
+            c.x + (i & 1? r : -r),
+            c.y + (i & 2? r : -r),
+            c.z + (i & 4? r : -r),
+        };
+        const float w = vp[12] * p[0] + vp[13] * p[1] + vp[14] * p[2] + vp[15];
+        if (w <= 0.f) {
+            return true;
+        }
+        const float x = (vp[0] * p[0] + vp[1] * p[1] + vp[2] * p[2] + vp[3]) / w;
+        const float y = (vp[4] * p[0] + vp[5] * p[1] + vp[6] * p[2] + vp[7]) / w;
+        x0 = fminf(x0, x);
+        y0 = fminf(y0, y);
+        x1 = fmaxf(x1, x);
+        y1 = fmaxf(y1, y);
+    }
+    if (x0 < -1.f || y0 < -1.f || x1 > 1.f || y1 > 1.f) {
+        return true;
+    }
+
+    // Texels of the readback level under the rectangle, then the level above
+    // where it spans two at most
+    const Level &top = levels[0];
+    auto texel = [this](float ndc, unsigned size, unsigned limit) {
+        unsigned t = unsigned((ndc * .5f + .5f) * float(size)) / seen_scale;
+        return t < limit? t : limit - 1;
+    };
+    unsigned tx0 = texel(x0, width, top.width), tx1 = texel(x1, width, top.width),
+        ty0 = texel(y0, height, top.height), ty1 = texel(y1, height, top.height);
+    size_t level = 0;
+    while (level + 1 < levels.size() && (tx1 - tx0 > 1 || ty1 - ty0 > 1)) {
+        level++;
+        const Level &l = levels[level];
+        tx0 = min(tx0 / 2, l.width - 1);
+        tx1 = min(tx1 / 2, l.width - 1);
+        ty0 = min(ty0 / 2, l.height - 1);
+        ty1 = min(ty1 / 2, l.height - 1);
+    }
+    const Level &l = levels[level];
+    float farthest = 0.f;
+    for (unsigned y = ty0; y <= ty1; y++) {
+        for (unsigned x = tx0; x <= tx1; x++) {
+            farthest = fmaxf(farthest, l.depth[size_t(y) * l.width + x]);
+        }
+    }
+    if (window_depth(seen.projection, z + r) > farthest) {
+        culled++;
+        return false;
+    }
+    return true;
+}
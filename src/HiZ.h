@@ -0,0 +1,91 @@
+#ifndef DEMO_HIZ_H
+#define DEMO_HIZ_H
+
+#include <vector>
+
+#include "Camera.h"
+#include "tgl/tgl.h"
+
+extern "C" {
+#include "graphics/renderer.h"
+#include "math/vector.h"
+}
+
+/* Occlusion culling against a max-depth pyramid of earlier frames.
+ *
+ * capture(), with the G-buffer still bound after the geometry pass, reduces
+ * its depth texture on the GPU into a pyramid of farthest depths and reads a
+ * level of at most 128x128 back through a ring of PBOs. update() collects
+ * whichever readbacks have finished without waiting and extends them into a
+ * CPU pyramid; visible() then projects bounding spheres with the camera that
+ * depth was rendered from, and culls those whose nearest point lies behind
+ * the farthest depth under them.
+ *
+ * The depth is a few frames old, so the test stays conservative: spheres are
+ * padded by pad per frame of latency for moving objects and by the distance
+ * the eye moved for parallax, anything crossing the old near plane or the
+ * old view's edges is visible, and culling stops altogether once the eye
+ * has moved more than cut since the depth was rendered. */
+class HiZ {
+public:
+    bool build(ilG_renderman *rm, char **error);
+    void free();
+
+    // Call with the G-buffer bound; restores the binding and viewport after
+    void capture(const CameraBlock &camera, unsigned width, unsigned height);
+    // Call once per frame, before visible()
+    void update(const CameraBlock &camera);
+    bool visible(il_vec3 center, float radius);
+
+    // World units per frame an object may move, and the eye before giving up
+    float pad = .5f, cut = 4.f;
+    // visible() calls answered and spheres culled
+    unsigned long tested = 0, culled = 0;
+
+private:
+    static const unsigned ring = 3, readback_size = 128;
+
+    struct Pass {
+        ilG_matid mat;
+        GLuint program;
+        GLint samples;
+    };
+    struct Slot {
+        GLuint pbo = 0;
+        GLsync fence = 0;
+        unsigned width = 0, height = 0, scale = 1;
+        unsigned long frame = 0;
+        CameraBlock camera;
+    };
+    struct Level {
+        unsigned width, height;
+        std::vector<float> depth;
+    };
+
+    bool pass(Pass &pass, const char *name, const char *frag, char **error);
+    void resize(unsigned width, unsigned height);
+    void draw_level(unsigned level);
+    void collect(Slot &slot);
+
+    ilG_renderman *rm = nullptr;
+    Pass reduce, reduce_ms;
+    tgl_vao empty;
+    GLuint fbo = 0, pyramid = 0;
+    // Full resolution, and the GPU pyramid's level sizes, halved from it
+    unsigned width = 0, height = 0;
+    std::vector<unsigned> level_width, level_height;
+    Slot slots[ring];
+    unsigned head = 0, tail = 0;
+    unsigned long frame = 0;
+    bool built = false, warned = false;
+
+    // Newest collected depth and the camera it was rendered with
+    std::vector<Level> levels;
+    CameraBlock seen;
+    unsigned seen_scale = 1;
+    unsigned long seen_frame = 0;
+    float moved = 0;
+    bool active = false;
+};
+
+#endif
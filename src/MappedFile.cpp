@@ -0,0 +1,115 @@
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *path)
+{
+    close();
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        close();
+        return false;
+    }
+    ptr = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!ptr) {
+        close();
+        return false;
+    }
+    len = size_t(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (ptr) {
+        UnmapViewOfFile(ptr);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file) {
+        CloseHandle(file);
+    }
+    ptr = nullptr;
+    len = 0;
+    mapping = file = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const char *path)
+{
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    ptr = static_cast<const uint8_t*>(p);
+    len = size_t(st.st_size);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (ptr) {
+        munmap(const_cast<uint8_t*>(ptr), len);
+    }
+    ptr = nullptr;
+    len = 0;
+}
+
+#endif
+
+bool replace_file(const char *path, const void *data, size_t size)
+{
+    std::string tmp = std::string(path) + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, f) == size;
+    ok &= fclose(f) == 0;
+    if (ok) {
+        // rename() won't replace an existing file on Windows
+        std::remove(path);
+        ok = std::rename(tmp.c_str(), path) == 0;
+    }
+    if (!ok) {
+        std::remove(tmp.c_str());
+    }
+    return ok;
+}
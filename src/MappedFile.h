@@ -0,0 +1,39 @@
+#ifndef DEMO_MAPPEDFILE_H
+#define DEMO_MAPPEDFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const char *path);
+    void close();
+
+    const uint8_t *data() const {
+        return ptr;
+    }
+    size_t size() const {
+        return len;
+    }
+
+private:
+    const uint8_t *ptr = nullptr;
+    size_t len = 0;
+#ifdef _WIN32
+    void *file = nullptr, *mapping = nullptr;
+#endif
+};
+
+/* Writes a whole file through a temporary and a rename, so readers never
+ * see a truncated file */
+bool replace_file(const char *path, const void *data, size_t size);
+
+#endif
@@ -0,0 +1,122 @@
+#include "Mesh.h"
+
+#include <cstring>
+
+using namespace std;
+
+static const char magic[4] = {'I', 'L', 'M', 'S'};
+static const uint32_t version = 2;
+
+static size_t align16(size_t v)
+{
+    return (v + 15) & ~size_t(15);
+}
+
+void BakedMesh::bake(const MeshData &data, uint64_t source_mtime, uint64_t source_size)
+{
+    free();
+    Header head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, magic, sizeof(magic));
+    head.version = version;
+    head.source_mtime = source_mtime;
+    head.source_size = source_size;
+    head.vertex_count = uint32_t(data.vertices.size());
+    head.index_count = uint32_t(data.indices.size());
+    head.index_size = data.vertices.size() <= 0xFFFF? 2 : 4;
+    head.vertex_offset = align16(sizeof(Header));
+    head.index_offset = align16(head.vertex_offset + sizeof(MeshVertex) * head.vertex_count);
+
+    storage.assign(align16(head.index_offset + size_t(head.index_size) * head.index_count), 0);
+    memcpy(storage.data(), &head, sizeof(head));
+    memcpy(storage.data() + head.vertex_offset, data.vertices.data(),
+           sizeof(MeshVertex) * head.vertex_count);
+    if (head.index_size == 2) {
+        uint16_t *dst = reinterpret_cast<uint16_t*>(storage.data() + head.index_offset);
+        for (uint32_t i : data.indices) {
+            *dst++ = uint16_t(i);
+        }
+    } else {
+        memcpy(storage.data() + head.index_offset, data.indices.data(),
+               sizeof(uint32_t) * head.index_count);
+    }
+    base = storage.data();
+    len = storage.size();
+}
+
+bool BakedMesh::validate(uint64_t source_mtime, uint64_t source_size) const
+{
+    if (len < sizeof(Header)) {
+        return false;
+    }
+    const Header &head = header();
+    if (memcmp(head.magic, magic, sizeof(magic)) || head.version != version
+        || head.source_mtime != source_mtime || head.source_size != source_size
+        || (head.index_size != 2 && head.index_size != 4)) {
+        return false;
+    }
+    uint64_t vsize = uint64_t(sizeof(MeshVertex)) * head.vertex_count;
+    uint64_t isize = uint64_t(head.index_size) * head.index_count;
+    return head.vertex_offset <= len && vsize <= len - head.vertex_offset
+        && head.index_offset <= len && isize <= len - head.index_offset
+        && head.vertex_offset % 16 == 0 && head.index_offset % 16 == 0;
+}
+
+bool BakedMesh::load(const char *path, uint64_t source_mtime, uint64_t source_size)
+{
+    free();
+    if (!map.open(path)) {
+        return false;
+    }
+    base = map.data();
+    len = map.size();
+    if (!validate(source_mtime, source_size)) {
+        free();
+        return false;
+    }
+    return true;
+}
+
+bool BakedMesh::save(const char *path) const
+{
+    return replace_file(path, base, len);
+}
+
+void BakedMesh::free()
+{
+    map.close();
+    storage.clear();
+    storage.shrink_to_fit();
+    base = nullptr;
+    len = 0;
+}
+
+void Mesh::upload(const BakedMesh &baked)
+{
+    const BakedMesh::Header &head = baked.header();
+    free();
+    where = demo_geometry.add(baked.vertices(), head.vertex_count,
+                              baked.indices(), head.index_count, head.index_size);
+}
+
+void Mesh::upload(const MeshData &data)
+{
+    BakedMesh baked;
+    baked.bake(data, 0, 0);
+    upload(baked);
+}
+
+void Mesh::free()
+{
+    demo_geometry.remove(where);
+}
+
+void Mesh::bind()
+{
+    demo_geometry.bind();
+}
+
+void Mesh::draw()
+{
+    demo_geometry.draw(where);
+}
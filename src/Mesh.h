@@ -0,0 +1,75 @@
+#ifndef DEMO_MESH_H
+#define DEMO_MESH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Geometry.h"
+#include "MappedFile.h"
+#include "ObjLoader.h"
+#include "tgl/tgl.h"
+
+/* An indexed mesh laid out exactly as it is stored in a .mesh cache file:
+ * Header, then the interleaved MeshVertex array, then the index array, each
+ * aligned to 16 bytes. A mapped cache is handed to glBufferData as-is. */
+class BakedMesh {
+public:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t source_mtime, source_size;
+        uint32_t vertex_count, index_count;
+        uint32_t index_size; // 2 or 4 bytes
+        uint32_t reserved;
+        uint64_t vertex_offset, index_offset;
+    };
+
+    // Picks 16-bit indices when the vertex count allows it
+    void bake(const MeshData &data, uint64_t source_mtime, uint64_t source_size);
+    bool load(const char *path, uint64_t source_mtime, uint64_t source_size);
+    bool save(const char *path) const;
+    void free();
+
+    const Header &header() const {
+        return *reinterpret_cast<const Header*>(base);
+    }
+    const MeshVertex *vertices() const {
+        return reinterpret_cast<const MeshVertex*>(base + header().vertex_offset);
+    }
+    const void *indices() const {
+        return base + header().index_offset;
+    }
+    size_t size() const {
+        return len;
+    }
+
+private:
+    bool validate(uint64_t source_mtime, uint64_t source_size) const;
+
+    MappedFile map;
+    std::vector<uint8_t> storage;
+    const uint8_t *base = nullptr;
+    size_t len = 0;
+};
+
+/* A range of the shared geometry arena. bind() binds the arena's VAO, which
+ * is the same for every mesh, so drawing several meshes in a row only needs
+ * it once. */
+class Mesh {
+public:
+    // Must be called on the GL thread
+    void upload(const BakedMesh &baked);
+    void upload(const MeshData &data);
+    void free();
+    void bind();
+    void draw();
+
+    const GeometryArena::Range &range() const {
+        return where;
+    }
+
+private:
+    GeometryArena::Range where;
+};
+
+#endif
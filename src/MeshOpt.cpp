@@ -0,0 +1,293 @@
+#include "MeshOpt.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using namespace std;
+
+float acmr(const uint32_t *indices, size_t count, size_t vertex_count, unsigned cache_size)
+{
+    if (count < 3) {
+        return 0.f;
+    }
+    // A vertex is in the FIFO if it entered within the last cache_size misses
+    vector<size_t> stamp(vertex_count, 0);
+    size_t misses = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t v = indices[i];
+        if (stamp[v] == 0 || misses - stamp[v] + 1 > cache_size) {
+            misses++;
+            stamp[v] = misses;
+        }
+    }
+    return float(misses) / float(count / 3);
+}
+
+namespace {
+
+struct VertexHash {
+    size_t operator()(const MeshVertex &v) const {
+        uint32_t words[sizeof(MeshVertex) / 4];
+        memcpy(words, &v, sizeof(words));
+        uint64_t h = 0xCBF29CE484222325ull;
+        for (uint32_t w : words) {
+            h = (h ^ w) * 0x100000001B3ull;
+        }
+        return size_t(h);
+    }
+};
+
+struct VertexEq {
+    bool operator()(const MeshVertex &a, const MeshVertex &b) const {
+        return memcmp(&a, &b, sizeof(MeshVertex)) == 0;
+    }
+};
+
+}
+
+void generate_indices(const MeshVertex *vertices, size_t count, MeshData &out)
+{
+    out.vertices.clear();
+    out.indices.clear();
+    out.indices.reserve(count);
+    unordered_map<MeshVertex, uint32_t, VertexHash, VertexEq> seen;
+    for (size_t i = 0; i < count; i++) {
+        auto res = seen.emplace(vertices[i], uint32_t(out.vertices.size()));
+        if (res.second) {
+            out.vertices.push_back(vertices[i]);
+        }
+        out.indices.push_back(res.first->second);
+    }
+}
+
+namespace {
+
+class Tipsify {
+public:
+    Tipsify(const vector<uint32_t> &indices, size_t vertex_count, unsigned cache_size)
+        : indices(indices), cache_size(cache_size),
+          live(vertex_count, 0), stamp(vertex_count, 0), offsets(vertex_count + 1, 0),
+          emitted(indices.size() / 3, false)
+    {
+        // Vertex -> triangle adjacency in CSR form
+        for (uint32_t v : indices) {
+            live[v]++;
+        }
+        for (size_t v = 0; v < vertex_count; v++) {
+            offsets[v + 1] = offsets[v] + live[v];
+        }
+        adjacency.resize(indices.size());
+        vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+        }
+    }
+
+    // Outputs triangle ids, and the output positions where clusters start
+    void run(vector<uint32_t> &order, vector<size_t> &clusters) {
+        size_t time = cache_size + 1;
+        int64_t fan = live.empty()? -1 : 0;
+        cursor = 0;
+        clusters.push_back(0);
+        while (fan >= 0) {
+            candidates.clear();
+            for (uint32_t k = offsets[fan]; k < offsets[fan + 1]; k++) {
+                uint32_t tri = adjacency[k];
+                if (emitted[tri]) {
+                    continue;
+                }
+                emitted[tri] = true;
+                order.push_back(tri);
+                for (unsigned j = 0; j < 3; j++) {
+                    uint32_t v = indices[tri * 3 + j];
+                    dead_ends.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - stamp[v] > cache_size) {
+                        stamp[v] = time++;
+                    }
+                }
+            }
+            fan = next_vertex(time);
+            if (fan < 0) {
+                bool dead_end = false;
+                fan = skip_dead_end(dead_end);
+                // Jumping to an unrelated vertex flushes the cache, which is a
+                // hard boundary the overdraw pass can reorder around
+                if (fan >= 0 && !dead_end && order.size() != clusters.back()) {
+                    clusters.push_back(order.size());
+                }
+            }
+        }
+    }
+
+private:
+    int64_t next_vertex(size_t time) {
+        int64_t best = -1;
+        int64_t best_priority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            // Prefer vertices that will still be in the cache once all their
+            // remaining triangles are emitted
+            if (int64_t(time - stamp[v]) + 2 * int64_t(live[v]) <= int64_t(cache_size)) {
+                priority = int64_t(time - stamp[v]);
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = v;
+            }
+        }
+        return best;
+    }
+
+    int64_t skip_dead_end(bool &dead_end) {
+        while (!dead_ends.empty()) {
+            uint32_t v = dead_ends.back();
+            dead_ends.pop_back();
+            if (live[v] > 0) {
+                dead_end = true;
+                return v;
+            }
+        }
+        for (; cursor < live.size(); cursor++) {
+            if (live[cursor] > 0) {
+                return int64_t(cursor);
+            }
+        }
+        return -1;
+    }
+
+    const vector<uint32_t> &indices;
+    unsigned cache_size;
+    vector<uint32_t> live;
+    vector<size_t> stamp;
+    vector<uint32_t> offsets, adjacency;
+    vector<bool> emitted;
+    vector<uint32_t> dead_ends, candidates;
+    size_t cursor = 0;
+};
+
+void cross(const float *a, const float *b, const float *c, float *out)
+{
+    float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    out[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    out[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    out[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+/* Linear-speed overdraw ordering from the same paper: clusters whose area
+ * weighted normal points away from the mesh centroid are likely to occlude
+ * the rest, so they are drawn first. */
+void sort_clusters(const MeshData &data, vector<uint32_t> &order, const vector<size_t> &clusters)
+{
+    const size_t tris = order.size();
+    if (clusters.size() < 2) {
+        return;
+    }
+    float centroid[3] = {0, 0, 0}, total = 0;
+    struct Cluster {
+        size_t begin, end;
+        float centroid[3], normal[3], area;
+        float key;
+    };
+    vector<Cluster> list;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster cl;
+        memset(&cl, 0, sizeof(cl));
+        cl.begin = clusters[c];
+        cl.end = c + 1 < clusters.size()? clusters[c + 1] : tris;
+        for (size_t i = cl.begin; i < cl.end; i++) {
+            const uint32_t *t = &data.indices[size_t(order[i]) * 3];
+            const float *a = data.vertices[t[0]].pos;
+            const float *b = data.vertices[t[1]].pos;
+            const float *d = data.vertices[t[2]].pos;
+            float n[3];
+            cross(a, b, d, n);
+            float area = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (unsigned k = 0; k < 3; k++) {
+                cl.centroid[k] += (a[k] + b[k] + d[k]) / 3 * area;
+                cl.normal[k] += n[k];
+            }
+            cl.area += area;
+        }
+        for (unsigned k = 0; k < 3; k++) {
+            centroid[k] += cl.centroid[k];
+            if (cl.area > 0) {
+                cl.centroid[k] /= cl.area;
+            }
+        }
+        total += cl.area;
+        list.push_back(cl);
+    }
+    if (total <= 0) {
+        return;
+    }
+    for (unsigned k = 0; k < 3; k++) {
+        centroid[k] /= total;
+    }
+    for (auto &cl : list) {
+        cl.key = 0;
+        for (unsigned k = 0; k < 3; k++) {
+            cl.key += (cl.centroid[k] - centroid[k]) * cl.normal[k];
+        }
+    }
+    stable_sort(list.begin(), list.end(), [](const Cluster &a, const Cluster &b) {
+        return a.key > b.key;
+    });
+    vector<uint32_t> sorted;
+    sorted.reserve(tris);
+    for (auto &cl : list) {
+        sorted.insert(sorted.end(), order.begin() + cl.begin, order.begin() + cl.end);
+    }
+    order.swap(sorted);
+}
+
+}
+
+MeshOptStats optimize_mesh(MeshData &data, unsigned cache_size)
+{
+    MeshOptStats stats;
+    const size_t nverts = data.vertices.size();
+    stats.acmr_before = acmr(data.indices.data(), data.indices.size(), nverts, cache_size);
+    if (data.indices.size() < 3) {
+        stats.acmr_after = stats.acmr_before;
+        return stats;
+    }
+
+    // Triangle order
+    vector<uint32_t> order;
+    vector<size_t> clusters;
+    order.reserve(data.indices.size() / 3);
+    Tipsify(data.indices, nverts, cache_size).run(order, clusters);
+    sort_clusters(data, order, clusters);
+
+    vector<uint32_t> indices;
+    indices.reserve(data.indices.size());
+    for (uint32_t tri : order) {
+        indices.insert(indices.end(), &data.indices[size_t(tri) * 3], &data.indices[size_t(tri) * 3 + 3]);
+    }
+
+    // Vertex order: first use, dropping unreferenced vertices
+    const uint32_t unused = UINT32_MAX;
+    vector<uint32_t> remap(nverts, unused);
+    vector<MeshVertex> vertices;
+    vertices.reserve(nverts);
+    for (uint32_t &i : indices) {
+        if (remap[i] == unused) {
+            remap[i] = uint32_t(vertices.size());
+            vertices.push_back(data.vertices[i]);
+        }
+        i = remap[i];
+    }
+    data.vertices.swap(vertices);
+    data.indices.swap(indices);
+
+    stats.acmr_after = acmr(data.indices.data(), data.indices.size(), data.vertices.size(), cache_size);
+    return stats;
+}
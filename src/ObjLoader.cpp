@@ -0,0 +1,478 @@
+#include "ObjLoader.h"
+
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+const int32_t NONE = -1;
+
+struct Corner {
+    int32_t v, t, n;
+
+    bool operator==(const Corner &o) const {
+        return v == o.v && t == o.t && n == o.n;
+    }
+};
+
+inline size_t hash(const Corner &c)
+{
+    uint64_t h = uint32_t(c.v);
+    h = h * 0x9E3779B97F4A7C15ull ^ uint32_t(c.t);
+    h = h * 0x9E3779B97F4A7C15ull ^ uint32_t(c.n);
+    return size_t(h ^ (h >> 29));
+}
+
+/* Open addressing map from corner to vertex index. The dedupe pass does one
+ * lookup per corner, so this is where large meshes spend most of their time;
+ * std::unordered_map's per-node allocations are several times slower. */
+class CornerMap {
+public:
+    explicit CornerMap(size_t expected) {
+        size_t cap = 16;
+        while (cap < expected * 2) {
+            cap <<= 1;
+        }
+        slots.resize(cap);
+    }
+
+    // Returns the existing index, or inserts `index` and returns it
+    uint32_t insert(const Corner &key, uint32_t index) {
+        if ((used + 1) * 2 > slots.size()) {
+            grow();
+        }
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            Slot &s = slots[i];
+            if (s.index == EMPTY) {
+                s.key = key;
+                s.index = index;
+                used++;
+                return index;
+            }
+            if (s.key == key) {
+                return s.index;
+            }
+        }
+    }
+
+    template<typename F>
+    void each(F f) const {
+        for (auto &s : slots) {
+            if (s.index != EMPTY) {
+                f(s.key, s.index);
+            }
+        }
+    }
+
+private:
+    static const uint32_t EMPTY = UINT32_MAX;
+    struct Slot {
+        Corner key;
+        uint32_t index = EMPTY;
+    };
+
+    void grow() {
+        vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        used = 0;
+        for (auto &s : old) {
+            if (s.index != EMPTY) {
+                insert(s.key, s.index);
+            }
+        }
+    }
+
+    vector<Slot> slots;
+    size_t used = 0;
+};
+
+struct Chunk {
+    const char *begin, *end;
+    vector<float> v, vt, vn;
+    // Three corners per triangle
+    vector<Corner> corners;
+    size_t v_off = 0, vt_off = 0, vn_off = 0;
+    unsigned line = 0;
+    const char *error = nullptr;
+};
+
+inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+inline const char *skip_line(const char *p, const char *end)
+{
+    const char *nl = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+    return nl? nl + 1 : end;
+}
+
+const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Parses the decimal forms OBJ exporters write. Accumulates up to 19
+ * significant digits in an integer and applies the exponent once, which is
+ * far faster than strtof and exact enough for vertex data. */
+const char *parse_float(const char *p, const char *end, float &out)
+{
+    p = skip_space(p, end);
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = *p == '-';
+        p++;
+    }
+    const char *start = p;
+    uint64_t mant = 0;
+    int exp = 0, digits = 0;
+    for (; p < end && is_digit(*p); p++) {
+        if (digits < 19) {
+            mant = mant * 10 + uint64_t(*p - '0');
+            digits += mant != 0;
+        } else {
+            exp++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && is_digit(*p); p++) {
+            if (digits < 19) {
+                mant = mant * 10 + uint64_t(*p - '0');
+                digits += mant != 0;
+                exp--;
+            }
+        }
+    }
+    if (p == start) {
+        return nullptr;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool eneg = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            eneg = *p == '-';
+            p++;
+        }
+        int e = 0;
+        for (; p < end && is_digit(*p); p++) {
+            e = min(e * 10 + (*p - '0'), 1000);
+        }
+        exp += eneg? -e : e;
+    }
+    double v = double(mant);
+    if (exp < 0) {
+        v = -exp <= 22? v / pow10_table[-exp] : v * pow(10.0, exp);
+    } else if (exp > 0) {
+        v = exp <= 22? v * pow10_table[exp] : v * pow(10.0, exp);
+    }
+    out = float(neg? -v : v);
+    return p;
+}
+
+const char *parse_int(const char *p, const char *end, int32_t &out)
+{
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = *p == '-';
+        p++;
+    }
+    if (p == end || !is_digit(*p)) {
+        return nullptr;
+    }
+    int64_t v = 0;
+    for (; p < end && is_digit(*p); p++) {
+        v = min<int64_t>(v * 10 + (*p - '0'), INT32_MAX);
+    }
+    out = int32_t(neg? -v : v);
+    return p;
+}
+
+/* OBJ indices are 1-based, or negative to count back from the most recent
+ * element. Absolute indices are stored 0-based. Relative ones can only be
+ * resolved once the chunk's offset is known, and may reach back into earlier
+ * chunks, so their position relative to the chunk's first element, which is
+ * negative in that case, is stored biased as -(position + REL_BIAS + 2) and
+ * fixed up after all chunks finish. */
+const int64_t REL_BIAS = int64_t(1) << 30;
+
+inline int32_t encode_index(int32_t i, size_t local_count)
+{
+    if (i > 0) {
+        return i - 1;
+    }
+    if (i == 0) {
+        return NONE;
+    }
+    // Further back than any file can reach; decodes out of range
+    const int64_t position = max(int64_t(local_count) + i, -REL_BIAS);
+    return int32_t(-(position + REL_BIAS) - 2);
+}
+
+inline int32_t decode_index(int32_t i, size_t offset)
+{
+    if (i > -2) {
+        return i;
+    }
+    const int64_t index = int64_t(offset) + (-int64_t(i) - 2 - REL_BIAS);
+    return index < 0? NONE : int32_t(index);
+}
+
+const char *parse_floats(const char *p, const char *end, vector<float> &out,
+                         unsigned need, unsigned optional)
+{
+    for (unsigned i = 0; i < need; i++) {
+        float f;
+        if (!(p = parse_float(p, end, f))) {
+            return nullptr;
+        }
+        out.push_back(f);
+    }
+    // Trailing w components and the like are skipped
+    for (unsigned i = 0; i < optional; i++) {
+        float f;
+        const char *q = parse_float(p, end, f);
+        if (!q) {
+            break;
+        }
+        p = q;
+    }
+    return p;
+}
+
+void parse_chunk(Chunk &c)
+{
+    const char *p = c.begin, *end = c.end;
+    vector<Corner> poly;
+    while (p < end) {
+        c.line++;
+        p = skip_space(p, end);
+        if (p + 1 >= end) {
+            break;
+        }
+        const char *line_end = skip_line(p, end);
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            p = parse_floats(p + 2, line_end, c.v, 3, 1);
+        } else if (p[0] == 'v' && p[1] == 't') {
+            p = parse_floats(p + 2, line_end, c.vt, 2, 1);
+        } else if (p[0] == 'v' && p[1] == 'n') {
+            p = parse_floats(p + 2, line_end, c.vn, 3, 0);
+        } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            poly.clear();
+            p += 2;
+            while (true) {
+                p = skip_space(p, line_end);
+                if (p >= line_end || *p == '\n' || *p == '#') {
+                    break;
+                }
+                int32_t v, t = 0, n = 0;
+                if (!(p = parse_int(p, line_end, v))) {
+                    break;
+                }
+                if (p < line_end && *p == '/') {
+                    p++;
+                    if (p < line_end && *p != '/') {
+                        p = parse_int(p, line_end, t);
+                    }
+                    if (p && p < line_end && *p == '/') {
+                        p = parse_int(p + 1, line_end, n);
+                    }
+                    if (!p) {
+                        break;
+                    }
+                }
+                Corner corner;
+                corner.v = encode_index(v, c.v.size() / 3);
+                corner.t = encode_index(t, c.vt.size() / 2);
+                corner.n = encode_index(n, c.vn.size() / 3);
+                poly.push_back(corner);
+            }
+            if (!p || poly.size() < 3 || poly[0].v == NONE) {
+                c.error = "malformed face";
+                return;
+            }
+            for (size_t i = 2; i < poly.size(); i++) {
+                c.corners.push_back(poly[0]);
+                c.corners.push_back(poly[i-1]);
+                c.corners.push_back(poly[i]);
+            }
+        }
+        if (!p) {
+            c.error = "malformed vertex";
+            return;
+        }
+        p = line_end;
+    }
+}
+
+inline void sub3(const float *a, const float *b, float *out)
+{
+    out[0] = a[0] - b[0];
+    out[1] = a[1] - b[1];
+    out[2] = a[2] - b[2];
+}
+
+}
+
+bool parse_obj(const char *data, size_t size, MeshData &out, string &error, unsigned threads)
+{
+    const size_t min_chunk = 1 << 18;
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+    size_t count = min<size_t>(threads, size / min_chunk + 1);
+
+    vector<Chunk> chunks(count);
+    const char *end = data + size;
+    const char *p = data;
+    for (size_t i = 0; i < count; i++) {
+        chunks[i].begin = p;
+        if (i + 1 == count) {
+            p = end;
+        } else {
+            p = max(p, data + size * (i + 1) / count);
+            p = p < end? skip_line(p, end) : end;
+        }
+        chunks[i].end = p;
+    }
+
+    if (count == 1) {
+        parse_chunk(chunks[0]);
+    } else {
+        vector<thread> workers;
+        for (size_t i = 1; i < count; i++) {
+            workers.emplace_back(parse_chunk, ref(chunks[i]));
+        }
+        parse_chunk(chunks[0]);
+        for (auto &t : workers) {
+            t.join();
+        }
+    }
+
+    size_t nv = 0, nt = 0, nn = 0, ncorners = 0;
+    unsigned line = 0;
+    for (auto &c : chunks) {
+        if (c.error) {
+            error = string(c.error) + " on line " + to_string(line + c.line);
+            return false;
+        }
+        line += c.line;
+        c.v_off = nv;
+        c.vt_off = nt;
+        c.vn_off = nn;
+        nv += c.v.size() / 3;
+        nt += c.vt.size() / 2;
+        nn += c.vn.size() / 3;
+        ncorners += c.corners.size();
+    }
+    if (ncorners == 0) {
+        error = "no faces";
+        return false;
+    }
+
+    vector<float> pos, tex, norm;
+    pos.reserve(nv * 3);
+    tex.reserve(nt * 2);
+    norm.reserve(nn * 3);
+    for (auto &c : chunks) {
+        pos.insert(pos.end(), c.v.begin(), c.v.end());
+        tex.insert(tex.end(), c.vt.begin(), c.vt.end());
+        norm.insert(norm.end(), c.vn.begin(), c.vn.end());
+    }
+
+    out.vertices.clear();
+    out.indices.clear();
+    out.indices.reserve(ncorners);
+    // Indexed meshes typically reference each vertex about six times
+    CornerMap seen(ncorners / 4);
+    bool missing_normals = false;
+    for (auto &c : chunks) {
+        for (Corner k : c.corners) {
+            k.v = decode_index(k.v, c.v_off);
+            k.t = decode_index(k.t, c.vt_off);
+            k.n = decode_index(k.n, c.vn_off);
+            if (size_t(k.v) >= nv) {
+                error = "vertex index out of range";
+                return false;
+            }
+            if (k.t != NONE && size_t(k.t) >= nt) {
+                k.t = NONE;
+            }
+            if (k.n != NONE && size_t(k.n) >= nn) {
+                k.n = NONE;
+            }
+            uint32_t next = uint32_t(out.vertices.size());
+            uint32_t index = seen.insert(k, next);
+            if (index == next) {
+                MeshVertex vert;
+                memcpy(vert.pos, &pos[size_t(k.v) * 3], sizeof(vert.pos));
+                if (k.t != NONE) {
+                    memcpy(vert.tex, &tex[size_t(k.t) * 2], sizeof(vert.tex));
+                } else {
+                    vert.tex[0] = vert.tex[1] = 0;
+                }
+                if (k.n != NONE) {
+                    memcpy(vert.norm, &norm[size_t(k.n) * 3], sizeof(vert.norm));
+                } else {
+                    vert.norm[0] = vert.norm[1] = vert.norm[2] = 0;
+                    missing_normals = true;
+                }
+                out.vertices.push_back(vert);
+            }
+            out.indices.push_back(index);
+        }
+    }
+
+    if (missing_normals) {
+        // Area weighted smooth normals, shared by every vertex at a position
+        vector<float> accum(nv * 3, 0.f);
+        vector<int32_t> vert_pos(out.vertices.size());
+        seen.each([&](const Corner &k, uint32_t index) {
+            vert_pos[index] = k.v;
+        });
+        for (size_t i = 0; i + 2 < out.indices.size(); i += 3) {
+            const float *a = out.vertices[out.indices[i+0]].pos;
+            const float *b = out.vertices[out.indices[i+1]].pos;
+            const float *c = out.vertices[out.indices[i+2]].pos;
+            float e1[3], e2[3];
+            sub3(b, a, e1);
+            sub3(c, a, e2);
+            float n[3] = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0]
+            };
+            for (unsigned j = 0; j < 3; j++) {
+                float *dst = &accum[size_t(vert_pos[out.indices[i+j]]) * 3];
+                dst[0] += n[0];
+                dst[1] += n[1];
+                dst[2] += n[2];
+            }
+        }
+        for (size_t i = 0; i < out.vertices.size(); i++) {
+            MeshVertex &vert = out.vertices[i];
+            if (vert.norm[0] != 0 || vert.norm[1] != 0 || vert.norm[2] != 0) {
+                continue;
+            }
+            const float *n = &accum[size_t(vert_pos[i]) * 3];
+            float len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (len > 0) {
+                vert.norm[0] = n[0] / len;
+                vert.norm[1] = n[1] / len;
+                vert.norm[2] = n[2] / len;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef DEMO_OBJLOADER_H
+#define DEMO_OBJLOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Interleaved vertex layout shared by every demo mesh
+struct MeshVertex {
+    float pos[3];
+    float tex[2];
+    float norm[3];
+};
+
+struct MeshData {
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+/* Parses a Wavefront OBJ held in memory (usually a mapped file) into an
+ * indexed triangle list, deduplicating v/vt/vn combinations. Polygons are
+ * triangulated as fans and missing normals are generated. Large inputs are
+ * split at line boundaries and parsed on up to `threads` threads.
+ *
+ * Only geometry is read; materials, groups and smoothing groups are
+ * ignored. */
+bool parse_obj(const char *data, size_t size, MeshData &out, std::string &error,
+               unsigned threads = 0);
+
+#endif
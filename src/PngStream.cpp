@@ -0,0 +1,116 @@
+#include "PngStream.h"
+
+#include <errno.h>
+#include <string.h>
+
+extern "C" {
+#include "util/log.h"
+}
+
+PngStream::~PngStream()
+{
+    release();
+}
+
+void PngStream::on_error(png_structp png, png_const_charp message)
+{
+    auto self = reinterpret_cast<PngStream*>(png_get_error_ptr(png));
+    self->message = message;
+    png_longjmp(png, 1);
+}
+
+void PngStream::on_warning(png_structp png, png_const_charp message)
+{
+    auto self = reinterpret_cast<PngStream*>(png_get_error_ptr(png));
+    il_warning("%s: %s", self->path.c_str(), message);
+}
+
+void PngStream::release()
+{
+    if (png) {
+        png_destroy_write_struct(&png, info? &info : nullptr);
+    }
+    if (file) {
+        fclose(file);
+    }
+    png = nullptr;
+    info = nullptr;
+    file = nullptr;
+}
+
+/* libpng reports errors by longjmp-ing back to the setjmp in whichever of
+ * the functions below called it, so none of them keep objects with
+ * destructors on the stack. */
+
+bool PngStream::open(const char *path, unsigned width, unsigned height, int level,
+                     std::string &error)
+{
+    release();
+    this->path = path;
+    file = fopen(path, "wb");
+    if (!file) {
+        error = this->path + ": " + strerror(errno);
+        return false;
+    }
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, this, on_error, on_warning);
+    if (png) {
+        info = png_create_info_struct(png);
+    }
+    if (!png || !info) {
+        error = "Failed to allocate PNG writer";
+        release();
+        return false;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        error = this->path + ": " + message;
+        release();
+        return false;
+    }
+    png_init_io(png, file);
+    png_set_compression_level(png, level);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    // Input carries a fourth byte per pixel after RGB, which libpng skips
+    png_set_filler(png, 0, PNG_FILLER_AFTER);
+    return true;
+}
+
+bool PngStream::row(const uint8_t *rgba, std::string &error)
+{
+    if (!png) {
+        error = "PNG stream is not open";
+        return false;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        error = path + ": " + message;
+        release();
+        return false;
+    }
+    png_write_row(png, rgba);
+    return true;
+}
+
+bool PngStream::close(std::string &error)
+{
+    if (!png) {
+        error = "PNG stream is not open";
+        return false;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        error = path + ": " + message;
+        release();
+        return false;
+    }
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    png = nullptr;
+    info = nullptr;
+    int res = fclose(file);
+    file = nullptr;
+    if (res != 0) {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
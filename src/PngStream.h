@@ -0,0 +1,37 @@
+#ifndef DEMO_PNGSTREAM_H
+#define DEMO_PNGSTREAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include <png.h>
+
+/* Writes an 8-bit RGB PNG one row at a time, top to bottom, so only the row
+ * being written has to be in memory. Rows are passed as RGBA, the layout
+ * glReadPixels returns fastest, and alpha is dropped. level is zlib's, 1 is
+ * the fastest; row filtering is left to libpng. */
+class PngStream {
+public:
+    PngStream() {}
+    PngStream(const PngStream&) = delete;
+    PngStream &operator=(const PngStream&) = delete;
+    ~PngStream();
+
+    bool open(const char *path, unsigned width, unsigned height, int level, std::string &error);
+    bool row(const uint8_t *rgba, std::string &error);
+    // Finishes the file; must follow exactly height rows
+    bool close(std::string &error);
+
+private:
+    static void on_error(png_structp png, png_const_charp message);
+    static void on_warning(png_structp png, png_const_charp message);
+    void release();
+
+    FILE *file = nullptr;
+    png_structp png = nullptr;
+    png_infop info = nullptr;
+    std::string message, path;
+};
+
+#endif
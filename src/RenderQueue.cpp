@@ -0,0 +1,162 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "GLState.h"
+#include "Graphics.h"
+#include "UniformRing.h"
+
+using namespace std;
+
+unsigned RenderQueue::id(const void *object)
+{
+    auto it = ids.find(object);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    unsigned next = unsigned(ids.size()) % 4095 + 1;
+    ids.emplace(object, next);
+    return next;
+}
+
+uint32_t RenderQueue::depth(float distance, float zfar)
+{
+    float d = distance / zfar;
+    d = d < 0.f? 0.f : d > 1.f? 1.f : d;
+    return uint32_t(d * float(0xFFFFFF));
+}
+
+uint64_t RenderQueue::key(unsigned pass, unsigned material, unsigned textures, unsigned mesh,
+                          uint32_t depth)
+{
+    return uint64_t(pass & 0xF) << 60
+        | uint64_t(material & 0xFFF) << 48
+        | uint64_t(textures & 0xFFF) << 36
+        | uint64_t(mesh & 0xFFF) << 24
+        | uint64_t(depth & 0xFFFFFF);
+}
+
+void RenderQueue::push(uint64_t key, Drawable *drawable, uint32_t index)
+{
+    queue.push_back(Item{key, drawable, index, false});
+}
+
+void RenderQueue::sort()
+{
+    const size_t n = queue.size();
+    if (n < 2) {
+        return;
+    }
+    // Bytes that are the same in every key don't need a pass
+    uint64_t all_or = 0, all_and = ~uint64_t(0);
+    for (auto &item : queue) {
+        all_or |= item.key;
+        all_and &= item.key;
+    }
+    const uint64_t varying = all_or ^ all_and;
+    scratch.resize(n);
+    for (unsigned shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xFF) == 0) {
+            continue;
+        }
+        size_t offsets[256] = {0};
+        for (auto &item : queue) {
+            offsets[(item.key >> shift) & 0xFF]++;
+        }
+        size_t sum = 0;
+        for (size_t &o : offsets) {
+            size_t c = o;
+            o = sum;
+            sum += c;
+        }
+        for (auto &item : queue) {
+            scratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+        }
+        queue.swap(scratch);
+    }
+}
+
+void RenderQueue::prepass()
+{
+    ObjectBlock block;
+    memset(&block, 0, sizeof(block));
+    occluders = 0;
+    for (auto &item : queue) {
+        const Mesh *mesh = nullptr;
+        item.early_z = item.drawable->occluder(item, mesh, block.model);
+        if (!item.early_z) {
+            continue;
+        }
+        demo_uniforms.bind(DEMO_OBJECT_BINDING, demo_uniforms.push(&block, sizeof(block)));
+        demo_geometry.draw(mesh->range());
+        occluders++;
+    }
+    early_z = occluders != 0;
+}
+
+void RenderQueue::execute(Graphics &graphics)
+{
+#ifndef __APPLE__
+#define push_group(n) glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, n)
+#define pop_group() glPopDebugGroup()
+#else
+#define push_group(n)
+#define pop_group()
+#endif
+    items = queue.size();
+    material_changes = 0;
+    uint64_t last = 0;
+    Drawable *group = nullptr;
+    for (auto &item : queue) {
+        const unsigned material = unsigned(item.key >> 48) & 0xFFF;
+        const unsigned last_material = unsigned(last >> 48) & 0xFFF;
+        unsigned changed = 0;
+        if (&item == &queue.front() || material == 0 || last_material == 0) {
+            changed = CHANGED_ALL;
+        } else {
+            if (material != last_material) {
+                changed = CHANGED_ALL;
+            }
+            if ((item.key ^ last) >> 36 & 0xFFF) {
+                changed |= CHANGED_TEXTURES;
+            }
+            if ((item.key ^ last) >> 24 & 0xFFF) {
+                changed |= CHANGED_MESH;
+            }
+        }
+        material_changes += (changed & CHANGED_MATERIAL) != 0;
+        if (item.drawable != group) {
+            if (group) {
+                pop_group();
+            }
+            group = item.drawable;
+            push_group(group->name());
+        }
+        if (material == 0) {
+            // Unknown state: the drawable may bind behind the cache's back
+            demo_gl.invalidate();
+        }
+        if (early_z) {
+            // Cached, so this only reaches GL between runs of either kind
+            demo_gl.depth_func(item.early_z? GL_EQUAL : GL_LESS);
+            demo_gl.depth_mask(!item.early_z);
+        }
+        item.drawable->execute(graphics, item, changed);
+        if (material == 0) {
+            demo_gl.invalidate();
+        }
+        last = item.key;
+    }
+    if (group) {
+        pop_group();
+    }
+    if (early_z) {
+        demo_gl.depth_func(GL_LESS);
+        demo_gl.depth_mask(true);
+        early_z = false;
+    }
+    queue.clear();
+#undef push_group
+#undef pop_group
+}
@@ -0,0 +1,69 @@
+#ifndef DEMO_RENDERQUEUE_H
+#define DEMO_RENDERQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+class Drawable;
+class Graphics;
+
+/* Per-frame list of draw items ordered by a 64-bit key:
+ *
+ *     63..60 pass | 59..48 material | 47..36 textures | 35..24 mesh | 23..0 depth
+ *
+ * Items sharing a material end up adjacent, then those sharing textures and
+ * meshes, and within a run of identical state they go front to back for
+ * early-Z rejection. The sort is a stable LSD radix sort, so items with equal
+ * keys keep submission order.
+ *
+ * Material 0 means "unknown state": the item's drawable binds whatever it
+ * likes, so it and the item after it always see every state as changed. */
+class RenderQueue {
+public:
+    enum Pass {
+        PASS_OPAQUE = 1,
+        PASS_LEGACY = 15, // Drawables that only implement draw()
+    };
+    enum Changed {
+        CHANGED_MATERIAL = 1 << 0,
+        CHANGED_TEXTURES = 1 << 1,
+        CHANGED_MESH     = 1 << 2,
+        CHANGED_ALL      = 7,
+    };
+    struct Item {
+        uint64_t key;
+        Drawable *drawable;
+        uint32_t index; // Meaning is up to the drawable
+        bool early_z;   // Drawn by prepass() this frame
+    };
+
+    /* Small stable ids for state objects, keyed by address. 0 is never
+     * returned; ids wrap after 4095 objects, which only costs sort quality. */
+    unsigned id(const void *object);
+    // Front-to-back depth from the distance to the camera and the far plane
+    static uint32_t depth(float distance, float zfar);
+    static uint64_t key(unsigned pass, unsigned material, unsigned textures, unsigned mesh,
+                        uint32_t depth);
+
+    void push(uint64_t key, Drawable *drawable, uint32_t index = 0);
+    void sort();
+    /* Depth pre-pass: draws the occluder of every item that has one, in
+     * queue order, with the depth-only program and the geometry arena's
+     * position VAO already bound. execute() then draws those items with
+     * GL_EQUAL and depth writes off, and everything else as usual. */
+    void prepass();
+    // Calls Drawable::execute for every item in order, then clears the queue
+    void execute(Graphics &graphics);
+
+    // Last execute: items drawn and material switches; last prepass: items drawn
+    size_t items = 0, material_changes = 0, occluders = 0;
+
+private:
+    std::vector<Item> queue, scratch;
+    bool early_z = false;
+    std::unordered_map<const void*, unsigned> ids;
+};
+
+#endif
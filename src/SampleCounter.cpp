@@ -0,0 +1,48 @@
+#include "SampleCounter.h"
+
+void SampleCounter::begin()
+{
+    active = !pending;
+    if (!active) {
+        return;
+    }
+    if (!query) {
+        glGenQueries(1, &query);
+    }
+    glBeginQuery(target, query);
+}
+
+void SampleCounter::end()
+{
+    if (active) {
+        glEndQuery(target);
+        pending = true;
+        active = false;
+    }
+}
+
+bool SampleCounter::poll(GLuint &samples)
+{
+    if (!pending) {
+        return false;
+    }
+    GLuint available = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return false;
+    }
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+    total += samples;
+    results++;
+    pending = false;
+    return true;
+}
+
+void SampleCounter::free()
+{
+    if (query) {
+        glDeleteQueries(1, &query);
+    }
+    query = 0;
+    pending = active = false;
+}
@@ -0,0 +1,32 @@
+#ifndef DEMO_SAMPLECOUNTER_H
+#define DEMO_SAMPLECOUNTER_H
+
+#include "tgl/tgl.h"
+
+/* GL_SAMPLES_PASSED query that never stalls: begin() only starts a new query
+ * once the previous result has been collected by poll(), so a count arrives
+ * every frame or two rather than for every frame. Only one counter per target
+ * can be between begin() and end() at a time. With GL_TIME_ELAPSED
+ * (ARB_timer_query) it measures GPU time in nanoseconds instead. */
+class SampleCounter {
+public:
+    explicit SampleCounter(GLenum target = GL_SAMPLES_PASSED)
+        : target(target) {}
+
+    void begin();
+    void end();
+    // Stores the latest result and returns true if one has arrived
+    bool poll(GLuint &samples);
+    void free();
+
+    // Sum and number of results collected by poll(), for averaging
+    double total = 0;
+    unsigned long results = 0;
+
+private:
+    GLenum target;
+    GLuint query = 0;
+    bool pending = false, active = false;
+};
+
+#endif
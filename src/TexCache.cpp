@@ -0,0 +1,417 @@
+#include "TexCache.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "tgl/tgl.h"
+
+using namespace std;
+
+static const char magic[4] = {'I', 'L', 'T', 'X'};
+static const uint32_t version = 1;
+
+static unsigned channel_count(ilA_imgchannels channels)
+{
+    unsigned count = 0;
+    for (unsigned bit = ILA_IMG_R; bit <= ILA_IMG_A; bit <<= 1) {
+        count += (channels & bit) != 0;
+    }
+    return count;
+}
+
+static bool is_compressed(BakedTex::Format fmt)
+{
+    return fmt >= BakedTex::BC1;
+}
+
+static size_t level_size(BakedTex::Format fmt, unsigned width, unsigned height)
+{
+    size_t blocks = size_t((width + 3) / 4) * ((height + 3) / 4);
+    switch (fmt) {
+    case BakedTex::R8:    return size_t(width) * height;
+    case BakedTex::RG8:   return size_t(width) * height * 2;
+    case BakedTex::RGB8:  return size_t(width) * height * 3;
+    case BakedTex::RGBA8: return size_t(width) * height * 4;
+    case BakedTex::BC1:
+    case BakedTex::RGTC1: return blocks * 8;
+    case BakedTex::BC3:
+    case BakedTex::RGTC2: return blocks * 16;
+    }
+    return 0;
+}
+
+static size_t align16(size_t v)
+{
+    return (v + 15) & ~size_t(15);
+}
+
+// Mip generation
+///////////////////
+
+static void downsample(const uint8_t *src, unsigned sw, unsigned sh,
+                       uint8_t *dst, unsigned dw, unsigned dh, unsigned nc)
+{
+    for (unsigned y = 0; y < dh; y++) {
+        unsigned y0 = min(y * 2, sh - 1), y1 = min(y * 2 + 1, sh - 1);
+        for (unsigned x = 0; x < dw; x++) {
+            unsigned x0 = min(x * 2, sw - 1), x1 = min(x * 2 + 1, sw - 1);
+            for (unsigned c = 0; c < nc; c++) {
+                unsigned sum = src[(y0 * sw + x0) * nc + c]
+                    + src[(y0 * sw + x1) * nc + c]
+                    + src[(y1 * sw + x0) * nc + c]
+                    + src[(y1 * sw + x1) * nc + c];
+                dst[(y * dw + x) * nc + c] = uint8_t((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+// Block compression
+//////////////////////
+// Simple range-fit encoders: endpoints come from the block's bounding box,
+// then every texel picks its nearest palette entry. Good enough for the demo
+// assets and fast enough to run at first use.
+
+static void fetch_block(const uint8_t *src, unsigned w, unsigned h, unsigned nc,
+                        unsigned bx, unsigned by, uint8_t out[16][4])
+{
+    for (unsigned y = 0; y < 4; y++) {
+        for (unsigned x = 0; x < 4; x++) {
+            unsigned sx = min(bx * 4 + x, w - 1), sy = min(by * 4 + y, h - 1);
+            const uint8_t *p = src + (size_t(sy) * w + sx) * nc;
+            uint8_t *o = out[y * 4 + x];
+            o[0] = p[0];
+            o[1] = nc > 1? p[1] : 0;
+            o[2] = nc > 2? p[2] : 0;
+            o[3] = nc > 3? p[3] : 255;
+        }
+    }
+}
+
+static void put16(uint8_t *dst, uint16_t v)
+{
+    dst[0] = uint8_t(v);
+    dst[1] = uint8_t(v >> 8);
+}
+
+static uint16_t pack565(const int c[3])
+{
+    return uint16_t(((c[0] * 31 + 127) / 255) << 11
+                    | ((c[1] * 63 + 127) / 255) << 5
+                    | ((c[2] * 31 + 127) / 255));
+}
+
+static void unpack565(uint16_t v, int c[3])
+{
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+static void encode_bc1(const uint8_t texels[16][4], uint8_t *dst)
+{
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    for (unsigned i = 0; i < 16; i++) {
+        for (unsigned c = 0; c < 3; c++) {
+            lo[c] = min(lo[c], int(texels[i][c]));
+            hi[c] = max(hi[c], int(texels[i][c]));
+        }
+    }
+    // Inset the box slightly, which lowers the error of the interpolants
+    for (unsigned c = 0; c < 3; c++) {
+        int inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+    uint16_t c0 = pack565(hi), c1 = pack565(lo);
+    if (c0 < c1) {
+        swap(c0, c1);
+    }
+    int pal[4][3];
+    unpack565(c0, pal[0]);
+    unpack565(c1, pal[1]);
+    for (unsigned c = 0; c < 3; c++) {
+        pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+        pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+    }
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        for (unsigned i = 0; i < 16; i++) {
+            unsigned best = 0;
+            int best_err = 1 << 30;
+            for (unsigned j = 0; j < 4; j++) {
+                int err = 0;
+                for (unsigned c = 0; c < 3; c++) {
+                    int d = int(texels[i][c]) - pal[j][c];
+                    err += d * d;
+                }
+                if (err < best_err) {
+                    best_err = err;
+                    best = j;
+                }
+            }
+            indices |= uint32_t(best) << (i * 2);
+        }
+    }
+    put16(dst, c0);
+    put16(dst + 2, c1);
+    for (unsigned i = 0; i < 4; i++) {
+        dst[4 + i] = uint8_t(indices >> (i * 8));
+    }
+}
+
+// BC4 / RGTC1 block, also used for the alpha half of BC3
+static void encode_bc4(const uint8_t texels[16][4], unsigned channel, uint8_t *dst)
+{
+    int lo = 255, hi = 0;
+    for (unsigned i = 0; i < 16; i++) {
+        lo = min(lo, int(texels[i][channel]));
+        hi = max(hi, int(texels[i][channel]));
+    }
+    dst[0] = uint8_t(hi);
+    dst[1] = uint8_t(lo);
+    int pal[8];
+    pal[0] = hi;
+    pal[1] = lo;
+    for (int j = 1; j < 7; j++) {
+        pal[j + 1] = ((7 - j) * hi + j * lo) / 7;
+    }
+    uint64_t indices = 0;
+    if (hi != lo) {
+        for (unsigned i = 0; i < 16; i++) {
+            unsigned best = 0;
+            int best_err = 256;
+            for (unsigned j = 0; j < 8; j++) {
+                int err = abs(int(texels[i][channel]) - pal[j]);
+                if (err < best_err) {
+                    best_err = err;
+                    best = j;
+                }
+            }
+            indices |= uint64_t(best) << (i * 3);
+        }
+    }
+    for (unsigned i = 0; i < 6; i++) {
+        dst[2 + i] = uint8_t(indices >> (i * 8));
+    }
+}
+
+static void compress(BakedTex::Format fmt, const uint8_t *src, unsigned w, unsigned h,
+                     unsigned nc, uint8_t *dst)
+{
+    unsigned bw = (w + 3) / 4, bh = (h + 3) / 4;
+    for (unsigned by = 0; by < bh; by++) {
+        for (unsigned bx = 0; bx < bw; bx++) {
+            uint8_t texels[16][4];
+            fetch_block(src, w, h, nc, bx, by, texels);
+            switch (fmt) {
+            case BakedTex::BC1:
+                encode_bc1(texels, dst);
+                dst += 8;
+                break;
+            case BakedTex::BC3:
+                encode_bc4(texels, 3, dst);
+                encode_bc1(texels, dst + 8);
+                dst += 16;
+                break;
+            case BakedTex::RGTC1:
+                encode_bc4(texels, 0, dst);
+                dst += 8;
+                break;
+            case BakedTex::RGTC2:
+                encode_bc4(texels, 0, dst);
+                encode_bc4(texels, 1, dst + 8);
+                dst += 16;
+                break;
+            default:
+                return;
+            }
+        }
+    }
+}
+
+// BakedTex
+/////////////
+
+bool BakedTex::bake(const ilA_img *faces, unsigned count, bool compress_,
+                    uint64_t source_mtime, uint64_t source_size)
+{
+    free();
+    if (count == 0 || faces[0].fmt != ILA_IMG_U8) {
+        return false;
+    }
+    const unsigned width = faces[0].width, height = faces[0].height;
+    const unsigned nc = channel_count(faces[0].channels);
+    for (unsigned i = 0; i < count; i++) {
+        if (faces[i].fmt != ILA_IMG_U8 || faces[i].channels != faces[0].channels
+            || faces[i].width != width || faces[i].height != height) {
+            return false;
+        }
+    }
+    static const Format plain[] = {R8, RG8, RGB8, RGBA8};
+    static const Format packed[] = {RGTC1, RGTC2, BC1, BC3};
+    if (nc < 1 || nc > 4) {
+        return false;
+    }
+    const Format fmt = compress_? packed[nc-1] : plain[nc-1];
+
+    unsigned levels = 1;
+    while ((width >> levels) > 0 || (height >> levels) > 0) {
+        levels++;
+    }
+
+    size_t offset = align16(sizeof(Header) + sizeof(Level) * count * levels);
+    vector<Level> table;
+    for (unsigned f = 0; f < count; f++) {
+        for (unsigned l = 0; l < levels; l++) {
+            Level lvl;
+            lvl.width = max(1u, width >> l);
+            lvl.height = max(1u, height >> l);
+            lvl.size = level_size(fmt, lvl.width, lvl.height);
+            lvl.offset = offset;
+            offset = align16(offset + lvl.size);
+            table.push_back(lvl);
+        }
+    }
+    storage.assign(offset, 0);
+
+    Header head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, magic, sizeof(magic));
+    head.version = version;
+    head.source_mtime = source_mtime;
+    head.source_size = source_size;
+    head.format = fmt;
+    head.width = width;
+    head.height = height;
+    head.faces = count;
+    head.levels = levels;
+    memcpy(storage.data(), &head, sizeof(head));
+    memcpy(storage.data() + sizeof(head), table.data(), sizeof(Level) * table.size());
+
+    vector<uint8_t> cur, next;
+    for (unsigned f = 0; f < count; f++) {
+        cur.assign(faces[f].data, faces[f].data + size_t(width) * height * nc);
+        for (unsigned l = 0; l < levels; l++) {
+            const Level &lvl = table[f * levels + l];
+            if (l > 0) {
+                const Level &prev = table[f * levels + l - 1];
+                next.resize(size_t(lvl.width) * lvl.height * nc);
+                downsample(cur.data(), prev.width, prev.height,
+                           next.data(), lvl.width, lvl.height, nc);
+                cur.swap(next);
+            }
+            uint8_t *dst = storage.data() + lvl.offset;
+            if (is_compressed(fmt)) {
+                compress(fmt, cur.data(), lvl.width, lvl.height, nc, dst);
+            } else {
+                memcpy(dst, cur.data(), lvl.size);
+            }
+        }
+    }
+
+    base = storage.data();
+    len = storage.size();
+    return true;
+}
+
+bool BakedTex::validate(bool compress_, uint64_t source_mtime, uint64_t source_size) const
+{
+    if (len < sizeof(Header)) {
+        return false;
+    }
+    const Header &head = header();
+    if (memcmp(head.magic, magic, sizeof(magic)) || head.version != version
+        || head.source_mtime != source_mtime || head.source_size != source_size
+        || head.format > RGTC2 || is_compressed(Format(head.format)) != compress_
+        || head.faces == 0 || head.levels == 0 || head.levels > 32) {
+        return false;
+    }
+    if (sizeof(Header) + sizeof(Level) * head.faces * head.levels > len) {
+        return false;
+    }
+    for (unsigned f = 0; f < head.faces; f++) {
+        for (unsigned l = 0; l < head.levels; l++) {
+            const Level &lvl = level(f, l);
+            if (lvl.offset > len || lvl.size > len - lvl.offset
+                || lvl.size != level_size(Format(head.format), lvl.width, lvl.height)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool BakedTex::load(const char *path, bool compress_, uint64_t source_mtime, uint64_t source_size)
+{
+    free();
+    if (!map.open(path)) {
+        return false;
+    }
+    base = map.data();
+    len = map.size();
+    if (!validate(compress_, source_mtime, source_size)) {
+        free();
+        return false;
+    }
+    return true;
+}
+
+bool BakedTex::save(const char *path) const
+{
+    return replace_file(path, base, len);
+}
+
+void BakedTex::upload(ilG_tex *tex) const
+{
+    static const GLenum internal[] = {
+        GL_R8, GL_RG8, GL_RGB8, GL_RGBA8,
+        GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+        GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+        GL_COMPRESSED_RED_RGTC1,
+        GL_COMPRESSED_RG_RGTC2
+    };
+    static const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    const Header &head = header();
+    const Format fmt = Format(head.format);
+
+    memset(tex, 0, sizeof(*tex));
+    tex->target = head.faces == 6? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+    glGenTextures(1, &tex->object);
+    glBindTexture(tex->target, tex->object);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned f = 0; f < head.faces; f++) {
+        // Same face order as ilG_tex_loadcube
+        GLenum target = head.faces == 6? GL_TEXTURE_CUBE_MAP_POSITIVE_X + f : GL_TEXTURE_2D;
+        for (unsigned l = 0; l < head.levels; l++) {
+            const Level &lvl = level(f, l);
+            const uint8_t *data = base + lvl.offset;
+            if (is_compressed(fmt)) {
+                glCompressedTexImage2D(target, GLint(l), internal[fmt], GLsizei(lvl.width),
+                                       GLsizei(lvl.height), 0, GLsizei(lvl.size), data);
+            } else {
+                glTexImage2D(target, GLint(l), GLint(internal[fmt]), GLsizei(lvl.width),
+                             GLsizei(lvl.height), 0, formats[fmt], GL_UNSIGNED_BYTE, data);
+            }
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(tex->target, GL_TEXTURE_MAX_LEVEL, GLint(head.levels - 1));
+    glTexParameteri(tex->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(tex->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (tex->target == GL_TEXTURE_CUBE_MAP) {
+        glTexParameteri(tex->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(tex->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(tex->target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+}
+
+void BakedTex::free()
+{
+    map.close();
+    storage.clear();
+    storage.shrink_to_fit();
+    base = nullptr;
+    len = 0;
+}
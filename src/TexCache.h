@@ -0,0 +1,79 @@
+#ifndef DEMO_TEXCACHE_H
+#define DEMO_TEXCACHE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "MappedFile.h"
+
+extern "C" {
+#include "asset/image.h"
+#include "graphics/tex.h"
+}
+
+/* A texture with its whole mip chain already decoded (and optionally block
+ * compressed), laid out exactly as it is stored in a .iltex cache file.
+ *
+ * Layout: Header, then faces * levels Level records (face major), then the
+ * level data, each blob aligned to 16 bytes. All offsets are from the start
+ * of the file, so a mapped cache can be uploaded without any copies.
+ */
+class BakedTex {
+public:
+    enum Format : uint32_t {
+        R8,
+        RG8,
+        RGB8,
+        RGBA8,
+        BC1,   // RGB, 4bpp
+        BC3,   // RGBA, 8bpp
+        RGTC1, // R, 4bpp
+        RGTC2, // RG, 8bpp
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t source_mtime, source_size;
+        uint32_t format;
+        uint32_t width, height;
+        uint32_t faces, levels;
+        uint32_t reserved;
+    };
+    struct Level {
+        uint64_t offset, size;
+        uint32_t width, height;
+    };
+
+    /* Builds the mip chain of faces[0..count) on the CPU. All faces need
+     * the same size and channel layout. Frees nothing. */
+    bool bake(const ilA_img *faces, unsigned count, bool compress,
+              uint64_t source_mtime, uint64_t source_size);
+    /* Maps a cache file, failing if it's stale or was baked with a different
+     * compression setting. */
+    bool load(const char *path, bool compress, uint64_t source_mtime, uint64_t source_size);
+    bool save(const char *path) const;
+    // Must be called on the GL thread
+    void upload(ilG_tex *tex) const;
+    void free();
+
+    const Header &header() const {
+        return *reinterpret_cast<const Header*>(base);
+    }
+    const Level &level(unsigned face, unsigned level) const {
+        return reinterpret_cast<const Level*>(base + sizeof(Header))[face * header().levels + level];
+    }
+    size_t size() const {
+        return len;
+    }
+
+private:
+    bool validate(bool compress, uint64_t source_mtime, uint64_t source_size) const;
+
+    MappedFile map;
+    std::vector<uint8_t> storage;
+    const uint8_t *base = nullptr;
+    size_t len = 0;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "UniformRing.h"
+
+#include <string.h>
+
+#include "GLState.h"
+
+extern "C" {
+#include "util/log.h"
+}
+
+UniformRing demo_uniforms;
+
+static_assert(sizeof(ObjectBlock) == 2 * 64 + 16, "ObjectBlock must match std140");
+
+void UniformRing::create(size_t size)
+{
+    GLint align = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    alignment = align > 0? size_t(align) : 256;
+    region = (size + alignment - 1) / alignment * alignment;
+    persistent = epoxy_gl_version() >= 44 || TGL_EXTENSION(ARB_buffer_storage);
+
+    const GLsizeiptr total = GLsizeiptr(region * frames);
+    glGenBuffers(1, &buffer);
+    demo_gl.bind_buffer(GL_UNIFORM_BUFFER, buffer);
+    if (persistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, total, NULL, flags);
+        mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, total, flags);
+        if (!mapped) {
+            il_warning("Persistent map of the uniform ring failed, mapping per write");
+            persistent = false;
+        }
+    } else {
+        glBufferData(GL_UNIFORM_BUFFER, total, NULL, GL_STREAM_DRAW);
+    }
+    head = 0;
+}
+
+void UniformRing::release()
+{
+    for (GLsync &fence : fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+        fence = 0;
+    }
+    if (buffer) {
+        if (mapped) {
+            demo_gl.bind_buffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        demo_gl.forget_buffer(buffer);
+        // Draws still in flight keep the old storage alive
+        glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+}
+
+void UniformRing::begin_frame()
+{
+    if (!buffer) {
+        create(region);
+        il_log("Uniform ring: %u x %zu bytes, %s", frames, region,
+               persistent? "persistently mapped" : "mapped per write");
+    }
+    GLsync &fence = fences[current];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            waits++;
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+    head = 0;
+}
+
+void UniformRing::end_frame()
+{
+    if (!buffer) {
+        return;
+    }
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    current = (current + 1) % frames;
+}
+
+UniformRing::Slice UniformRing::push(const void *data, size_t size)
+{
+    size_t offset = (head + alignment - 1) / alignment * alignment;
+    if (!buffer || offset + size > region) {
+        size_t grown = buffer? region * 2 : region;
+        while (grown < size) {
+            grown *= 2;
+        }
+        release();
+        create(grown);
+        il_log("Uniform ring grown to %zu bytes per frame", region);
+        offset = 0;
+    }
+    const size_t at = current * region + offset;
+    if (mapped) {
+        memcpy(mapped + at, data, size);
+    } else {
+        demo_gl.bind_buffer(GL_UNIFORM_BUFFER, buffer);
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+            | GL_MAP_INVALIDATE_RANGE_BIT;
+        void *ptr = glMapBufferRange(GL_UNIFORM_BUFFER, GLintptr(at), GLsizeiptr(size), flags);
+        memcpy(ptr, data, size);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    head = offset + size;
+    return Slice{buffer, GLintptr(at), GLsizeiptr(size)};
+}
+
+void UniformRing::bind(GLuint binding, const Slice &slice)
+{
+    // Also sets the generic binding, keep the shadow in step
+    demo_gl.bind_buffer(GL_UNIFORM_BUFFER, slice.buffer);
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, slice.buffer, slice.offset, slice.size);
+}
+
+void UniformRing::free()
+{
+    release();
+    current = 0;
+}
+
+void UniformRing::attach(ilG_material *mat)
+{
+    GLuint index = glGetUniformBlockIndex(mat->program, "Object");
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(mat->program, index, DEMO_OBJECT_BINDING);
+    }
+}
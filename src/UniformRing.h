@@ -0,0 +1,76 @@
+#ifndef DEMO_UNIFORMRING_H
+#define DEMO_UNIFORMRING_H
+
+#include <stddef.h>
+
+#include "tgl/tgl.h"
+
+extern "C" {
+#include "graphics/material.h"
+#include "math/matrix.h"
+}
+
+enum {
+    // Uniform buffer binding point of the Object block
+    DEMO_OBJECT_BINDING = 1,
+};
+
+/* std140 layout of the per-object uniform block. Shaders declare it as
+ *
+ *     layout(std140, row_major) uniform Object {
+ *         mat4 model, imt;
+ *         vec4 color;
+ *     };
+ */
+struct ObjectBlock {
+    il_mat model, imt;
+    float color[4];
+};
+
+/* Stream of uniform data for the current frame, carved out of one buffer
+ * split into a region per frame in flight. A region is only rewritten once
+ * the fence placed at the end of its frame has signalled, so writes never
+ * stall on or race with the GPU.
+ *
+ * With GL 4.4 or ARB_buffer_storage the buffer stays mapped for its whole
+ * lifetime and push() is a plain memcpy; otherwise each push maps just its
+ * range, unsynchronized. Regions that run out of space mid-frame are
+ * doubled. */
+class UniformRing {
+public:
+    struct Slice {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    // Waits for this frame's region to be released by the GPU
+    void begin_frame();
+    // Fences the region written since begin_frame and moves to the next one
+    void end_frame();
+    Slice push(const void *data, size_t size);
+    void bind(GLuint binding, const Slice &slice);
+    void free();
+    // Points the material's Object block, if it has one, at DEMO_OBJECT_BINDING
+    static void attach(ilG_material *mat);
+
+    bool persistent = false;
+    // Frames that had to block on their region's fence
+    unsigned long waits = 0;
+
+private:
+    static const unsigned frames = 3;
+
+    void create(size_t size);
+    void release();
+
+    GLuint buffer = 0;
+    GLsync fences[frames] = {};
+    char *mapped = nullptr;
+    size_t region = 64 * 1024, alignment = 256, head = 0;
+    unsigned current = 0;
+};
+
+extern UniformRing demo_uniforms;
+
+#endif
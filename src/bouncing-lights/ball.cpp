@@ -1,6 +1,9 @@
 #include "ball.hpp"
 
+#include <cstring>
+
 #include "Demo.h"
+#include "GLState.h"
 
 extern "C" {
 #include "graphics/material.h"
@@ -19,45 +22,113 @@ using namespace BouncingLights;
 
 void BallRenderer::free()
 {
-    ilG_mesh_free(&mesh);
+    mesh.free();
     ilG_renderman_delMaterial(rm, mat);
+    if (batched) {
+        ilG_renderman_delMaterial(rm, batch_mat);
+    }
 }
 
-void BallRenderer::draw(il_mat *mvp, il_mat *imt, il_vec3 *col, size_t count)
+void BallRenderer::draw(il_mat *model, il_mat *imt, il_vec3 *col, size_t count)
 {
-    ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
-    ilG_mesh_bind(&mesh);
-    ilG_material_bind(mat);
     for (unsigned i = 0; i < count; i++) {
-        ilG_material_bindMatrix(mat, mvp_loc, mvp[i]);
-        ilG_material_bindMatrix(mat, imt_loc, imt[i]);
-        il_vec3 c = col[i];
-        glUniform3f(col_loc, c.x, c.y, c.z);
-        ilG_mesh_draw(&mesh);
+        draw(model[i], imt[i], col[i], i == 0? RenderQueue::CHANGED_ALL : 0);
     }
 }
 
-bool BallRenderer::build(ilG_renderman *rm, char **error)
+void BallRenderer::draw(il_mat model, il_mat imt, il_vec3 col, unsigned changed)
+{
+    ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
+    if (changed & RenderQueue::CHANGED_MESH) {
+        mesh.bind();
+    }
+    if (changed & RenderQueue::CHANGED_MATERIAL) {
+        demo_gl.material(mat);
+    }
+    ObjectBlock block;
+    block.model = model;
+    block.imt = imt;
+    block.color[0] = col.x;
+    block.color[1] = col.y;
+    block.color[2] = col.z;
+    block.color[3] = 1.f;
+    demo_uniforms.bind(DEMO_OBJECT_BINDING, demo_uniforms.push(&block, sizeof(block)));
+    mesh.draw();
+}
+
+uint64_t BallRenderer::key(RenderQueue &queue, uint32_t depth)
+{
+    return RenderQueue::key(RenderQueue::PASS_OPAQUE, queue.id(&mat), 0, queue.id(&mesh), depth);
+}
+
+bool BallRenderer::record(DrawBatch &batch, il_mat *model, il_mat *imt, il_vec3 *col, size_t count)
+{
+    if (!batched) {
+        return false;
+    }
+    if (group < 0) {
+        group = int(batch.group([this]() {
+            demo_gl.material(ilG_renderman_findMaterial(rm, batch_mat));
+        }));
+    }
+    DrawBatch::DrawData data;
+    memset(&data, 0, sizeof(data));
+    for (size_t i = 0; i < count; i++) {
+        data.model = model[i];
+        data.imt = imt[i];
+        data.color[0] = col[i].x;
+        data.color[1] = col[i].y;
+        data.color[2] = col[i].z;
+        batch.add(unsigned(group), mesh, data);
+    }
+    return true;
+}
+
+bool BallRenderer::build(ilG_renderman *rm, AssetLoader &loader, GBufferLayout layout,
+                         char **error)
 {
     this->rm = rm;
 
+    auto outputs = [layout](ilG_material &m) {
+        if (layout == GBUFFER_COMPACT) {
+            Deferred::outputs(m);
+        } else {
+            ilG_material_fragData(&m, ILG_GBUFFER_NORMAL, "out_Normal");
+            ilG_material_fragData(&m, ILG_GBUFFER_ALBEDO, "out_Albedo");
+        }
+    };
+    const bool compact = layout == GBUFFER_COMPACT;
     ilG_material m;
     ilG_material_init(&m);
     ilG_material_name(&m, "Ball Material");
-    ilG_material_fragData(&m, ILG_GBUFFER_NORMAL, "out_Normal");
-    ilG_material_fragData(&m, ILG_GBUFFER_ALBEDO, "out_Albedo");
+    outputs(m);
     ilG_material_arrayAttrib(&m, ILG_MESH_POS, "in_Position");
-    if (!ilG_renderman_addMaterialFromFile(rm, m, "glow.vert", "glow.frag", &mat, error)) {
+    if (!ilG_renderman_addMaterialFromFile(rm, m, "glow.vert",
+                                           compact? "glow_compact.frag" : "glow.frag",
+                                           &mat, error)) {
         return false;
     }
     ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
-    mvp_loc = ilG_material_getLoc(mat, "mvp");
-    imt_loc = ilG_material_getLoc(mat, "imt");
-    col_loc = ilG_material_getLoc(mat, "col");
+    CameraBuffer::attach(mat);
+    UniformRing::attach(mat);
 
-    if (!ilG_mesh_fromfile(&mesh, &demo_fs, "sphere.obj")) {
-        return false;
+    if (DrawBatch::supported()) {
+        ilG_material_init(&m);
+        ilG_material_name(&m, "Ball Material (batched)");
+        outputs(m);
+        ilG_material_arrayAttrib(&m, ILG_MESH_POS, "in_Position");
+        ilG_material_arrayAttrib(&m, DEMO_DRAW_ID_ATTRIB, "in_DrawID");
+        ilG_material_textureUnit(&m, DEMO_DRAW_DATA_UNIT, "draws");
+        if (!ilG_renderman_addMaterialFromFile(rm, m, "glow_batch.vert",
+                                               compact? "glow_batch_compact.frag"
+                                                      : "glow_batch.frag",
+                                               &batch_mat, error)) {
+            return false;
+        }
+        CameraBuffer::attach(ilG_renderman_findMaterial(rm, batch_mat));
+        batched = true;
     }
 
+    loader.mesh(&mesh, "sphere.obj");
     return true;
 }
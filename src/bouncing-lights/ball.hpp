@@ -4,6 +4,13 @@
 #include <unordered_map>
 
 #include "tgl/tgl.h"
+#include "AssetLoader.h"
+#include "Camera.h"
+#include "Deferred.h"
+#include "DrawBatch.h"
+#include "RenderQueue.h"
+#include "Mesh.h"
+#include "UniformRing.h"
 
 extern "C" {
 #include "graphics/material.h"
@@ -16,14 +23,24 @@ namespace BouncingLights {
 
 class BallRenderer {
     ilG_renderman *rm = nullptr;
-    ilG_mesh mesh;
-    ilG_matid mat;
-    GLuint mvp_loc, imt_loc, col_loc;
+    Mesh mesh;
+    ilG_matid mat, batch_mat;
+    bool batched = false;
+    int group = -1;
 
 public:
     void free();
-    bool build(ilG_renderman *rm, char **error);
-    void draw(il_mat *mvp, il_mat *imt, il_vec3 *col, size_t count);
+    bool build(ilG_renderman *rm, AssetLoader &loader, GBufferLayout layout, char **error);
+    void draw(il_mat *model, il_mat *imt, il_vec3 *col, size_t count);
+    // One ball, only rebinding the state flagged in changed
+    void draw(il_mat model, il_mat imt, il_vec3 col, unsigned changed);
+    uint64_t key(RenderQueue &queue, uint32_t depth);
+    // False when the GL 4.3 batched material isn't available
+    bool record(DrawBatch &batch, il_mat *model, il_mat *imt, il_vec3 *col, size_t count);
+    // Mesh draw() uses, for the depth pre-pass
+    const Mesh *occluder() const {
+        return &mesh;
+    }
 };
 
 }
@@ -5,6 +5,7 @@
 #include <BulletCollision/CollisionDispatch/btCollisionObject.h>
 #include <SDL.h>
 
+#include <chrono>
 #include <iostream>
 #include <utility>
 #include <ctime>
@@ -13,9 +14,12 @@
 
 #include "tgl/tgl.h"
 #include "debugdraw.hpp"
+#include "GLState.h"
 #include "bulletspace.hpp"
 #include "ball.hpp"
+#include "terrain.hpp"
 #include "Demo.h"
+#include "FrameScheduler.h"
 #include "Graphics.h"
 
 using namespace std;
@@ -47,6 +51,9 @@ struct Scene : public Drawable {
     vector<ilG_light> lights;
     BulletSpace::BodyID heightmap_body = BulletSpace::BodyID(0);
     ilG_heightmap heightmap;
+    TerrainRenderer terrain;
+    GBufferLayout layout = GBUFFER_IL;
+    ilG_tex colortex, heighttex, normaltex;
     BallRenderer ball;
     btSphereShape sphere_shape = btSphereShape(1);
     btStaticPlaneShape ground_shape[4] = {
@@ -58,22 +65,118 @@ struct Scene : public Drawable {
     btDefaultMotionState ground_motion_state[4], heightmap_motion_state;
     btHeightfieldTerrainShape *heightmap_shape;
 
+    // Matrices for this frame's queued items
+    vector<il_mat> frame_model, frame_imt;
+    static const uint32_t heightmap_item = ~uint32_t(0);
+
+    // IL's heightmap only knows its own G-buffer layout
+    void draw_heightmap() {
+        il_mat imt;
+        space.objmats(&imt, &heightmap_body, ILG_IMT, 1);
+        if (layout == GBUFFER_COMPACT) {
+            il_mat model;
+            space.objmats(&model, &heightmap_body, ILG_MODEL, 1);
+            terrain.draw(model, imt);
+        } else {
+            il_mat mvp;
+            space.objmats(&mvp, &heightmap_body, ILG_MVP, 1);
+            ilG_heightmap_draw(&heightmap, mvp, imt);
+        }
+    }
+
+    static il_vec3 center(const il_mat &model) {
+        return il_vec3_new(model.data[3], model.data[7], model.data[11]);
+    }
+
+    // Every ball is also a point light at its centre
+    void light_positions(vector<il_vec3> &out) {
+        vector<il_mat> model(bodies.size());
+        space.objmats(model.data(), bodies.data(), ILG_MODEL, bodies.size());
+        out.resize(bodies.size());
+        for (size_t i = 0; i < bodies.size(); i++) {
+            out[i] = center(model[i]);
+        }
+    }
+
+    // The heightmap binds IL's own state, so it gets material 0. It's the
+    // ground under everything else, so it goes first
+    void enqueue_heightmap(RenderQueue &queue) {
+        queue.push(RenderQueue::key(RenderQueue::PASS_OPAQUE, 0, 0, 0, 0), this, heightmap_item);
+    }
+
+    void enqueue(Graphics &graphics, RenderQueue &queue) override {
+        enqueue_heightmap(queue);
+
+        frame_model.resize(bodies.size());
+        frame_imt.resize(bodies.size());
+        space.objmats(frame_model.data(), bodies.data(), ILG_MODEL, bodies.size());
+        space.objmats(frame_imt.data(), bodies.data(), ILG_IMT, bodies.size());
+        for (size_t i = 0; i < bodies.size(); i++) {
+            if (!graphics.visible(center(frame_model[i]), sphere_shape.getRadius())) {
+                continue;
+            }
+            queue.push(ball.key(queue, graphics.depth(frame_model[i])), this, uint32_t(i));
+        }
+    }
+
+    void execute(Graphics &graphics, const RenderQueue::Item &item, unsigned changed) override {
+        (void)graphics;
+        if (item.index == heightmap_item) {
+            draw_heightmap();
+        } else {
+            ball.draw(frame_model[item.index], frame_imt[item.index], colors[item.index], changed);
+        }
+    }
+
+    // Only the balls; the ground is displaced or drawn by IL
+    bool occluder(const RenderQueue::Item &item, const Mesh *&mesh, il_mat &model) override {
+        if (item.index == heightmap_item) {
+            return false;
+        }
+        mesh = ball.occluder();
+        model = frame_model[item.index];
+        return true;
+    }
+
     void draw(Graphics &graphics) override {
         (void)graphics;
-        il_mat hmvp, himt;
-        space.objmats(&hmvp, &heightmap_body, ILG_MVP, 1);
-        space.objmats(&himt, &heightmap_body, ILG_IMT, 1);
-        ilG_heightmap_draw(&heightmap, hmvp, himt);
+        draw_heightmap();
 
-        vector<il_mat> mvp, imt;
-        mvp.resize(bodies.size());
+        vector<il_mat> model, imt;
+        model.resize(bodies.size());
         imt.resize(bodies.size());
-        space.objmats(mvp.data(), bodies.data(), ILG_MVP, bodies.size());
+        space.objmats(model.data(), bodies.data(), ILG_MODEL, bodies.size());
         space.objmats(imt.data(), bodies.data(), ILG_IMT, bodies.size());
-        ball.draw(mvp.data(), imt.data(), colors.data(), bodies.size());
+        ball.draw(model.data(), imt.data(), colors.data(), bodies.size());
     }
 
-    bool build(ilG_renderman *rm) {
+    // The heightmap is IL's own renderer, so only the balls are batched; it
+    // is still queued, so it gets the pre-pass and the G-buffer stats
+    bool record(Graphics &graphics, DrawBatch &batch) override {
+        vector<il_mat> model, imt;
+        model.resize(bodies.size());
+        imt.resize(bodies.size());
+        space.objmats(model.data(), bodies.data(), ILG_MODEL, bodies.size());
+        space.objmats(imt.data(), bodies.data(), ILG_IMT, bodies.size());
+        vector<il_vec3> col(colors);
+        size_t kept = 0;
+        for (size_t i = 0; i < bodies.size(); i++) {
+            if (graphics.visible(center(model[i]), sphere_shape.getRadius())) {
+                model[kept] = model[i];
+                imt[kept] = imt[i];
+                col[kept] = col[i];
+                kept++;
+            }
+        }
+        if (!ball.record(batch, model.data(), imt.data(), col.data(), kept)) {
+            return false;
+        }
+        enqueue_heightmap(graphics.queue);
+        return true;
+    }
+
+    bool build(ilG_renderman *rm, AssetLoader &loader, GBufferLayout layout) {
+        this->layout = layout;
         // Arena walls
         ///////////////
         vector<btRigidBody> ground_body;
@@ -97,57 +200,75 @@ struct Scene : public Drawable {
 
         // Image
         ///////////////////////
-        ilA_img hm;
-        ilA_imgerr res = ilA_img_loadfile(&hm, &demo_fs, "arena-heightmap.png");
-        if (res) {
-            il_error("Failed to load heightmap: %s", ilA_img_strerror(res));
-            return false;
-        }
-        // Physics
-        /////////////////////
-        const unsigned height = 50;
-        heightmap_shape = new btHeightfieldTerrainShape(hm.width, hm.height, hm.data, height/255.f, 0,
-                                                        height, 1, PHY_UCHAR, false);
-        heightmap_shape->setLocalScaling(btVector3(arenaWidth/hm.width, 1, arenaWidth/hm.height));
-        btTransform trans = btTransform(btQuaternion(0,0,0,1),
-                                        btVector3(arenaWidth/2, height/2, arenaWidth/2));
-        heightmap_motion_state = trans;
-        btRigidBody::btRigidBodyConstructionInfo groundRigidBodyCI
-            (0, &heightmap_motion_state, &*heightmap_shape, btVector3(0,0,0));
-        heightmap_body = space.add(groundRigidBodyCI);
-        space.getBody(heightmap_body).setRestitution(1.0);
-        space.setBodyScale(heightmap_body, il_vec3_new(128, 50, 128));
-        // Rendering
-        ///////////////////////
-        ilA_img norm;
-        res = ilA_img_height_to_normal(&norm, &hm);
-        if (res) {
-            il_error("Failed to create normal map: %s", ilA_img_strerror(res));
-            return false;
-        }
-        ilG_tex colortex, heighttex, normaltex;
-        res = ilG_tex_loadfile(&colortex, &demo_fs, "terrain.png");
-        if (res) {
-            il_error("Failed to load heightmap texture: %s", ilA_img_strerror(res));
-            return false;
-        }
-        ilA_img hmc;
-        res = ilA_img_copy(&hmc, &hm);
-        if (res) {
-            il_error("Failed to copy image: %s", ilA_img_strerror(res));
-            return false;
-        }
-        ilG_tex_loadimage(&heighttex, hmc);
-        ilG_tex_loadimage(&normaltex, norm);
-        char *error;
-        if (!ilG_heightmap_build(&this->heightmap, rm, hm.width, hm.height,
-                                 heighttex, normaltex, colortex, &error)) {
-            il_error("heightmap: %s", error);
-            free(error);
-            return false;
-        }
+        enum {
+            HEIGHT,
+            NORMAL,
+            HEIGHT_COPY
+        };
+        // Decoding the heightmap and deriving the normal map happens on the
+        // loader's worker threads; only the uploads run on this thread.
+        loader.texture(&colortex, "terrain.png");
+        loader.image("arena-heightmap.png", [=, &loader](AssetLoader::Images &imgs) {
+            ilA_img &hm = imgs[HEIGHT];
+            // Physics
+            /////////////////////
+            const unsigned height = 50;
+            heightmap_shape = new btHeightfieldTerrainShape(hm.width, hm.height, hm.data, height/255.f, 0,
+                                                            height, 1, PHY_UCHAR, false);
+            heightmap_shape->setLocalScaling(btVector3(arenaWidth/hm.width, 1, arenaWidth/hm.height));
+            btTransform trans = btTransform(btQuaternion(0,0,0,1),
+                                            btVector3(arenaWidth/2, height/2, arenaWidth/2));
+            heightmap_motion_state = trans;
+            btRigidBody::btRigidBodyConstructionInfo groundRigidBodyCI
+                (0, &heightmap_motion_state, &*heightmap_shape, btVector3(0,0,0));
+            heightmap_body = space.add(groundRigidBodyCI);
+            space.getBody(heightmap_body).setRestitution(1.0);
+            space.setBodyScale(heightmap_body, il_vec3_new(128, 50, 128));
+            // Rendering
+            ///////////////////////
+            ilG_tex_loadimage(&heighttex, imgs[HEIGHT_COPY]);
+            ilG_tex_loadimage(&normaltex, imgs[NORMAL]);
+            unsigned hm_width = hm.width, hm_height = hm.height;
+            // The terrain texture is a separate request, so wait for both
+            loader.after([=]() {
+                char *error;
+                if (layout == GBUFFER_COMPACT) {
+                    if (!terrain.build(rm, hm_width, hm_height, heighttex, normaltex, colortex,
+                                       &error)) {
+                        il_error("terrain: %s", error);
+                        free(error);
+                        return false;
+                    }
+                    return true;
+                }
+                if (!ilG_heightmap_build(&this->heightmap, rm, hm_width, hm_height,
+                                         heighttex, normaltex, colortex, &error)) {
+                    il_error("heightmap: %s", error);
+                    free(error);
+                    return false;
+                }
+                return true;
+            });
+            return true;
+        }, [](AssetLoader::Images &imgs) {
+            ilA_img norm, hmc;
+            ilA_imgerr res = ilA_img_height_to_normal(&norm, &imgs[HEIGHT]);
+            if (res) {
+                il_error("Failed to create normal map: %s", ilA_img_strerror(res));
+                return false;
+            }
+            res = ilA_img_copy(&hmc, &imgs[HEIGHT]);
+            if (res) {
+                il_error("Failed to copy image: %s", ilA_img_strerror(res));
+                return false;
+            }
+            imgs.push_back(norm);
+            imgs.push_back(hmc);
+            return true;
+        });
 
-        if (!ball.build(rm, &error)) {
+        char *error;
+        if (!ball.build(rm, loader, layout, &error)) {
             il_error("ball: %s", error);
             free(error);
             return false;
@@ -236,7 +357,10 @@ int main(int argc, char **argv)
     ///////////////////////////////
 
     Scene scene(world);
-    if (!scene.build(graphics.rm)) {
+    if (!scene.build(graphics.rm, graphics.loader, graphics.gbuffer)) {
+        return 1;
+    }
+    if (!graphics.loader.wait()) {
         return 1;
     }
     scene.populate(100);
@@ -244,28 +368,60 @@ int main(int argc, char **argv)
 
     float yaw = 0, pitch = 0;
     il_quat rot = il_quat_new(0,0,0,1);
+    auto look = [&](const SDL_MouseMotionEvent &motion) {
+        if (!(motion.state & SDL_BUTTON_LMASK)) {
+            return;
+        }
+        graphics.limiter.input(motion.timestamp);
+        const float s = 0.01;
+        yaw = fmodf(yaw + motion.xrel * s, M_PI * 2);
+        pitch = max((float)-M_PI/2, min((float)M_PI/2, pitch + motion.yrel * s));
+        rot = il_quat_mul
+            (il_quat_fromAxisAngle(0,1,0, -yaw),
+             il_quat_fromAxisAngle(1,0,0, -pitch));
+        ghostObject.setWorldTransform(btTransform(btQuaternion(rot.x,rot.y,rot.z,rot.w),
+                                                  ghostObject.getWorldTransform().getOrigin()));
+    };
+    graphics.camera_source = [&](il_mat &view, il_vec3 &eye) {
+        /* Late latch: mouse motion that arrived while the world stepped and
+         * the frame was set up still turns this frame's camera. Walking
+         * went through the physics step, so it has to wait a frame. */
+        SDL_PumpEvents();
+        SDL_Event motion[16];
+        int count;
+        while ((count = SDL_PeepEvents(motion, 16, SDL_GETEVENT, SDL_MOUSEMOTION,
+                                       SDL_MOUSEMOTION)) > 0) {
+            for (int i = 0; i < count; i++) {
+                look(motion[i].motion);
+            }
+        }
+        view = world.viewmat(ILG_VIEW);
+        eye = world.eye();
+    };
     State state;
+    vector<il_vec3> light_pos;
+    FrameScheduler frames(window);
+    typedef std::chrono::steady_clock clock;
+    clock::time_point last_step = clock::now();
     while (1) {
         SDL_Event ev;
-        while (SDL_PollEvent(&ev)) {
+        while (frames.poll(ev)) {
             switch (ev.type) {
             case SDL_QUIT:
                 il_log("Stopping");
                 return 0;
             case SDL_MOUSEMOTION:
-                if (ev.motion.state & SDL_BUTTON_LMASK) {
-                    const float s = 0.01;
-                    yaw = fmodf(yaw + ev.motion.xrel * s, M_PI * 2);
-                    pitch = max((float)-M_PI/2, min((float)M_PI/2, pitch + ev.motion.yrel * s));
-                    rot = il_quat_mul
-                        (il_quat_fromAxisAngle(0,1,0, -yaw),
-                         il_quat_fromAxisAngle(1,0,0, -pitch));
-                    ghostObject.setWorldTransform(btTransform(btQuaternion(rot.x,rot.y,rot.z,rot.w),
-                                                              ghostObject.getWorldTransform().getOrigin()));
-                }
+                look(ev.motion);
+                break;
+            case SDL_KEYDOWN:
+            case SDL_KEYUP:
+                graphics.limiter.input(ev.key.timestamp);
                 break;
             }
         }
+        if (!frames.draw()) {
+            continue;
+        }
         {
             const uint8_t *state = SDL_GetKeyboardState(NULL);
             il_vec3 playerwalk = il_vec3_new
@@ -279,7 +435,21 @@ int main(int argc, char **argv)
             playerwalk = il_vec3_rotate(playerwalk, rot);
             player.setWalkDirection(btVector3(playerwalk.x, playerwalk.y, playerwalk.z));
         }
-        world.step(1/60.f);
+        /* Steps by the real time since the last drawn frame, in fixed 1/60 s
+         * ticks, so a throttled unfocused window keeps real time. The clamp
+         * pauses the world while minimised instead of catching up after */
+        const clock::time_point now = clock::now();
+        const float elapsed = std::chrono::duration<float>(now - last_step).count();
+        last_step = now;
+        const float max_step = .25f;
+        world.step(min(elapsed, max_step), int(max_step * 60) + 1);
+        if (graphics.gbuffer == GBUFFER_COMPACT) {
+            // IL's lighting wants floatspace ids, which the balls don't have
+            scene.light_positions(light_pos);
+            state.point_positions = light_pos.data();
+            state.point_lights = scene.lights.data();
+            state.point_count = scene.lights.size();
+        }
         graphics.draw(state);
     }
 }
@@ -8,21 +8,39 @@ extern "C" {
 
 using namespace BouncingLights;
 
+void BulletSpace::update_camera()
+{
+    const btTransform &current = ghost.getWorldTransform();
+    if (camera_valid && current == camera) {
+        return;
+    }
+    camera = current;
+    camera_valid = true;
+    btQuaternion rot = camera.getRotation();
+    camera_r = il_mat_rotate(il_quat_new(rot.x(),rot.y(),rot.z(),rot.w()));
+    btVector3 pos = camera.getOrigin();
+    il_vec4 v = il_vec4_new(pos.x(),pos.y(),pos.z(), 1.0);
+    v.x = -v.x;
+    v.y = -v.y;
+    v.z = -v.z;
+    camera_t = il_mat_translate(v);
+}
+
+il_vec3 BulletSpace::eye()
+{
+    btVector3 pos = ghost.getWorldTransform().getOrigin();
+    return il_vec3_new(pos.x(), pos.y(), pos.z());
+}
+
 il_mat BulletSpace::viewmat(int type)
 {
+    update_camera();
     il_mat m = type & ILG_PROJECTION? projection : il_mat_identity();
-    btTransform camera = ghost.getWorldTransform();
-    btQuaternion rot = camera.getRotation();
     if (type & ILG_VIEW_R) {
-        m = il_mat_mul(m, il_mat_rotate(il_quat_new(rot.x(),rot.y(),rot.z(),rot.w())));
+        m = il_mat_mul(m, camera_r);
     }
-    btVector3 pos = camera.getOrigin();
     if (type & ILG_VIEW_T) {
-        il_vec4 v = il_vec4_new(pos.x(),pos.y(),pos.z(), 1.0);
-        v.x = -v.x;
-        v.y = -v.y;
-        v.z = -v.z;
-        m = il_mat_mul(m, il_mat_translate(v));
+        m = il_mat_mul(m, camera_t);
     }
     if (type & ILG_INVERSE) {
         m = il_mat_invert(m);
@@ -43,20 +61,14 @@ void BulletSpace::objmats(il_mat *out, BodyID *in, int type, size_t count)
     mattype(ILG_PROJECTION) {
         out[i] = proj;
     }
-    btTransform camera = ghost.getWorldTransform();
-    btQuaternion rot = camera.getRotation();
-    il_mat viewr = il_mat_rotate(il_quat_new(rot.x(),rot.y(),rot.z(),rot.w()));
+    if (type & (ILG_VIEW_R | ILG_VIEW_T)) {
+        update_camera();
+    }
     mattype(ILG_VIEW_R) {
-        out[i] = il_mat_mul(out[i], viewr);
+        out[i] = il_mat_mul(out[i], camera_r);
     }
-    btVector3 pos = camera.getOrigin();
-    il_vec4 viewt_v = il_vec4_new(pos.x(),pos.y(),pos.z(), 1.0);
-    viewt_v.x = -viewt_v.x;
-    viewt_v.y = -viewt_v.y;
-    viewt_v.z = -viewt_v.z;
-    il_mat viewt = il_mat_translate(viewt_v);
     mattype(ILG_VIEW_T) {
-        out[i] = il_mat_mul(out[i], viewt);
+        out[i] = il_mat_mul(out[i], camera_t);
     }
     mattype(ILG_MODEL_T) {
         il_mat modelt = il_mat_translate(il_vec3_to_vec4(this->pos(in[i].value()), 1.0));
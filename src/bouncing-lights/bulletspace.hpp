@@ -23,6 +23,12 @@ struct BulletSpace {
 
     il_vec3 pos(unsigned id);
     il_quat rot(unsigned id);
+    // Recomputes the cached camera matrices if the ghost has moved
+    void update_camera();
+
+    btTransform camera;
+    il_mat camera_r, camera_t;
+    bool camera_valid = false;
 
 public:
     class BodyID {
@@ -45,6 +51,7 @@ public:
     void del(BodyID id);
     int step(float by, int maxsubs = 1, float fixed = 1/60.f);
     il_mat viewmat(int type);
+    il_vec3 eye();
     void objmats(il_mat *out, BodyID *in, int type, size_t count);
     btRigidBody &getBody(BodyID id) {
         return bodies[id.value()];
@@ -3,6 +3,8 @@
 #include <btBulletDynamicsCommon.h>
 #include <LinearMath/btIDebugDraw.h>
 
+#include "GLState.h"
+
 using namespace std;
 using namespace BouncingLights;
 
@@ -21,13 +23,13 @@ enum {
 void DebugDraw::draw(il_mat vp)
 {
     ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
-    glDisable(GL_BLEND);
-    glDisable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
-    ilG_material_bind(mat);
+    demo_gl.enable(GL_BLEND, false);
+    demo_gl.enable(GL_CULL_FACE, false);
+    demo_gl.enable(GL_DEPTH_TEST, true);
+    demo_gl.material(mat);
     ilG_material_bindMatrix(mat, vp_loc, vp);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    demo_gl.bind_vao(vao);
+    demo_gl.bind_buffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, lines.size() * sizeof(Vertex), lines.data(), GL_DYNAMIC_DRAW);
     glDrawArrays(GL_LINES, 0, lines.size());
 }
@@ -0,0 +1,96 @@
+#include "terrain.hpp"
+
+#include <cstring>
+
+#include "Camera.h"
+#include "Deferred.h"
+#include "GLState.h"
+#include "UniformRing.h"
+
+extern "C" {
+#include "graphics/material.h"
+#include "graphics/mesh.h"
+}
+
+using namespace BouncingLights;
+
+enum {
+    TEX_HEIGHT,
+    TEX_NORMAL,
+    TEX_COLOR
+};
+
+void TerrainRenderer::free()
+{
+    if (built) {
+        ilG_renderman_delMaterial(rm, mat);
+        mesh.free();
+    }
+    built = false;
+}
+
+bool TerrainRenderer::build(ilG_renderman *rm, unsigned width, unsigned depth,
+                            ilG_tex height, ilG_tex normal, ilG_tex color, char **error)
+{
+    this->rm = rm;
+    this->height = height;
+    this->normal = normal;
+    this->color = color;
+
+    ilG_material m;
+    ilG_material_init(&m);
+    ilG_material_name(&m, "Terrain Material");
+    ilG_material_arrayAttrib(&m, ILG_MESH_POS, "in_Position");
+    ilG_material_arrayAttrib(&m, ILG_MESH_TEX, "in_Texcoord");
+    ilG_material_textureUnit(&m, TEX_HEIGHT, "tex_Height");
+    ilG_material_textureUnit(&m, TEX_NORMAL, "tex_Normal");
+    ilG_material_textureUnit(&m, TEX_COLOR, "tex_Color");
+    Deferred::outputs(m);
+    if (!ilG_renderman_addMaterialFromFile(rm, m, "terrain_compact.vert",
+                                           "terrain_compact.frag", &mat, error)) {
+        return false;
+    }
+    ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
+    CameraBuffer::attach(mat);
+    UniformRing::attach(mat);
+
+    MeshData data;
+    data.vertices.resize(size_t(width) * depth);
+    for (unsigned z = 0; z < depth; z++) {
+        for (unsigned x = 0; x < width; x++) {
+            MeshVertex &v = data.vertices[size_t(z) * width + x];
+            memset(&v, 0, sizeof(v));
+            v.tex[0] = x / float(width - 1);
+            v.tex[1] = z / float(depth - 1);
+            v.pos[0] = v.tex[0] - 0.5f;
+            v.pos[2] = v.tex[1] - 0.5f;
+            v.norm[1] = 1.f;
+        }
+    }
+    data.indices.reserve(size_t(width - 1) * (depth - 1) * 6);
+    for (unsigned z = 0; z + 1 < depth; z++) {
+        for (unsigned x = 0; x + 1 < width; x++) {
+            uint32_t a = z * width + x, b = a + 1, c = a + width, d = c + 1;
+            const uint32_t quad[6] = {a, c, b, b, c, d};
+            data.indices.insert(data.indices.end(), quad, quad + 6);
+        }
+    }
+    mesh.upload(data);
+    built = true;
+    return true;
+}
+
+void TerrainRenderer::draw(il_mat model, il_mat imt)
+{
+    demo_gl.material(ilG_renderman_findMaterial(rm, mat));
+    demo_gl.texture(TEX_HEIGHT, &height);
+    demo_gl.texture(TEX_NORMAL, &normal);
+    demo_gl.texture(TEX_COLOR, &color);
+    ObjectBlock block;
+    memset(&block, 0, sizeof(block));
+    block.model = model;
+    block.imt = imt;
+    demo_uniforms.bind(DEMO_OBJECT_BINDING, demo_uniforms.push(&block, sizeof(block)));
+    mesh.bind();
+    mesh.draw();
+}
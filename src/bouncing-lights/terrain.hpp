@@ -0,0 +1,35 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "tgl/tgl.h"
+#include "Mesh.h"
+
+extern "C" {
+#include "graphics/renderer.h"
+#include "graphics/tex.h"
+#include "math/matrix.h"
+}
+
+namespace BouncingLights {
+
+/* Heightmap drawn into the compact G-buffer, which IL's ilG_heightmap can't
+ * write. A grid over [-0.5, 0.5] in x and z is displaced by the height
+ * texture in the vertex shader, like IL's, so the same model matrix fits
+ * the physics shape. */
+class TerrainRenderer {
+    ilG_renderman *rm = nullptr;
+    ilG_matid mat;
+    Mesh mesh;
+    ilG_tex height, normal, color;
+    bool built = false;
+
+public:
+    void free();
+    bool build(ilG_renderman *rm, unsigned width, unsigned depth,
+               ilG_tex height, ilG_tex normal, ilG_tex color, char **error);
+    void draw(il_mat model, il_mat imt);
+};
+
+}
+
+#endif
@@ -4,10 +4,14 @@
 #include <chrono>
 
 #include "Demo.h"
+#include "FrameScheduler.h"
+#include "Mesh.h"
+#include "MeshOpt.h"
 
 extern "C" {
 #include "graphics/floatspace.h"
 #include "graphics/material.h"
+#include "graphics/mesh.h"
 #include "graphics/renderer.h"
 #include "graphics/transform.h"
 #include "math/matrix.h"
@@ -71,7 +75,7 @@ int main(int argc, char **argv)
     Window window = createWindow("Box");
     ilG_renderman rm[1];
     ilG_matid mat;
-    GLuint vbo, vao;
+    Mesh mesh;
     GLuint pos_loc;
     GLuint mvp_loc;
 
@@ -81,7 +85,7 @@ int main(int argc, char **argv)
     ilG_material m;
     ilG_material_init(&m);
     ilG_material_name(&m, "Box Shader");
-    ilG_material_arrayAttrib(&m, 0, "in_Position");
+    ilG_material_arrayAttrib(&m, ILG_MESH_POS, "in_Position");
     ilG_material_fragData(&m, ILG_GBUFFER_ALBEDO, "out_Color");
     if (!ilG_renderman_addMaterialFromFile(rm, m, "box.vert", "box.frag", &mat, &error)) {
         il_error("Box Shader: %s", error);
@@ -92,13 +96,18 @@ int main(int argc, char **argv)
     pos_loc = ilG_material_getLoc(mptr, "in_Position");
     mvp_loc = ilG_material_getLoc(mptr, "mvp");
 
-    glGenBuffers(1, &vbo);
-    glGenVertexArrays(1, &vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBindVertexArray(vao);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+    // Only positions differ, so the 36 corners collapse to 8 vertices
+    MeshVertex soup[36];
+    memset(soup, 0, sizeof(soup));
+    for (unsigned i = 0; i < 36; i++) {
+        memcpy(soup[i].pos, &cube[i * 3], sizeof(soup[i].pos));
+    }
+    MeshData data;
+    generate_indices(soup, 36, data);
+    MeshOptStats stats = optimize_mesh(data);
+    il_log("Box mesh: %zu vertices, ACMR %.3f -> %.3f",
+           data.vertices.size(), stats.acmr_before, stats.acmr_after);
+    mesh.upload(data);
 
     ilG_floatspace fs;
     ilG_floatspace_init(&fs, 1);
@@ -109,26 +118,28 @@ int main(int argc, char **argv)
     il_pos boxp = il_pos_new(&fs);
 
     ilG_material_bind(mptr);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    mesh.bind();
     glEnable(GL_DEPTH_TEST);
 
     typedef chrono::steady_clock clock;
     typedef chrono::duration<double> duration;
 
+    FrameScheduler frames(window);
     clock::time_point start = clock::now();
     while (1) {
         SDL_Event ev;
-        while (SDL_PollEvent(&ev)) {
+        while (frames.poll(ev)) {
             switch (ev.type) {
             case SDL_QUIT:
                 il_log("Stopping");
                 ilG_renderman_delMaterial(rm, mat);
-                glDeleteBuffers(1, &vao);
-                glDeleteBuffers(1, &vbo);
+                mesh.free();
                 return 0;
             }
         }
+        if (!frames.draw()) {
+            continue;
+        }
 
         duration delta = clock::now() - start;
         il_vec3 v;
@@ -146,7 +157,7 @@ int main(int argc, char **argv)
         unsigned id = boxp.id;
         ilG_floatspace_objmats(&fs, &mvp, &id, ILG_MVP, 1);
         ilG_material_bindMatrix(mptr, mvp_loc, mvp);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        mesh.draw();
 
         window.swap();
     }
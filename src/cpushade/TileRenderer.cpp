@@ -0,0 +1,103 @@
+#include "TileRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Tiles [begin, end) left to a thread
+struct Run {
+    mutex lock;
+    unsigned begin = 0, end = 0;
+};
+
+// Converts as the GL does storing to a UNORM8 target; NaNs end up black
+uint8_t unorm8(float f)
+{
+    f = f > 0? (f < 1? f : 1) : 0;
+    return uint8_t(f * 255 + .5f);
+}
+
+}
+
+void TileRenderer::render(CpuShadeRow shade_row, const CpuUniforms &uniforms, unsigned width,
+                          unsigned height, uint8_t *rgba)
+{
+    const unsigned across = (width + tile - 1) / tile, down = (height + tile - 1) / tile;
+    const unsigned count = across * down;
+    const unsigned workers = max(1u, min(threads, count));
+    unique_ptr<Run[]> runs(new Run[workers]);
+    for (unsigned i = 0; i < workers; i++) {
+        runs[i].begin = unsigned(uint64_t(count) * i / workers);
+        runs[i].end = unsigned(uint64_t(count) * (i + 1) / workers);
+    }
+    atomic<unsigned long> steals(0);
+
+    auto shade = [&](unsigned index, float *row) {
+        const unsigned x0 = index % across * tile, y0 = index / across * tile;
+        const unsigned x1 = min(x0 + tile, width), y1 = min(y0 + tile, height);
+        for (unsigned y = y0; y < y1; y++) {
+            shade_row(uniforms, height - 1 - y, x0, x1, row);
+            uint8_t *out = rgba + (size_t(y) * width + x0) * 4;
+            for (unsigned i = 0; i < (x1 - x0) * 4; i++) {
+                out[i] = unorm8(row[i]);
+            }
+        }
+    };
+    auto take = [](Run &run, unsigned &index) {
+        lock_guard<mutex> guard(run.lock);
+        if (run.begin == run.end) {
+            return false;
+        }
+        index = run.begin++;
+        return true;
+    };
+    auto steal = [&](unsigned self) {
+        for (unsigned i = 1; i < workers; i++) {
+            Run &victim = runs[(self + i) % workers];
+            unsigned begin, end;
+            {
+                lock_guard<mutex> guard(victim.lock);
+                if (victim.begin == victim.end) {
+                    continue;
+                }
+                end = victim.end;
+                begin = victim.begin + (victim.end - victim.begin) / 2;
+                victim.end = begin;
+            }
+            // Nothing else gives this thread work, so its run is still empty
+            lock_guard<mutex> guard(runs[self].lock);
+            runs[self].begin = begin;
+            runs[self].end = end;
+            steals++;
+            return true;
+        }
+        return false;
+    };
+    auto work = [&](unsigned self) {
+        vector<float> row(size_t(tile) * 4);
+        unsigned index;
+        do {
+            while (take(runs[self], index)) {
+                shade(index, row.data());
+            }
+        } while (steal(self));
+    };
+
+    vector<thread> pool;
+    for (unsigned i = 1; i < workers; i++) {
+        pool.emplace_back(work, i);
+    }
+    work(0);
+    for (thread &t : pool) {
+        t.join();
+    }
+    stats.tiles += count;
+    stats.steals += steals;
+}
@@ -0,0 +1,30 @@
+#ifndef DEMO_TILERENDERER_H
+#define DEMO_TILERENDERER_H
+
+#include <stdint.h>
+
+#include "cpushade.h"
+
+/* Shades an image on every core. The image is cut into square tiles, and
+ * each thread starts with a contiguous run of them, so it walks neighbouring
+ * pixels. A thread whose run is empty steals the far half of another's
+ * remaining run, which keeps all of them busy when some tiles (the ones a
+ * raymarcher spends more steps on, say) cost far more than others. */
+class TileRenderer {
+public:
+    struct Stats {
+        unsigned long tiles = 0, steals = 0;
+    };
+
+    TileRenderer(unsigned threads, unsigned tile)
+        : threads(threads), tile(tile) {}
+
+    // Shades into width * height RGBA bytes, top row first, as PNGs store them
+    void render(CpuShadeRow shade_row, const CpuUniforms &uniforms, unsigned width,
+                unsigned height, uint8_t *rgba);
+
+    const unsigned threads, tile;
+    Stats stats;
+};
+
+#endif
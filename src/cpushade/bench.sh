@@ -0,0 +1,27 @@
+#!/bin/sh
+# Times every shadertoy on cpushade against the GL path on Mesa's software
+# rasterizer, and checks the two agree. Run from the top of the tree after
+# building; shadertoy still opens a (hidden) window, so batch nodes need Xvfb.
+# The CPU timings assume the shaders were vectorized with libmvec, which GCC
+# does by itself and clang with -fveclib=libmvec; see the README.
+#
+#     src/cpushade/bench.sh [WxH] [time]
+
+size=${1:-1280x720}
+time=${2:-1}
+out=${TMPDIR:-/tmp}/cpushade-bench
+mkdir -p "$out" || exit 1
+status=0
+
+for name in $(./cpushade --list); do
+    echo "== $name"
+    echo "GL (Mesa):"
+    LIBGL_ALWAYS_SOFTWARE=1 ./shadertoy -f="$name" --size="$size" --fps=60 --duration=1 \
+        -o="$out/$name.y4m"
+    LIBGL_ALWAYS_SOFTWARE=1 ./shadertoy -f="$name" --size="$size" --time="$time" \
+        -o="$out/$name.png" || { status=1; continue; }
+    echo "CPU:"
+    ./cpushade -f="$name" --size="$size" --time="$time" --frames=60 \
+        --compare="$out/$name.png" || status=1
+done
+exit $status
@@ -0,0 +1,240 @@
+#include "cpushade.h"
+
+#include <chrono>
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PngStream.h"
+#include "TileRenderer.h"
+
+extern "C" {
+#include "util/log.h"
+#include "util/opt.h"
+}
+
+using namespace std;
+
+enum ArgType {
+    NO_ARG,
+    REQUIRED,
+    OPTIONAL
+};
+
+const struct {
+    ArgType arg;
+    char s;
+    const char *l, *h;
+} help[] = {
+    {NO_ARG,    'h', "help",    "Prints this message and exits"},
+    {NO_ARG,    'l', "list",    "Lists the shaders built in"},
+    {REQUIRED,  'f', "shader",  "Shader to render, by file name"},
+    {REQUIRED,  'o', "output",  "Writes the image to a PNG"},
+    {REQUIRED,    0, "size",    "Resolution as WxH (1280x720)"},
+    {REQUIRED,    0, "time",    "Value of iGlobalTime, in seconds (0)"},
+    {REQUIRED,    0, "threads", "Threads to shade on (one per core)"},
+    {REQUIRED,    0, "tile",    "Tile size in pixels (32)"},
+    {REQUIRED,    0, "frames",  "Times to render the image, for benchmarking (1)"},
+    {REQUIRED,    0, "compare", "Compares the image against a PNG from shadertoy -o"},
+    {REQUIRED,    0, "tolerance", "Largest difference per channel that counts as a match, of 255 (4)"},
+    {REQUIRED,    0, "outliers", "Percentage of pixels allowed outside the tolerance (0.5)"},
+    {NO_ARG,      0, NULL,      NULL}
+};
+
+vector<CpuShader> &cpu_shaders()
+{
+    static vector<CpuShader> shaders;
+    return shaders;
+}
+
+static bool read_png(const char *path, unsigned width, unsigned height, vector<uint8_t> &rgba,
+                     string &error)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&image, path)) {
+        error = string(path) + ": " + image.message;
+        return false;
+    }
+    if (image.width != width || image.height != height) {
+        error = string(path) + ": " + to_string(image.width) + "x" + to_string(image.height)
+            + ", expected " + to_string(width) + "x" + to_string(height);
+        png_image_free(&image);
+        return false;
+    }
+    image.format = PNG_FORMAT_RGBA;
+    rgba.resize(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, NULL, rgba.data(), 0, NULL)) {
+        error = string(path) + ": " + image.message;
+        return false;
+    }
+    return true;
+}
+
+static bool write_png(const char *path, unsigned width, unsigned height,
+                      const vector<uint8_t> &rgba, string &error)
+{
+    PngStream png;
+    if (!png.open(path, width, height, 6, error)) {
+        return false;
+    }
+    for (unsigned y = 0; y < height; y++) {
+        if (!png.row(&rgba[size_t(y) * width * 4], error)) {
+            return false;
+        }
+    }
+    return png.close(error);
+}
+
+int main(int argc, char **argv)
+{
+    string name, output, compare;
+    unsigned width = 1280, height = 720;
+    unsigned threads = max(1u, thread::hardware_concurrency()), tile = 32, frames = 1;
+    unsigned tolerance = 4;
+    float time = 0, outliers = .5f;
+
+    size_t i;
+    il_opts opts = il_opt_parse(argc, argv);
+    il_modopts *main_opts = il_opts_lookup(&opts, const_cast<char*>(""));
+    for (i = 0; main_opts && i < main_opts->args.length; i++) {
+        il_opt *opt = &main_opts->args.data[i];
+        string arg(opt->arg.str, opt->arg.len);
+#define option(s, l) if (il_string_cmp(opt->name, il_string_new(const_cast<char*>(s))) || \
+                         il_string_cmp(opt->name, il_string_new(const_cast<char*>(l))))
+        option("h", "help") {
+            printf("Usage: %s [OPTIONS]\n\n", argv[0]);
+            printf("Renders a shadertoy on the CPU, from C++ that glsl2cpp translated it to.\n\n");
+            printf("Options:\n");
+            for (i = 0; help[i].l; i++) {
+                static const char *const arg_strs[] = {
+                    "",
+                    "[=arg]",
+                    "=arg"
+                };
+                char longbuf[64];
+                sprintf(longbuf, "%s%s%s",
+                        help[i].l? "-" : " ",
+                        help[i].l? help[i].l : "",
+                        arg_strs[help[i].arg]
+                );
+                printf(" %c%c %-18s %s\n",
+                       help[i].s? '-' : ' ',
+                       help[i].s? help[i].s : ' ',
+                       longbuf,
+                       help[i].h
+                );
+            }
+            return 0;
+        }
+        option("l", "list") {
+            for (const CpuShader &shader : cpu_shaders()) {
+                printf("%s\n", shader.name);
+            }
+            return 0;
+        }
+        option("f", "shader") {
+            name = arg;
+        }
+        option("o", "output") {
+            output = arg;
+        }
+        option("", "size") {
+            if (sscanf(arg.c_str(), "%ux%u", &width, &height) != 2 || !width || !height) {
+                il_error("Expected WxH, got %s", arg.c_str());
+                return 1;
+            }
+        }
+        option("", "time") {
+            time = float(atof(arg.c_str()));
+        }
+        option("", "threads") {
+            threads = unsigned(strtoul(arg.c_str(), NULL, 10));
+        }
+        option("", "tile") {
+            tile = unsigned(strtoul(arg.c_str(), NULL, 10));
+        }
+        option("", "frames") {
+            frames = unsigned(strtoul(arg.c_str(), NULL, 10));
+        }
+        option("", "compare") {
+            compare = arg;
+        }
+        option("", "tolerance") {
+            tolerance = unsigned(strtoul(arg.c_str(), NULL, 10));
+        }
+        option("", "outliers") {
+            outliers = float(atof(arg.c_str()));
+        }
+    }
+    if (!threads || !tile || !frames) {
+        il_error("--threads, --tile and --frames take positive numbers");
+        return 1;
+    }
+
+    const CpuShader *shader = nullptr;
+    for (const CpuShader &s : cpu_shaders()) {
+        if (name == s.name) {
+            shader = &s;
+        }
+    }
+    if (!shader) {
+        fprintf(stderr, "Pass one of the shaders --list shows with -f\n");
+        return 1;
+    }
+
+    typedef chrono::steady_clock clock;
+    typedef chrono::duration<double> duration;
+    TileRenderer renderer(threads, tile);
+    CpuUniforms uniforms = {{float(width), float(height), 1}, time, {0, 0, 0, 0}};
+    vector<uint8_t> image(size_t(width) * height * 4);
+    clock::time_point start = clock::now();
+    for (unsigned frame = 0; frame < frames; frame++) {
+        renderer.render(shader->shade_row, uniforms, width, height, image.data());
+    }
+    const double seconds = duration(clock::now() - start).count();
+    il_log("%s: %u frames at %ux%u, %.2f ms/frame, %.1f Mpixels/s, %u threads, %lu of %lu "
+           "tiles stolen", shader->name, frames, width, height, seconds * 1000 / frames,
+           double(width) * height * frames / seconds / 1e6, renderer.threads,
+           renderer.stats.steals, renderer.stats.tiles);
+
+    string error;
+    if (!output.empty() && !write_png(output.c_str(), width, height, image, error)) {
+        il_error("%s", error.c_str());
+        return 1;
+    }
+    if (compare.empty()) {
+        return 0;
+    }
+    vector<uint8_t> reference;
+    if (!read_png(compare.c_str(), width, height, reference, error)) {
+        il_error("%s", error.c_str());
+        return 1;
+    }
+    // Alpha isn't compared, PNGs from shadertoy don't keep it
+    unsigned worst = 0;
+    unsigned long over = 0;
+    double total = 0;
+    for (size_t px = 0; px < image.size(); px += 4) {
+        unsigned most = 0;
+        for (unsigned c = 0; c < 3; c++) {
+            const unsigned diff = unsigned(abs(int(image[px + c]) - int(reference[px + c])));
+            most = max(most, diff);
+            total += diff;
+        }
+        worst = max(worst, most);
+        over += most > tolerance;
+    }
+    const double pixels = double(width) * height;
+    const double share = over * 100 / pixels;
+    const bool match = share <= outliers;
+    il_log("%s against %s: mean difference %.3f, largest %u, %.3f%% of pixels over %u: %s",
+           shader->name, compare.c_str(), total / (pixels * 3), worst, share, tolerance,
+           match? "match" : "MISMATCH");
+    return match? 0 : 1;
+}
@@ -0,0 +1,33 @@
+#ifndef DEMO_CPUSHADE_H
+#define DEMO_CPUSHADE_H
+
+#include <vector>
+
+// What the shaders read, in the layout glsl.h's set() loads from
+struct CpuUniforms {
+    float resolution[3];
+    float time;
+    float mouse[4];
+};
+
+/* Shades pixels x0 to x1 - 1 of row y, counted from the bottom as
+ * gl_FragCoord is, into x1 - x0 RGBA floats. glsl2cpp generates one per
+ * shader. */
+typedef void (*CpuShadeRow)(const CpuUniforms &uniforms, unsigned y, unsigned x0, unsigned x1,
+                            float *rgba);
+
+struct CpuShader {
+    const char *name;
+    CpuShadeRow shade_row;
+};
+
+// Every translated shader linked in, by file name
+std::vector<CpuShader> &cpu_shaders();
+
+struct CpuShaderRegistrar {
+    CpuShaderRegistrar(const char *name, CpuShadeRow shade_row) {
+        cpu_shaders().push_back({name, shade_row});
+    }
+};
+
+#endif
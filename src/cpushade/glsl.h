@@ -0,0 +1,556 @@
+#ifndef DEMO_GLSL_H
+#define DEMO_GLSL_H
+
+#include <math.h>
+#include <type_traits>
+
+/* Just enough of GLSL's types and built-in functions for the C++ that
+ * glsl2cpp makes of a shadertoy to compile unchanged. Everything is scalar and
+ * inline: cpushade shades a row of pixels in a loop the compiler vectorizes,
+ * one pixel per SIMD lane, so nothing here may call out of line or branch on
+ * data other than through ?: on scalars, which becomes a blend.
+ *
+ * Swizzles are member templates, v.swz<0, 1>() for v.xy; they return const
+ * copies so that assigning to one, which isn't supported, fails to compile
+ * instead of writing to a temporary. */
+namespace glsl {
+
+struct vec2;
+struct vec3;
+struct vec4;
+
+#define GLSL_SWIZZLE_DECLS \
+    template <int A, int B> const vec2 swz() const; \
+    template <int A, int B, int C> const vec3 swz() const; \
+    template <int A, int B, int C, int D> const vec4 swz() const;
+
+struct vec2 {
+    float x = 0, y = 0;
+
+    vec2() {}
+    explicit vec2(float s)
+        : x(s), y(s) {}
+    vec2(float x, float y)
+        : x(x), y(y) {}
+    explicit vec2(const vec3 &v);
+    explicit vec2(const vec4 &v);
+
+    float operator[](int i) const {
+        return i == 0? x : y;
+    }
+    float &operator[](int i) {
+        return i == 0? x : y;
+    }
+    GLSL_SWIZZLE_DECLS
+};
+
+struct vec3 {
+    float x = 0, y = 0, z = 0;
+
+    vec3() {}
+    explicit vec3(float s)
+        : x(s), y(s), z(s) {}
+    vec3(float x, float y, float z)
+        : x(x), y(y), z(z) {}
+    vec3(const vec2 &v, float z)
+        : x(v.x), y(v.y), z(z) {}
+    vec3(float x, const vec2 &v)
+        : x(x), y(v.x), z(v.y) {}
+    explicit vec3(const vec4 &v);
+
+    float operator[](int i) const {
+        return i == 0? x : i == 1? y : z;
+    }
+    float &operator[](int i) {
+        return i == 0? x : i == 1? y : z;
+    }
+    GLSL_SWIZZLE_DECLS
+};
+
+struct vec4 {
+    float x = 0, y = 0, z = 0, w = 0;
+
+    vec4() {}
+    explicit vec4(float s)
+        : x(s), y(s), z(s), w(s) {}
+    vec4(float x, float y, float z, float w)
+        : x(x), y(y), z(z), w(w) {}
+    vec4(const vec3 &v, float w)
+        : x(v.x), y(v.y), z(v.z), w(w) {}
+    vec4(float x, const vec3 &v)
+        : x(x), y(v.x), z(v.y), w(v.z) {}
+    vec4(const vec2 &v, float z, float w)
+        : x(v.x), y(v.y), z(z), w(w) {}
+    vec4(const vec2 &a, const vec2 &b)
+        : x(a.x), y(a.y), z(b.x), w(b.y) {}
+
+    float operator[](int i) const {
+        return i == 0? x : i == 1? y : i == 2? z : w;
+    }
+    float &operator[](int i) {
+        return i == 0? x : i == 1? y : i == 2? z : w;
+    }
+    GLSL_SWIZZLE_DECLS
+};
+
+#undef GLSL_SWIZZLE_DECLS
+
+inline vec2::vec2(const vec3 &v)
+    : x(v.x), y(v.y) {}
+inline vec2::vec2(const vec4 &v)
+    : x(v.x), y(v.y) {}
+inline vec3::vec3(const vec4 &v)
+    : x(v.x), y(v.y), z(v.z) {}
+
+#define GLSL_SWIZZLES(V, N) \
+    template <int A, int B> inline const vec2 V::swz() const { \
+        static_assert(A < N && B < N, "swizzle out of range"); \
+        return vec2((*this)[A], (*this)[B]); \
+    } \
+    template <int A, int B, int C> inline const vec3 V::swz() const { \
+        static_assert(A < N && B < N && C < N, "swizzle out of range"); \
+        return vec3((*this)[A], (*this)[B], (*this)[C]); \
+    } \
+    template <int A, int B, int C, int D> inline const vec4 V::swz() const { \
+        static_assert(A < N && B < N && C < N && D < N, "swizzle out of range"); \
+        return vec4((*this)[A], (*this)[B], (*this)[C], (*this)[D]); \
+    }
+GLSL_SWIZZLES(vec2, 2)
+GLSL_SWIZZLES(vec3, 3)
+GLSL_SWIZZLES(vec4, 4)
+#undef GLSL_SWIZZLES
+
+template <typename T> struct is_vec : std::false_type {};
+template <> struct is_vec<vec2> : std::true_type {};
+template <> struct is_vec<vec3> : std::true_type {};
+template <> struct is_vec<vec4> : std::true_type {};
+
+// V for the vector types only, so scalars fall through to the float overloads
+template <typename V>
+using if_vec = typename std::enable_if<is_vec<V>::value, V>::type;
+
+template <typename F> inline vec2 map(const vec2 &a, F f)
+{
+    return vec2(f(a.x), f(a.y));
+}
+template <typename F> inline vec3 map(const vec3 &a, F f)
+{
+    return vec3(f(a.x), f(a.y), f(a.z));
+}
+template <typename F> inline vec4 map(const vec4 &a, F f)
+{
+    return vec4(f(a.x), f(a.y), f(a.z), f(a.w));
+}
+template <typename F> inline vec2 map(const vec2 &a, const vec2 &b, F f)
+{
+    return vec2(f(a.x, b.x), f(a.y, b.y));
+}
+template <typename F> inline vec3 map(const vec3 &a, const vec3 &b, F f)
+{
+    return vec3(f(a.x, b.x), f(a.y, b.y), f(a.z, b.z));
+}
+template <typename F> inline vec4 map(const vec4 &a, const vec4 &b, F f)
+{
+    return vec4(f(a.x, b.x), f(a.y, b.y), f(a.z, b.z), f(a.w, b.w));
+}
+template <typename F> inline vec2 map(const vec2 &a, const vec2 &b, const vec2 &c, F f)
+{
+    return vec2(f(a.x, b.x, c.x), f(a.y, b.y, c.y));
+}
+template <typename F> inline vec3 map(const vec3 &a, const vec3 &b, const vec3 &c, F f)
+{
+    return vec3(f(a.x, b.x, c.x), f(a.y, b.y, c.y), f(a.z, b.z, c.z));
+}
+template <typename F> inline vec4 map(const vec4 &a, const vec4 &b, const vec4 &c, F f)
+{
+    return vec4(f(a.x, b.x, c.x), f(a.y, b.y, c.y), f(a.z, b.z, c.z), f(a.w, b.w, c.w));
+}
+
+#define GLSL_OPERATOR(op) \
+    template <typename V> inline if_vec<V> operator op(const V &a, const V &b) { \
+        return map(a, b, [](float a, float b) { return a op b; }); \
+    } \
+    template <typename V> inline if_vec<V> operator op(const V &a, float b) { \
+        return map(a, [b](float a) { return a op b; }); \
+    } \
+    template <typename V> inline if_vec<V> operator op(float a, const V &b) { \
+        return map(b, [a](float b) { return a op b; }); \
+    } \
+    template <typename V> inline if_vec<V> &operator op##=(V &a, const V &b) { \
+        return a = a op b; \
+    } \
+    template <typename V> inline if_vec<V> &operator op##=(V &a, float b) { \
+        return a = a op b; \
+    }
+GLSL_OPERATOR(+)
+GLSL_OPERATOR(-)
+GLSL_OPERATOR(*)
+GLSL_OPERATOR(/)
+#undef GLSL_OPERATOR
+
+template <typename V> inline if_vec<V> operator-(const V &a)
+{
+    return map(a, [](float a) { return -a; });
+}
+
+/* Column major, as in GLSL: m[i] is column i and the scalar constructors
+ * take the columns one after the other. */
+struct mat2 {
+    vec2 c[2];
+
+    mat2()
+        : mat2(1) {}
+    explicit mat2(float d)
+        : c{vec2(d, 0), vec2(0, d)} {}
+    mat2(float a, float b, float d, float e)
+        : c{vec2(a, b), vec2(d, e)} {}
+    mat2(const vec2 &a, const vec2 &b)
+        : c{a, b} {}
+
+    const vec2 &operator[](int i) const {
+        return c[i];
+    }
+    vec2 &operator[](int i) {
+        return c[i];
+    }
+};
+
+struct mat3 {
+    vec3 c[3];
+
+    mat3()
+        : mat3(1) {}
+    explicit mat3(float d)
+        : c{vec3(d, 0, 0), vec3(0, d, 0), vec3(0, 0, d)} {}
+    mat3(float a, float b, float d, float e, float f, float g, float h, float i, float j)
+        : c{vec3(a, b, d), vec3(e, f, g), vec3(h, i, j)} {}
+    mat3(const vec3 &a, const vec3 &b, const vec3 &d)
+        : c{a, b, d} {}
+
+    const vec3 &operator[](int i) const {
+        return c[i];
+    }
+    vec3 &operator[](int i) {
+        return c[i];
+    }
+};
+
+struct mat4 {
+    vec4 c[4];
+
+    mat4()
+        : mat4(1) {}
+    explicit mat4(float d)
+        : c{vec4(d, 0, 0, 0), vec4(0, d, 0, 0), vec4(0, 0, d, 0), vec4(0, 0, 0, d)} {}
+    mat4(float a, float b, float d, float e, float f, float g, float h, float i,
+         float j, float k, float l, float m, float n, float o, float p, float q)
+        : c{vec4(a, b, d, e), vec4(f, g, h, i), vec4(j, k, l, m), vec4(n, o, p, q)} {}
+    mat4(const vec4 &a, const vec4 &b, const vec4 &d, const vec4 &e)
+        : c{a, b, d, e} {}
+
+    const vec4 &operator[](int i) const {
+        return c[i];
+    }
+    vec4 &operator[](int i) {
+        return c[i];
+    }
+};
+
+template <typename T> struct mat_traits {
+    enum { n = 0 };
+};
+template <> struct mat_traits<mat2> {
+    typedef vec2 col;
+    enum { n = 2 };
+};
+template <> struct mat_traits<mat3> {
+    typedef vec3 col;
+    enum { n = 3 };
+};
+template <> struct mat_traits<mat4> {
+    typedef vec4 col;
+    enum { n = 4 };
+};
+
+template <typename M> using col_of = typename mat_traits<M>::col;
+
+template <typename M> inline col_of<M> operator*(const M &m, const col_of<M> &v)
+{
+    col_of<M> r = m[0] * v[0];
+    for (int i = 1; i < mat_traits<M>::n; i++) {
+        r += m[i] * v[i];
+    }
+    return r;
+}
+
+template <typename M> inline col_of<M> operator*(const col_of<M> &v, const M &m)
+{
+    col_of<M> r;
+    for (int i = 0; i < mat_traits<M>::n; i++) {
+        r[i] = dot(v, m[i]);
+    }
+    return r;
+}
+
+template <typename M> inline typename std::enable_if<mat_traits<M>::n != 0, M>::type
+operator*(const M &a, const M &b)
+{
+    M r;
+    for (int i = 0; i < mat_traits<M>::n; i++) {
+        r[i] = a * b[i];
+    }
+    return r;
+}
+
+template <typename M> inline typename std::enable_if<mat_traits<M>::n != 0, M>::type
+operator*(const M &a, float s)
+{
+    M r;
+    for (int i = 0; i < mat_traits<M>::n; i++) {
+        r[i] = a[i] * s;
+    }
+    return r;
+}
+
+template <typename M> inline typename std::enable_if<mat_traits<M>::n != 0, M>::type
+operator+(const M &a, const M &b)
+{
+    M r;
+    for (int i = 0; i < mat_traits<M>::n; i++) {
+        r[i] = a[i] + b[i];
+    }
+    return r;
+}
+
+template <typename M> inline typename std::enable_if<mat_traits<M>::n != 0, M &>::type
+operator*=(M &a, const M &b)
+{
+    return a = a * b;
+}
+
+/* floorf() only has a vector form from SSE4.1 on, truncating through int
+ * has one everywhere. Floats from 2^23 up are integers already; they're
+ * clamped first so the conversion stays defined. */
+inline float floor(float x)
+{
+    const float big = 8388608.f;
+    const float c = x < -big? -big : x > big? big : x;
+    const float t = float(int(c));
+    return ::fabsf(x) < big? (t > c? t - 1 : t) : x;
+}
+
+template <typename V> inline if_vec<V> floor(const V &v)
+{
+    return map(v, [](float x) { return floor(x); });
+}
+
+// Component-wise functions of one argument
+#define GLSL_FUNC1(name, expr) \
+    inline float name(float x) { \
+        return expr; \
+    } \
+    template <typename V> inline if_vec<V> name(const V &v) { \
+        return map(v, [](float x) { return name(x); }); \
+    }
+GLSL_FUNC1(radians, x * 0.017453292519943295f)
+GLSL_FUNC1(degrees, x * 57.29577951308232f)
+GLSL_FUNC1(sin, ::sinf(x))
+GLSL_FUNC1(cos, ::cosf(x))
+GLSL_FUNC1(tan, ::tanf(x))
+GLSL_FUNC1(asin, ::asinf(x))
+GLSL_FUNC1(acos, ::acosf(x))
+GLSL_FUNC1(exp, ::expf(x))
+GLSL_FUNC1(log, ::logf(x))
+GLSL_FUNC1(exp2, ::exp2f(x))
+GLSL_FUNC1(log2, ::log2f(x))
+GLSL_FUNC1(sqrt, ::sqrtf(x))
+GLSL_FUNC1(inversesqrt, 1 / ::sqrtf(x))
+GLSL_FUNC1(abs, ::fabsf(x))
+GLSL_FUNC1(sign, x > 0? 1.f : x < 0? -1.f : 0.f)
+GLSL_FUNC1(ceil, -floor(-x))
+GLSL_FUNC1(fract, x - floor(x))
+#undef GLSL_FUNC1
+
+/* Component-wise functions of two arguments; GLSL also allows a scalar for
+ * the second one of some, and for the first one of step() */
+#define GLSL_FUNC2(name, expr) \
+    inline float name(float x, float y) { \
+        return expr; \
+    } \
+    template <typename V> inline if_vec<V> name(const V &a, const V &b) { \
+        return map(a, b, [](float x, float y) { return name(x, y); }); \
+    }
+#define GLSL_FUNC2_SCALAR(name) \
+    template <typename V> inline if_vec<V> name(const V &a, float y) { \
+        return map(a, [y](float x) { return name(x, y); }); \
+    }
+GLSL_FUNC2(atan, ::atan2f(x, y))
+GLSL_FUNC2(pow, ::powf(x, y))
+GLSL_FUNC2(mod, x - y * floor(x / y))
+GLSL_FUNC2_SCALAR(mod)
+GLSL_FUNC2(min, y < x? y : x)
+GLSL_FUNC2_SCALAR(min)
+GLSL_FUNC2(max, x < y? y : x)
+GLSL_FUNC2_SCALAR(max)
+GLSL_FUNC2(step, y < x? 0.f : 1.f)
+#undef GLSL_FUNC2
+#undef GLSL_FUNC2_SCALAR
+
+inline float atan(float y_over_x)
+{
+    return ::atanf(y_over_x);
+}
+
+template <typename V> inline if_vec<V> atan(const V &v)
+{
+    return map(v, [](float x) { return atan(x); });
+}
+
+template <typename V> inline if_vec<V> step(float edge, const V &v)
+{
+    return map(v, [edge](float x) { return step(edge, x); });
+}
+
+inline float clamp(float x, float lo, float hi)
+{
+    return min(max(x, lo), hi);
+}
+
+template <typename V> inline if_vec<V> clamp(const V &v, const V &lo, const V &hi)
+{
+    return min(max(v, lo), hi);
+}
+
+template <typename V> inline if_vec<V> clamp(const V &v, float lo, float hi)
+{
+    return min(max(v, lo), hi);
+}
+
+inline float mix(float a, float b, float t)
+{
+    return a + (b - a) * t;
+}
+
+template <typename V> inline if_vec<V> mix(const V &a, const V &b, const V &t)
+{
+    return a + (b - a) * t;
+}
+
+template <typename V> inline if_vec<V> mix(const V &a, const V &b, float t)
+{
+    return a + (b - a) * t;
+}
+
+inline float smoothstep(float lo, float hi, float x)
+{
+    float t = clamp((x - lo) / (hi - lo), 0.f, 1.f);
+    return t * t * (3 - 2 * t);
+}
+
+template <typename V> inline if_vec<V> smoothstep(const V &lo, const V &hi, const V &v)
+{
+    return map(lo, hi, v, [](float lo, float hi, float x) { return smoothstep(lo, hi, x); });
+}
+
+template <typename V> inline if_vec<V> smoothstep(float lo, float hi, const V &v)
+{
+    return map(v, [lo, hi](float x) { return smoothstep(lo, hi, x); });
+}
+
+inline float dot(float a, float b)
+{
+    return a * b;
+}
+
+inline float dot(const vec2 &a, const vec2 &b)
+{
+    return a.x * b.x + a.y * b.y;
+}
+
+inline float dot(const vec3 &a, const vec3 &b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline float dot(const vec4 &a, const vec4 &b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+inline float length(float x)
+{
+    return abs(x);
+}
+
+template <typename V> inline typename std::enable_if<is_vec<V>::value, float>::type
+length(const V &v)
+{
+    return ::sqrtf(dot(v, v));
+}
+
+template <typename V> inline typename std::enable_if<is_vec<V>::value, float>::type
+distance(const V &a, const V &b)
+{
+    return length(a - b);
+}
+
+inline float distance(float a, float b)
+{
+    return abs(a - b);
+}
+
+template <typename V> inline if_vec<V> normalize(const V &v)
+{
+    return v * inversesqrt(dot(v, v));
+}
+
+inline vec3 cross(const vec3 &a, const vec3 &b)
+{
+    return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+template <typename V> inline if_vec<V> reflect(const V &i, const V &n)
+{
+    return i - 2 * dot(n, i) * n;
+}
+
+// Loading uniforms from the renderer's floats, and storing the output as RGBA
+inline void set(float &u, const float *v)
+{
+    u = v[0];
+}
+
+inline void set(vec2 &u, const float *v)
+{
+    u = vec2(v[0], v[1]);
+}
+
+inline void set(vec3 &u, const float *v)
+{
+    u = vec3(v[0], v[1], v[2]);
+}
+
+inline void set(vec4 &u, const float *v)
+{
+    u = vec4(v[0], v[1], v[2], v[3]);
+}
+
+inline void store(const vec3 &c, float *rgba)
+{
+    rgba[0] = c.x;
+    rgba[1] = c.y;
+    rgba[2] = c.z;
+    rgba[3] = 1;
+}
+
+inline void store(const vec4 &c, float *rgba)
+{
+    rgba[0] = c.x;
+    rgba[1] = c.y;
+    rgba[2] = c.z;
+    rgba[3] = c.w;
+}
+
+}
+
+#endif
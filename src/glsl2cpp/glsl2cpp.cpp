@@ -0,0 +1,469 @@
+/* Translates a shadertoy's fragment shader into C++ for cpushade.
+ *
+ * GLSL's expression syntax is C++'s, and src/cpushade/glsl.h provides its
+ * types and built-in functions, so most of the source is copied through
+ * untouched. The shader becomes a struct: its globals, uniforms and output
+ * are members, its functions member functions, and main() is called once per
+ * pixel. What has to change is done token by token:
+ *
+ * - #version, precision and layout() are dropped, as are precision
+ *   qualifiers;
+ * - uniform and out lose their qualifier, and are recorded so the generated
+ *   row function can load the uniforms and store the output;
+ * - out and inout parameters become references, in parameters plain ones;
+ * - swizzles become member templates, v.zyx to v.swz<2, 1, 0>(), unless
+ *   the name is a field of one of the shader's structs;
+ * - prototypes are dropped, since members can be used before they're defined;
+ * - identifiers that are C++ keywords get a trailing underscore.
+ *
+ * Line breaks are kept and a #line directive points the C++ compiler's errors
+ * back at the shader. Textures, inputs other than gl_FragCoord, and writing to
+ * swizzles aren't supported. */
+#include <ctype.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Token {
+    enum Kind {
+        SPACE,
+        COMMENT,
+        PREPROC,
+        IDENT,
+        NUMBER,
+        PUNCT,
+    } kind;
+    string text;
+    unsigned line;
+};
+
+struct Variable {
+    string type, name;
+};
+
+bool is_ident(char c)
+{
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+vector<Token> tokenize(const string &src)
+{
+    vector<Token> tokens;
+    unsigned line = 1;
+    bool line_start = true;
+    size_t i = 0;
+    while (i < src.size()) {
+        const size_t start = i;
+        const unsigned start_line = line;
+        Token::Kind kind;
+        char c = src[i];
+        if (isspace(static_cast<unsigned char>(c))) {
+            while (i < src.size() && isspace(static_cast<unsigned char>(src[i]))) {
+                if (src[i] == '\n') {
+                    line++;
+                    line_start = true;
+                }
+                i++;
+            }
+            tokens.push_back({Token::SPACE, src.substr(start, i - start), start_line});
+            continue;
+        }
+        if (c == '#' && line_start) {
+            // Up to the newline, following backslash continuations
+            while (i < src.size() && src[i] != '\n') {
+                if (src[i] == '\\' && i + 1 < src.size() && src[i + 1] == '\n') {
+                    line++;
+                    i++;
+                }
+                i++;
+            }
+            kind = Token::PREPROC;
+        } else if (src.compare(i, 2, "//") == 0) {
+            while (i < src.size() && src[i] != '\n') {
+                i++;
+            }
+            kind = Token::COMMENT;
+        } else if (src.compare(i, 2, "/*") == 0) {
+            size_t end = src.find("*/", i + 2);
+            end = end == string::npos? src.size() : end + 2;
+            for (; i < end; i++) {
+                line += src[i] == '\n';
+            }
+            kind = Token::COMMENT;
+        } else if (isdigit(static_cast<unsigned char>(c))
+                   || (c == '.' && i + 1 < src.size()
+                       && isdigit(static_cast<unsigned char>(src[i + 1])))) {
+            while (i < src.size() && (is_ident(src[i]) || src[i] == '.'
+                                      || ((src[i] == '+' || src[i] == '-')
+                                          && (src[i - 1] == 'e' || src[i - 1] == 'E')))) {
+                i++;
+            }
+            kind = Token::NUMBER;
+        } else if (is_ident(c)) {
+            while (i < src.size() && is_ident(src[i])) {
+                i++;
+            }
+            kind = Token::IDENT;
+        } else {
+            i++;
+            kind = Token::PUNCT;
+        }
+        line_start = false;
+        tokens.push_back({kind, src.substr(start, i - start), start_line});
+    }
+    return tokens;
+}
+
+// Component indices of a swizzle, or an empty string if name isn't one
+string swizzle(const string &name)
+{
+    static const char *const sets[] = {"xyzw", "rgba", "stpq"};
+    if (name.empty() || name.size() > 4) {
+        return string();
+    }
+    for (const char *set : sets) {
+        string indices;
+        for (char c : name) {
+            const char *at = strchr(set, c);
+            if (!at) {
+                indices.clear();
+                break;
+            }
+            indices += char('0' + (at - set));
+        }
+        if (!indices.empty()) {
+            return indices;
+        }
+    }
+    return string();
+}
+
+const set<string> &cpp_keywords()
+{
+    static const set<string> words = {
+        "auto", "catch", "char", "class", "delete", "double", "enum", "explicit", "extern",
+        "friend", "goto", "inline", "long", "mutable", "namespace", "new", "operator",
+        "private", "protected", "public", "register", "short", "signed", "sizeof", "static",
+        "template", "this", "throw", "try", "typedef", "typename", "union", "unsigned",
+        "using", "virtual", "volatile", "and", "or", "not", "xor", "glsl", "Shader",
+    };
+    return words;
+}
+
+class Translator {
+public:
+    Translator(const string &path, const vector<Token> &tokens)
+        : path(path), tokens(tokens) {}
+
+    bool run();
+    string output(const string &name) const;
+
+private:
+    // Index of the next token after i that isn't space or a comment
+    size_t next(size_t i) const;
+    bool fail(const Token &at, const string &message);
+    void warn(const Token &at, const string &message);
+    // Ends a top level statement, dropping it if it was a prototype
+    void end_statement(bool semicolon);
+
+    string path;
+    const vector<Token> &tokens;
+    string body;
+    vector<Variable> uniforms;
+    Variable out;
+    set<string> fields;
+    bool frag_color = false, has_main = false, has_main_image = false;
+
+    size_t statement = 0;
+    bool statement_paren = false, statement_assign = false;
+};
+
+size_t Translator::next(size_t i) const
+{
+    for (i++; i < tokens.size(); i++) {
+        if (tokens[i].kind != Token::SPACE && tokens[i].kind != Token::COMMENT) {
+            break;
+        }
+    }
+    return i;
+}
+
+bool Translator::fail(const Token &at, const string &message)
+{
+    cerr << path << ":" << at.line << ": error: " << message << endl;
+    return false;
+}
+
+void Translator::warn(const Token &at, const string &message)
+{
+    cerr << path << ":" << at.line << ": warning: " << message << endl;
+}
+
+void Translator::end_statement(bool semicolon)
+{
+    if (semicolon && statement_paren && !statement_assign) {
+        // Keeps the line breaks, so the #line numbers still hold
+        string kept;
+        for (size_t i = statement; i < body.size(); i++) {
+            if (body[i] == '\n') {
+                kept += '\n';
+            }
+        }
+        body.replace(statement, string::npos, kept);
+    }
+    statement = body.size();
+    statement_paren = statement_assign = false;
+}
+
+bool Translator::run()
+{
+    int braces = 0, parens = 0;
+    bool reference = false;
+    // Brace depth of the struct being defined, if any
+    int in_struct = -1;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const Token &tok = tokens[i];
+        const bool top = braces == 0 && parens == 0;
+        if (tok.kind == Token::PREPROC) {
+            istringstream words(tok.text.substr(1));
+            string directive;
+            words >> directive;
+            if (directive != "version" && directive != "extension") {
+                body += tok.text;
+            }
+            continue;
+        }
+        if (tok.kind != Token::IDENT) {
+            if (tok.kind == Token::PUNCT) {
+                const char c = tok.text[0];
+                braces += c == '{';
+                braces -= c == '}';
+                if (c == '}' && braces == in_struct) {
+                    in_struct = -1;
+                }
+                parens += c == '(';
+                parens -= c == ')';
+                if (braces == 0 && parens == 1 && c == '(') {
+                    statement_paren = true;
+                }
+                if (top && c == '=') {
+                    statement_assign = true;
+                }
+                if (c == '.' && next(i) == i + 1 && tokens[i + 1].kind == Token::IDENT
+                    && !fields.count(tokens[i + 1].text)) {
+                    const string indices = swizzle(tokens[i + 1].text);
+                    if (indices.size() == 1) {
+                        body += string(".") + "xyzw"[indices[0] - '0'];
+                        i++;
+                        continue;
+                    } else if (!indices.empty()) {
+                        body += ".swz<";
+                        for (size_t j = 0; j < indices.size(); j++) {
+                            body += (j? ", " : "") + string(1, indices[j]);
+                        }
+                        body += ">()";
+                        i++;
+                        continue;
+                    }
+                }
+            }
+            body += tok.text;
+            if (tok.kind == Token::PUNCT && braces == 0 && parens == 0
+                && (tok.text == ";" || tok.text == "}")) {
+                end_statement(tok.text == ";");
+            }
+            continue;
+        }
+
+        const string &word = tok.text;
+        if (word == "highp" || word == "mediump" || word == "lowp") {
+            continue;
+        }
+        if (top && (word == "precision" || word == "layout")) {
+            // Skips up to the ; or past the parenthesised list
+            const char *end = word == "precision"? ";" : ")";
+            while (i < tokens.size() && tokens[i].text != end) {
+                i++;
+            }
+            continue;
+        }
+        if (top && (word == "uniform" || word == "out")) {
+            const size_t type = next(i), name = next(type);
+            if (name >= tokens.size() || tokens[name].kind != Token::IDENT) {
+                return fail(tok, "expected a type and name after " + word);
+            }
+            const Variable var = {tokens[type].text, tokens[name].text};
+            if (var.type.compare(0, 7, "sampler") == 0) {
+                return fail(tok, var.name + ": textures aren't supported");
+            }
+            if (word == "out") {
+                if (!out.name.empty()) {
+                    return fail(tok, "only one output is supported");
+                }
+                out = var;
+            } else {
+                uniforms.push_back(var);
+            }
+            continue;
+        }
+        if (top && (word == "in" || word == "varying" || word == "attribute")) {
+            return fail(tok, "inputs other than gl_FragCoord aren't supported");
+        }
+        if (braces == 0 && parens > 0) {
+            if (word == "in") {
+                continue;
+            }
+            if (word == "out" || word == "inout") {
+                reference = true;
+                continue;
+            }
+            if (reference && word != "const") {
+                body += word + " &";
+                reference = false;
+                continue;
+            }
+        }
+        if (top && (word == "main" || word == "mainImage") && next(i) < tokens.size()
+            && tokens[next(i)].text == "(") {
+            (word == "main"? has_main : has_main_image) = true;
+        }
+        if (top && word == "struct") {
+            in_struct = 0;
+        }
+        if (in_struct >= 0 && braces > in_struct && next(i) < tokens.size()
+            && (tokens[next(i)].text == ";" || tokens[next(i)].text == ",")) {
+            fields.insert(word);
+        }
+        if (word == "gl_FragColor") {
+            frag_color = true;
+        }
+        body += cpp_keywords().count(word)? word + "_" : word;
+    }
+    if (braces != 0 || parens != 0) {
+        return fail(tokens.back(), "unbalanced braces or parentheses");
+    }
+    if (!has_main && !has_main_image) {
+        return fail(tokens.back(), "no main() or mainImage()");
+    }
+    if (has_main && out.name.empty() && !frag_color) {
+        return fail(tokens.back(), "main() writes neither an out variable nor gl_FragColor");
+    }
+    for (const Variable &var : uniforms) {
+        if (var.name != "iResolution" && var.name != "iGlobalTime" && var.name != "iTime"
+            && var.name != "iMouse") {
+            warn(tokens.front(), var.name + " isn't supported and stays zero");
+        }
+    }
+    return true;
+}
+
+string Translator::output(const string &name) const
+{
+    ostringstream out;
+    out << "// Generated by glsl2cpp from " << path << "; edit that instead\n"
+        << "#include \"cpushade.h\"\n"
+        << "#include \"glsl.h\"\n"
+        << "\n"
+        << "namespace glsl {\n"
+        << "namespace {\n"
+        << "\n"
+        << "struct Shader {\n"
+        << "    vec4 gl_FragCoord;\n";
+    if (frag_color) {
+        out << "    vec4 gl_FragColor;\n";
+    }
+    out << "#line 1 \"" << path << "\"\n"
+        << body << "\n";
+    // Numbers the line after the directive, past the lines so far and itself
+    unsigned lines = 2;
+    for (char c : out.str()) {
+        lines += c == '\n';
+    }
+    out << "#line " << lines << " \"" << name << "\"\n"
+        << "};\n"
+        << "\n"
+        << "void shade_row(const CpuUniforms &uniforms, unsigned y, unsigned x0, unsigned x1,\n"
+        << "               float *rgba)\n"
+        << "{\n";
+    // Uniforms are loaded once: read in the loop, they might alias rgba, and
+    // that stops it from vectorizing
+    out << "    Shader base;\n";
+    for (const Variable &var : uniforms) {
+        if (var.name == "iResolution") {
+            out << "    set(base.iResolution, uniforms.resolution);\n";
+        } else if (var.name == "iGlobalTime" || var.name == "iTime") {
+            out << "    set(base." << var.name << ", &uniforms.time);\n";
+        } else if (var.name == "iMouse") {
+            out << "    set(base.iMouse, uniforms.mouse);\n";
+        }
+    }
+    out << "    for (unsigned x = x0; x < x1; x++, rgba += 4) {\n"
+        << "        Shader s = base;\n"
+        << "        s.gl_FragCoord = vec4(x + .5f, y + .5f, 0, 1);\n";
+    if (has_main) {
+        const string color = this->out.name.empty()? "gl_FragColor" : this->out.name;
+        out << "        s.main();\n"
+            << "        store(s." << color << ", rgba);\n";
+    } else {
+        out << "        vec4 color;\n"
+            << "        s.mainImage(color, vec2(s.gl_FragCoord));\n"
+            << "        store(color, rgba);\n";
+    }
+    out << "    }\n"
+        << "}\n"
+        << "\n"
+        << "}\n"
+        << "}\n";
+    return out.str();
+}
+
+string basename(const string &path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    return slash == string::npos? path : path.substr(slash + 1);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " shader.frag out.cpp" << endl;
+        return 2;
+    }
+    const string in_path = argv[1], out_path = argv[2];
+    ifstream in(in_path, ios::binary);
+    if (!in) {
+        cerr << in_path << ": failed to open" << endl;
+        return 1;
+    }
+    ostringstream source;
+    source << in.rdbuf();
+    const vector<Token> tokens = tokenize(source.str());
+    if (tokens.empty()) {
+        cerr << in_path << ": empty" << endl;
+        return 1;
+    }
+
+    Translator translator(in_path, tokens);
+    if (!translator.run()) {
+        return 1;
+    }
+    string text = translator.output(out_path);
+    text += "\nstatic const CpuShaderRegistrar registrar(\"" + basename(in_path)
+        + "\", glsl::shade_row);\n";
+    ofstream out(out_path, ios::binary);
+    if (!(out << text)) {
+        cerr << out_path << ": failed to write" << endl;
+        return 1;
+    }
+    return 0;
+}
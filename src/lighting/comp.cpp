@@ -1,8 +1,14 @@
 #include "comp.h"
 
+#include <cstring>
+
+#include "GLState.h"
+#include "MeshOpt.h"
+
 extern "C" {
 #include "graphics/floatspace.h"
 #include "graphics/material.h"
+#include "graphics/mesh.h"
 #include "graphics/renderer.h"
 #include "graphics/transform.h"
 #include "graphics/tex.h"
@@ -147,12 +153,6 @@ static const float cube_t[] = {
     0.0, 0.0,
 };
 
-enum {
-    ATTRIB_POSITION,
-    ATTRIB_NORMAL,
-    ATTRIB_TEXCOORD,
-};
-
 enum {
     TEX_ALBEDO,
     TEX_NORMAL,
@@ -161,78 +161,144 @@ enum {
     TEX_EMISSION,
 };
 
-void Computer::draw(il_mat mvp, il_mat imt)
+void Computer::bind_textures()
+{
+    demo_gl.texture(TEX_ALBEDO, &tex_albedo);
+    demo_gl.texture(TEX_NORMAL, &tex_normal);
+    demo_gl.texture(TEX_REFRACTION, &tex_refraction);
+    demo_gl.texture(TEX_EMISSION, &tex_emission);
+}
+
+il_mat Computer::stretch(il_mat model)
+{
+    // imt is left unstretched, as the normals always were
+    return il_mat_mul(model, il_mat_scale(il_vec4_new(1, 4, 1, 1)));
+}
+
+void Computer::draw(il_mat model, il_mat imt, unsigned changed)
 {
     ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
 
-    ilG_tex_bind(&tex_albedo, TEX_ALBEDO);
-    ilG_tex_bind(&tex_normal, TEX_NORMAL);
-    ilG_tex_bind(&tex_refraction, TEX_REFRACTION);
-    ilG_tex_bind(&tex_emission, TEX_EMISSION);
+    if (changed & RenderQueue::CHANGED_TEXTURES) {
+        bind_textures();
+    }
+    if (changed & RenderQueue::CHANGED_MATERIAL) {
+        demo_gl.material(mat);
+    }
+    if (changed & RenderQueue::CHANGED_MESH) {
+        mesh.bind();
+    }
+    ObjectBlock block;
+    memset(&block, 0, sizeof(block));
+    block.model = stretch(model);
+    block.imt = imt;
+    demo_uniforms.bind(DEMO_OBJECT_BINDING, demo_uniforms.push(&block, sizeof(block)));
+    mesh.draw();
+}
+
+uint64_t Computer::key(RenderQueue &queue, uint32_t depth)
+{
+    return RenderQueue::key(RenderQueue::PASS_OPAQUE, queue.id(&mat), queue.id(&tex_albedo),
+                            queue.id(&mesh), depth);
+}
+
+bool Computer::record(DrawBatch &batch, il_mat model, il_mat imt)
+{
+    if (!batched) {
+        return false;
+    }
+    if (group < 0) {
+        group = int(batch.group([this]() {
+            bind_textures();
+            demo_gl.material(ilG_renderman_findMaterial(rm, batch_mat));
+        }));
+    }
+    DrawBatch::DrawData data;
+    memset(&data, 0, sizeof(data));
+    data.model = stretch(model);
+    data.imt = imt;
+    batch.add(unsigned(group), mesh, data);
+    return true;
+}
 
-    ilG_material_bind(mat);
-    tgl_vao_bind(&vao);
-    ilG_material_bindMatrix(mat, mvp_loc, mvp);
-    ilG_material_bindMatrix(mat, imt_loc, imt);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+const Mesh *Computer::occluder(il_mat model, il_mat &out) const
+{
+    out = stretch(model);
+    return &mesh;
 }
 
 void Computer::free()
 {
     ilG_renderman_delMaterial(rm, mat);
-    tgl_vao_free(&vao);
-    glDeleteBuffers(1, &v_vbo);
-    glDeleteBuffers(1, &n_vbo);
-    glDeleteBuffers(1, &t_vbo);
+    if (batched) {
+        ilG_renderman_delMaterial(rm, batch_mat);
+    }
+    mesh.free();
     ilG_tex_free(&tex_albedo);
     ilG_tex_free(&tex_normal);
     ilG_tex_free(&tex_refraction);
     ilG_tex_free(&tex_emission);
 }
 
-bool Computer::build(ilG_renderman *rm, char **error)
+bool Computer::build(ilG_renderman *rm, AssetLoader &loader, GBufferLayout layout, char **error)
 {
     this->rm = rm;
 
+    auto setup = [layout](ilG_material &m, const char *name) {
+        ilG_material_init(&m);
+        ilG_material_name(&m, name);
+        ilG_material_arrayAttrib(&m, ILG_MESH_POS,        "in_Position");
+        ilG_material_arrayAttrib(&m, ILG_MESH_NORM,       "in_Normal");
+        ilG_material_arrayAttrib(&m, ILG_MESH_TEX,        "in_Texcoord");
+        ilG_material_textureUnit(&m, TEX_ALBEDO,          "tex_Albedo");
+        ilG_material_textureUnit(&m, TEX_NORMAL,          "tex_Normal");
+        ilG_material_textureUnit(&m, TEX_REFRACTION,      "tex_Reflect");
+        ilG_material_textureUnit(&m, TEX_EMISSION,        "tex_Emission");
+        if (layout == GBUFFER_COMPACT) {
+            Deferred::outputs(m);
+            return;
+        }
+        ilG_material_fragData(&m, ILG_GBUFFER_ALBEDO,     "out_Albedo");
+        ilG_material_fragData(&m, ILG_GBUFFER_NORMAL,     "out_Normal");
+        ilG_material_fragData(&m, ILG_GBUFFER_REFRACTION, "out_Refraction");
+        ilG_material_fragData(&m, ILG_GBUFFER_GLOSS,      "out_Gloss");
+        ilG_material_fragData(&m, ILG_GBUFFER_EMISSION,   "out_Emission");
+    };
+    const char *frag = layout == GBUFFER_COMPACT? "comp_compact.frag" : "comp.frag";
     ilG_material m;
-    ilG_material_init(&m);
-    ilG_material_name(&m, "Computer Shader");
-    ilG_material_arrayAttrib(&m, ATTRIB_POSITION,     "in_Position");
-    ilG_material_arrayAttrib(&m, ATTRIB_NORMAL,       "in_Normal");
-    ilG_material_arrayAttrib(&m, ATTRIB_TEXCOORD,     "in_Texcoord");
-    ilG_material_fragData(&m, ILG_GBUFFER_ALBEDO,     "out_Albedo");
-    ilG_material_fragData(&m, ILG_GBUFFER_NORMAL,     "out_Normal");
-    ilG_material_fragData(&m, ILG_GBUFFER_REFRACTION, "out_Refraction");
-    ilG_material_fragData(&m, ILG_GBUFFER_GLOSS,      "out_Gloss");
-    ilG_material_fragData(&m, ILG_GBUFFER_EMISSION,   "out_Emission");
-    ilG_material_textureUnit(&m, TEX_ALBEDO,          "tex_Albedo");
-    ilG_material_textureUnit(&m, TEX_NORMAL,          "tex_Normal");
-    ilG_material_textureUnit(&m, TEX_REFRACTION,      "tex_Reflect");
-    ilG_material_textureUnit(&m, TEX_EMISSION,        "tex_Emission");
-    if (!ilG_renderman_addMaterialFromFile(rm, m, "comp.vert", "comp.frag", &mat, error)) {
+    setup(m, "Computer Shader");
+    if (!ilG_renderman_addMaterialFromFile(rm, m, "comp.vert", frag, &mat, error)) {
         return false;
     }
     ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
-    mvp_loc = ilG_material_getLoc(mat, "mvp");
-    imt_loc = ilG_material_getLoc(mat, "imt");
+    CameraBuffer::attach(mat);
+    UniformRing::attach(mat);
 
-    tgl_vao_init(&vao);
-    tgl_vao_bind(&vao);
-    glGenBuffers(1, &v_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, v_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
-    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(ATTRIB_POSITION);
-    glGenBuffers(1, &n_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, n_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_n), cube_n, GL_STATIC_DRAW);
-    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(ATTRIB_NORMAL);
-    glGenBuffers(1, &t_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, t_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_t), cube_t, GL_STATIC_DRAW);
-    glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+    if (DrawBatch::supported()) {
+        setup(m, "Computer Shader (batched)");
+        ilG_material_arrayAttrib(&m, DEMO_DRAW_ID_ATTRIB,   "in_DrawID");
+        ilG_material_textureUnit(&m, DEMO_DRAW_DATA_UNIT,   "draws");
+        if (!ilG_renderman_addMaterialFromFile(rm, m, "comp_batch.vert", frag,
+                                               &batch_mat, error)) {
+            return false;
+        }
+        CameraBuffer::attach(ilG_renderman_findMaterial(rm, batch_mat));
+        batched = true;
+    }
+
+    // Interleave the separate attribute arrays and index them
+    MeshVertex soup[36];
+    for (unsigned i = 0; i < 36; i++) {
+        memcpy(soup[i].pos, &cube[i * 3], sizeof(soup[i].pos));
+        memcpy(soup[i].tex, &cube_t[i * 2], sizeof(soup[i].tex));
+        memcpy(soup[i].norm, &cube_n[i * 3], sizeof(soup[i].norm));
+    }
+    MeshData data;
+    generate_indices(soup, 36, data);
+    MeshOptStats stats = optimize_mesh(data);
+    il_log("Computer mesh: %zu vertices, ACMR %.3f -> %.3f",
+           data.vertices.size(), stats.acmr_before, stats.acmr_after);
+    mesh.upload(data);
 
     ilG_tex *texes[4] = {
         &tex_albedo,
@@ -247,12 +313,7 @@ bool Computer::build(ilG_renderman *rm, char **error)
         "comp1a_g.png"
     };
     for (unsigned i = 0; i < 4; i++) {
-        ilA_imgerr err;
-        extern ilA_fs demo_fs;
-        if ((err = ilG_tex_loadfile(texes[i], &demo_fs, files[i]))) {
-            il_error("%s", ilA_img_strerror(err));
-            return false;
-        }
+        loader.texture(texes[i], files[i]);
     }
 
     return true;
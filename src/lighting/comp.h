@@ -1,22 +1,40 @@
 #ifndef DEMO_COMP_H
 #define DEMO_COMP_H
 
+#include "AssetLoader.h"
+#include "Camera.h"
+#include "Deferred.h"
+#include "DrawBatch.h"
+#include "RenderQueue.h"
+#include "Mesh.h"
+#include "UniformRing.h"
+
 extern "C" {
 #include "graphics/renderer.h"
 }
 
 class Computer {
     ilG_renderman *rm;
-    ilG_matid mat;
-    tgl_vao vao;
-    GLuint v_vbo, n_vbo, t_vbo;
-    GLuint mvp_loc, imt_loc;
+    ilG_matid mat, batch_mat;
+    bool batched = false;
+    int group = -1;
+    Mesh mesh;
     ilG_tex tex_albedo, tex_normal, tex_refraction, tex_emission;
 
+    void bind_textures();
+    // The mesh is a unit cube, stretched to the computer's height
+    static il_mat stretch(il_mat model);
+
 public:
     void free();
-    bool build(ilG_renderman *rm, char **error);
-    void draw(il_mat mvp, il_mat imt);
+    bool build(ilG_renderman *rm, AssetLoader &loader, GBufferLayout layout, char **error);
+    void draw(il_mat model, il_mat imt, unsigned changed = RenderQueue::CHANGED_ALL);
+    // Render queue key for one computer
+    uint64_t key(RenderQueue &queue, uint32_t depth);
+    // False when the GL 4.3 batched material isn't available
+    bool record(DrawBatch &batch, il_mat model, il_mat imt);
+    // Mesh and model matrix draw() uses, for the depth pre-pass
+    const Mesh *occluder(il_mat model, il_mat &out) const;
 };
 
 
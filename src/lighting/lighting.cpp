@@ -3,6 +3,7 @@
 #include <math.h>
 #include <chrono>
 
+#include "FrameScheduler.h"
 #include "Graphics.h"
 #include "comp.h"
 
@@ -20,15 +21,36 @@ public:
     ComputerRenderer(unsigned object, Computer &comp)
         : object(object), comp(comp) {}
 
+    void enqueue(Graphics &graphics, RenderQueue &queue) override {
+        model = graphics.objmats(&object, ILG_MODEL, 1).front();
+        imt = graphics.objmats(&object, ILG_IMT, 1).front();
+        queue.push(comp.key(queue, graphics.depth(model)), this);
+    }
+    void execute(Graphics &graphics, const RenderQueue::Item &item, unsigned changed) override {
+        (void)graphics;
+        (void)item;
+        comp.draw(model, imt, changed);
+    }
+    bool occluder(const RenderQueue::Item &item, const Mesh *&mesh, il_mat &model) override {
+        (void)item;
+        mesh = comp.occluder(this->model, model);
+        return true;
+    }
     void draw(Graphics &graphics) override {
-        auto mvp = graphics.objmats(&object, ILG_MVP, 1);
+        auto model = graphics.objmats(&object, ILG_MODEL, 1);
+        auto imt = graphics.objmats(&object, ILG_IMT, 1);
+        comp.draw(model.front(), imt.front());
+    }
+    bool record(Graphics &graphics, DrawBatch &batch) override {
+        auto model = graphics.objmats(&object, ILG_MODEL, 1);
         auto imt = graphics.objmats(&object, ILG_IMT, 1);
-        comp.draw(mvp.front(), imt.front());
+        return comp.record(batch, model.front(), imt.front());
     }
 
 private:
     unsigned object;
     Computer &comp;
+    il_mat model, imt;
 };
 
 int main(int argc, char **argv)
@@ -42,11 +64,14 @@ int main(int argc, char **argv)
     }
     Computer comp;
     char *error;
-    if (!comp.build(graphics.rm, &error)) {
+    if (!comp.build(graphics.rm, graphics.loader, graphics.gbuffer, &error)) {
         il_error("Computer: %s", error);
         free(error);
         return 1;
     }
+    if (!graphics.loader.wait()) {
+        return 1;
+    }
     il_pos compp = il_pos_new(&graphics.space);
     ComputerRenderer compr(compp.id, comp);
     graphics.drawables.push_back(&compr);
@@ -70,15 +95,19 @@ int main(int argc, char **argv)
     typedef std::chrono::steady_clock clock;
     typedef std::chrono::duration<double> duration;
 
+    FrameScheduler frames(window);
     clock::time_point start = clock::now();
     while (1) {
         SDL_Event ev;
-        while (SDL_PollEvent(&ev)) {
+        while (frames.poll(ev)) {
             switch (ev.type) {
             case SDL_QUIT:
                 return 0;
             }
         }
+        if (!frames.draw()) {
+            continue;
+        }
 
         duration delta = clock::now() - start;
         int secs = 10;
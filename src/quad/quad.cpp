@@ -3,6 +3,7 @@
 #include <math.h>
 
 #include "Demo.h"
+#include "FrameScheduler.h"
 
 extern "C" {
 #include "graphics/floatspace.h"
@@ -42,9 +43,12 @@ int main(int argc, char **argv)
     ilG_material_bind(mptr);
     tgl_vao_bind(&vao);
 
+    // The quad never changes, so it's only drawn again when something damages it
+    FrameScheduler frames(window);
+    frames.animating = false;
     while (1) {
         SDL_Event ev;
-        while (SDL_PollEvent(&ev)) {
+        while (frames.poll(ev)) {
             switch (ev.type) {
             case SDL_QUIT:
                 ilG_renderman_delMaterial(rm, mat);
@@ -54,6 +58,9 @@ int main(int argc, char **argv)
                 return 0;
             }
         }
+        if (!frames.draw()) {
+            continue;
+        }
         window.resize();
         tgl_quad_draw_once(&quad);
         window.swap();
@@ -0,0 +1,439 @@
+#include "offline.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <errno.h>
+#include <math.h>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "PngStream.h"
+#include "SampleCounter.h"
+
+extern "C" {
+#include "util/log.h"
+}
+
+using namespace std;
+
+namespace {
+
+// Fastest zlib level; previews are written far more often than read
+const int png_level = 1;
+// Readbacks in flight, and so frames the GPU may run ahead of the writers
+const unsigned ring = 4;
+
+// Output file names split around their frame number
+struct Pattern {
+    string prefix, suffix;
+    int width = 0;
+    bool zero = false;
+};
+
+bool parse_pattern(const string &output, Pattern &out)
+{
+    size_t at = output.find('%');
+    if (at == string::npos) {
+        return false;
+    }
+    size_t p = at + 1;
+    if (p < output.size() && output[p] == '0') {
+        out.zero = true;
+        p++;
+    }
+    while (p < output.size() && output[p] >= '0' && output[p] <= '9') {
+        out.width = out.width * 10 + (output[p] - '0');
+        p++;
+    }
+    if (p >= output.size() || output[p] != 'd' || output.find('%', p) != string::npos) {
+        return false;
+    }
+    out.prefix = output.substr(0, at);
+    out.suffix = output.substr(p + 1);
+    return true;
+}
+
+string format_name(const Pattern &pattern, unsigned index)
+{
+    char num[32];
+    snprintf(num, sizeof(num), pattern.zero? "%0*u" : "%*u", pattern.width, index);
+    return pattern.prefix + num + pattern.suffix;
+}
+
+bool ends_with(const string &s, const char *suffix)
+{
+    size_t len = strlen(suffix);
+    return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+/* Queue of read back frames, encoded on worker threads. Frame buffers are
+ * recycled through a free list capped at limit, so acquire() blocking is
+ * what slows rendering down to the writers' pace. */
+class FrameWriter {
+public:
+    bool open(const OfflineSettings &settings, string &error);
+    // Returns false once a writer has failed
+    bool acquire(vector<uint8_t> &pixels);
+    // pixels are bottom-up RGBA rows, as glReadPixels returns them
+    void push(unsigned index, vector<uint8_t> &&pixels);
+    // Waits for every queued frame to be written
+    bool close(string &error);
+
+    // Frames that had to wait for a free buffer
+    unsigned long stalls = 0;
+    unsigned threads_used = 0;
+
+private:
+    struct Frame {
+        unsigned index;
+        vector<uint8_t> pixels;
+    };
+
+    void run();
+    bool write_png(const Frame &frame, string &error);
+    bool write_y4m(const Frame &frame, vector<uint8_t> &planes, string &error);
+
+    unsigned width = 0, height = 0;
+    bool y4m = false;
+    Pattern pattern;
+    FILE *stream = nullptr;
+    vector<thread> threads;
+    mutex lock;
+    condition_variable ready, freed;
+    deque<Frame> queue;
+    vector<vector<uint8_t>> spare;
+    size_t buffers = 0, limit = 0;
+    bool closing = false;
+    string failure;
+};
+
+bool FrameWriter::open(const OfflineSettings &settings, string &error)
+{
+    width = settings.width;
+    height = settings.height;
+    y4m = settings.output == "-" || ends_with(settings.output, ".y4m");
+    if (!y4m && !parse_pattern(settings.output, pattern)) {
+        error = "Output must be a PNG name with one %d, a .y4m file or -, got "
+            + settings.output;
+        return false;
+    }
+
+    unsigned count = 1;
+    if (y4m) {
+        stream = settings.output == "-"? stdout : fopen(settings.output.c_str(), "wb");
+        if (!stream) {
+            error = settings.output + ": " + strerror(errno);
+            return false;
+        }
+        // 4:4:4 keeps full chroma; encoders downsample as they see fit
+        const double fps = settings.fps;
+        if (fps == floor(fps)) {
+            fprintf(stream, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n",
+                    width, height, unsigned(fps));
+        } else {
+            fprintf(stream, "YUV4MPEG2 W%u H%u F%u:1000 Ip A1:1 C444\n",
+                    width, height, unsigned(lround(fps * 1000)));
+        }
+    } else {
+        // Leave a core for the render thread and the driver
+        unsigned cores = thread::hardware_concurrency();
+        count = max(1u, min(cores > 1? cores - 1 : 1, 8u));
+    }
+    limit = count * 2 + 1;
+    threads_used = count;
+    for (unsigned i = 0; i < count; i++) {
+        threads.emplace_back(&FrameWriter::run, this);
+    }
+    return true;
+}
+
+bool FrameWriter::acquire(vector<uint8_t> &pixels)
+{
+    unique_lock<mutex> guard(lock);
+    if (spare.empty() && buffers >= limit) {
+        stalls++;
+        freed.wait(guard, [this] { return !spare.empty() || !failure.empty(); });
+    }
+    if (!failure.empty()) {
+        return false;
+    }
+    if (!spare.empty()) {
+        pixels = move(spare.back());
+        spare.pop_back();
+    } else {
+        buffers++;
+        pixels.resize(size_t(width) * height * 4);
+    }
+    return true;
+}
+
+void FrameWriter::push(unsigned index, vector<uint8_t> &&pixels)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        queue.push_back(Frame{index, move(pixels)});
+    }
+    ready.notify_one();
+}
+
+void FrameWriter::run()
+{
+    vector<uint8_t> planes;
+    while (true) {
+        Frame frame;
+        {
+            unique_lock<mutex> guard(lock);
+            ready.wait(guard, [this] { return !queue.empty() || closing; });
+            if (queue.empty()) {
+                return;
+            }
+            frame = move(queue.front());
+            queue.pop_front();
+        }
+        string error;
+        bool ok = y4m? write_y4m(frame, planes, error) : write_png(frame, error);
+        {
+            lock_guard<mutex> guard(lock);
+            if (!ok && failure.empty()) {
+                failure = move(error);
+            }
+            spare.push_back(move(frame.pixels));
+        }
+        freed.notify_one();
+    }
+}
+
+bool FrameWriter::write_png(const Frame &frame, string &error)
+{
+    PngStream png;
+    const string name = format_name(pattern, frame.index);
+    if (!png.open(name.c_str(), width, height, png_level, error)) {
+        return false;
+    }
+    const size_t stride = size_t(width) * 4;
+    for (unsigned y = 0; y < height; y++) {
+        if (!png.row(&frame.pixels[(height - 1 - y) * stride], error)) {
+            return false;
+        }
+    }
+    return png.close(error);
+}
+
+bool FrameWriter::write_y4m(const Frame &frame, vector<uint8_t> &planes, string &error)
+{
+    const size_t area = size_t(width) * height;
+    planes.resize(area * 3);
+    uint8_t *py = &planes[0], *pu = py + area, *pv = pu + area;
+    // BT.601 studio swing, offsets folded in so every sum stays positive
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t *src = &frame.pixels[(height - 1 - y) * size_t(width) * 4];
+        for (unsigned x = 0; x < width; x++, src += 4) {
+            const int r = src[0], g = src[1], b = src[2];
+            *py++ = uint8_t((66 * r + 129 * g + 25 * b + 128 + (16 << 8)) >> 8);
+            *pu++ = uint8_t((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8);
+            *pv++ = uint8_t((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8);
+        }
+    }
+    if (fputs("FRAME\n", stream) < 0 || fwrite(&planes[0], 1, planes.size(), stream) != planes.size()) {
+        error = string("Writing Y4M frame: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool FrameWriter::close(string &error)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        closing = true;
+    }
+    ready.notify_all();
+    for (thread &t : threads) {
+        t.join();
+    }
+    threads.clear();
+    bool ok = failure.empty();
+    if (stream) {
+        if ((stream == stdout? fflush(stream) : fclose(stream)) != 0 && ok) {
+            failure = string("Closing output: ") + strerror(errno);
+            ok = false;
+        }
+        stream = nullptr;
+    }
+    if (!ok) {
+        error = failure;
+    }
+    return ok;
+}
+
+struct Slot {
+    GLuint pbo = 0;
+    GLsync fence = 0;
+    unsigned index = 0;
+};
+
+// Waits for the slot's readback, which is usually long done, and queues it
+/* Hands a finished readback to the writer. Fails with error set if the
+ * pixels couldn't be read, or with it empty if the writer has failed. */
+bool collect(Slot &slot, FrameWriter &writer, size_t size, string &error)
+{
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (status == GL_TIMEOUT_EXPIRED) {
+        status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    vector<uint8_t> pixels;
+    if (!writer.acquire(pixels)) {
+        return false;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    void *ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_READ_BIT);
+    if (!ptr) {
+        // Nothing was mapped, so there is nothing to unmap
+        char code[16];
+        snprintf(code, sizeof(code), "0x%04x", glGetError());
+        error = "Mapping frame " + to_string(slot.index) + " failed with GL error " + code;
+        return false;
+    }
+    memcpy(&pixels[0], ptr, size);
+    // The store can be lost while mapped, on a mode switch for instance
+    if (!glUnmapBuffer(GL_PIXEL_PACK_BUFFER)) {
+        error = "Frame " + to_string(slot.index) + " was corrupted while mapped";
+        return false;
+    }
+    writer.push(slot.index, move(pixels));
+    return true;
+}
+
+}
+
+bool render_offline(Shader &shader, Passes &passes, tgl_quad &quad, tgl_vao &vao,
+                    const OfflineSettings &settings, string &error)
+{
+    typedef chrono::steady_clock clock;
+    typedef chrono::duration<double> duration;
+
+    passes.wait();
+    if (!passes.ready()) {
+        error = "A buffer pass failed to build";
+        return false;
+    }
+    FrameWriter writer;
+    if (!writer.open(settings, error)) {
+        return false;
+    }
+    const unsigned width = settings.width, height = settings.height;
+    const size_t size = size_t(width) * height * 4;
+    const unsigned frames = unsigned(ceil(double(settings.duration) * settings.fps));
+
+    GLuint fbo, color;
+    glGenRenderbuffers(1, &color);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, GLsizei(width), GLsizei(height));
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    Slot slots[ring];
+    for (Slot &slot : slots) {
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(size), NULL, GL_STREAM_READ);
+    }
+    const bool timed = epoxy_gl_version() >= 33 || TGL_EXTENSION(ARB_timer_query);
+    SampleCounter gpu(GL_TIME_ELAPSED);
+
+    il_log("Rendering %u frames at %ux%u, %g fps, %u writer threads", frames, width, height,
+           settings.fps, writer.threads_used);
+    int mouse[4] = {};
+    bool ok = status == GL_FRAMEBUFFER_COMPLETE, quit = false;
+    if (!ok) {
+        error = "Offscreen framebuffer incomplete";
+    }
+    clock::time_point start = clock::now();
+    unsigned i;
+    for (i = 0; ok && !quit && i < frames; i++) {
+        SDL_Event ev;
+        while (SDL_PollEvent(&ev)) {
+            quit |= ev.type == SDL_QUIT;
+        }
+        Slot &slot = slots[i % ring];
+        if (slot.fence && !collect(slot, writer, size, error)) {
+            ok = error.empty();
+            break;
+        }
+        GLuint ns;
+        gpu.poll(ns);
+
+        // Fixed steps, so every run renders the same frames
+        const float time = float(double(i) / settings.fps);
+        if (timed) {
+            gpu.begin();
+        }
+        passes.render(quad, vao, width, height, time, mouse);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, GLsizei(width), GLsizei(height));
+        shader.bind(width, height, time, mouse);
+        passes.bind_image(shader);
+        tgl_vao_bind(&vao);
+        tgl_quad_draw_once(&quad);
+        if (timed) {
+            gpu.end();
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glReadPixels(0, 0, GLsizei(width), GLsizei(height), GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.index = i;
+
+        if (frames >= 10 && (i + 1) % (frames / 10) == 0) {
+            il_log("%u / %u frames", i + 1, frames);
+        }
+    }
+    // Oldest first, so the Y4M stream stays in order
+    for (unsigned k = 0; k < ring; k++) {
+        Slot &slot = slots[(i + k) % ring];
+        if (slot.fence) {
+            if (ok && !collect(slot, writer, size, error)) {
+                ok = false;
+            }
+            if (slot.fence) {
+                glDeleteSync(slot.fence);
+                slot.fence = 0;
+            }
+        }
+    }
+    string write_error;
+    if (!writer.close(write_error) && error.empty()) {
+        error = write_error;
+        ok = false;
+    }
+    const double elapsed = duration(clock::now() - start).count();
+    GLuint ns;
+    gpu.poll(ns);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    for (Slot &slot : slots) {
+        glDeleteBuffers(1, &slot.pbo);
+    }
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &color);
+    gpu.free();
+
+    if (gpu.results) {
+        il_log("%u frames in %.2f s: %.1f frames/s, %.3f GPU ms/frame, %lu waits on writers",
+               i, elapsed, i / elapsed, gpu.total / gpu.results / 1e6, writer.stalls);
+    } else {
+        il_log("%u frames in %.2f s: %.1f frames/s, %lu waits on writers",
+               i, elapsed, i / elapsed, writer.stalls);
+    }
+    return ok;
+}
@@ -0,0 +1,33 @@
+#ifndef DEMO_OFFLINE_H
+#define DEMO_OFFLINE_H
+
+#include <string>
+
+#include "passes.h"
+#include "shader.h"
+#include "tgl/tgl.h"
+
+struct OfflineSettings {
+    /* foo%05d.png for numbered PNGs (any printf-style %d with an optional
+     * zero-padded width), foo.y4m for a YUV4MPEG2 stream, or - to write the
+     * stream to stdout, e.g. for piping into an encoder */
+    std::string output;
+    unsigned width, height;
+    float fps, duration;
+};
+
+/* Renders the shader at fixed time steps of 1 / fps into an offscreen
+ * framebuffer, as fast as the GPU and the writers allow. Frames are read
+ * back through a ring of pixel buffers, each mapped only once its fence has
+ * signalled, so the GPU keeps a few frames queued instead of draining after
+ * every readback. Encoding runs on writer threads: PNGs are independent and
+ * spread over several, the Y4M stream has one to keep frames in order. When
+ * the writers fall behind, rendering waits for a free frame buffer, which
+ * bounds memory.
+ *
+ * Logs frames per second overall and GPU milliseconds per frame, from
+ * GL_TIME_ELAPSED queries where ARB_timer_query is available. */
+bool render_offline(Shader &shader, Passes &passes, tgl_quad &quad, tgl_vao &vao,
+                    const OfflineSettings &settings, std::string &error);
+
+#endif
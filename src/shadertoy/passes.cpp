@@ -0,0 +1,335 @@
+#include "passes.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+
+extern "C" {
+#include "util/log.h"
+}
+
+using namespace std;
+
+namespace {
+
+// One line of the manifest; channels hold buffer names, or 0
+struct Entry {
+    char name;
+    string shader;
+    char channels[4];
+    unsigned width, height;
+    unsigned line;
+};
+
+bool fail(char **error, const string &path, unsigned line, const string &message)
+{
+    *error = strdup((path + ":" + to_string(line) + ": " + message).c_str());
+    return false;
+}
+
+}
+
+bool Passes::load(const Shader &image, char **error)
+{
+    size_t dot = image.path.rfind('.');
+    size_t slash = image.path.find_last_of("/\\");
+    const string path = image.path.substr(0, dot != string::npos
+        && (slash == string::npos || dot > slash)? dot : string::npos) + ".passes";
+    ifstream in(path);
+    if (!in) {
+        return true;
+    }
+
+    vector<Entry> entries;
+    Entry image_entry = {0, string(), {0, 0, 0, 0}, 0, 0, 0};
+    string text;
+    for (unsigned number = 1; getline(in, text); number++) {
+        text = text.substr(0, text.find('#'));
+        istringstream words(text);
+        string word;
+        if (!(words >> word)) {
+            continue;
+        }
+        Entry entry = {0, string(), {0, 0, 0, 0}, 0, 0, number};
+        const bool is_image = word == "image";
+        if (!is_image) {
+            if (word.size() != 1 || word[0] < 'A' || word[0] > 'D') {
+                return fail(error, path, number, "expected a buffer A-D or image, got " + word);
+            }
+            entry.name = word[0];
+            if (!(words >> entry.shader) || entry.shader.find('=') != string::npos) {
+                return fail(error, path, number, "expected buffer " + word + "'s shader");
+            }
+        }
+        while (words >> word) {
+            unsigned channel, width, height;
+            char input;
+            if (sscanf(word.c_str(), "iChannel%u=%c", &channel, &input) == 2) {
+                if (channel > 3 || input < 'A' || input > 'D') {
+                    return fail(error, path, number, "bad input " + word);
+                }
+                entry.channels[channel] = input;
+            } else if (!is_image && sscanf(word.c_str(), "size=%ux%u", &width, &height) == 2
+                       && width && height) {
+                entry.width = width;
+                entry.height = height;
+            } else {
+                return fail(error, path, number, "unknown option " + word);
+            }
+        }
+        if (is_image) {
+            image_entry = entry;
+            continue;
+        }
+        for (const Entry &other : entries) {
+            if (other.name == entry.name) {
+                return fail(error, path, number, string("buffer ") + entry.name + " listed twice");
+            }
+        }
+        entries.push_back(entry);
+    }
+    sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.name < b.name;
+    });
+    auto resolve = [&](const Entry &entry, int inputs[4]) {
+        for (unsigned i = 0; i < 4; i++) {
+            inputs[i] = -1;
+            for (size_t j = 0; entry.channels[i] && j < entries.size(); j++) {
+                if (entries[j].name == entry.channels[i]) {
+                    inputs[i] = int(j);
+                }
+            }
+            if (entry.channels[i] && inputs[i] < 0) {
+                return fail(error, path, entry.line,
+                            string("buffer ") + entry.channels[i] + " is not defined");
+            }
+        }
+        return true;
+    };
+
+    buffers.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        Buffer &buffer = buffers[i];
+        buffer.name = entries[i].name;
+        buffer.fixed_width = entries[i].width;
+        buffer.fixed_height = entries[i].height;
+        if (!resolve(entries[i], buffer.inputs)) {
+            buffers.clear();
+            return false;
+        }
+    }
+    if (!resolve(image_entry, image_inputs)) {
+        buffers.clear();
+        return false;
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        Buffer &buffer = buffers[i];
+        buffer.shader.reset(new Shader(rm));
+        if (!buffer.shader->open(entries[i].shader.c_str(), image.vertex(), error)) {
+            buffers.resize(i);
+            free();
+            return false;
+        }
+        glGenFramebuffers(2, buffer.fbo);
+        glGenTextures(2, buffer.tex);
+    }
+    il_log("%s: %zu buffer passes", path.c_str(), buffers.size());
+    return true;
+}
+
+void Passes::watch(uv_loop_t *loop)
+{
+    for (Buffer &buffer : buffers) {
+        buffer.shader->watch(loop);
+    }
+}
+
+void Passes::unwatch()
+{
+    for (Buffer &buffer : buffers) {
+        buffer.shader->unwatch();
+    }
+}
+
+void Passes::free()
+{
+    for (Buffer &buffer : buffers) {
+        buffer.shader->free();
+        glDeleteFramebuffers(2, buffer.fbo);
+        glDeleteTextures(2, buffer.tex);
+    }
+    buffers.clear();
+    if (rendered + skipped) {
+        il_log("Buffer passes: %lu rendered, %lu skipped", rendered, skipped);
+    }
+}
+
+void Passes::poll()
+{
+    for (Buffer &buffer : buffers) {
+        buffer.shader->poll();
+    }
+}
+
+void Passes::wait()
+{
+    for (Buffer &buffer : buffers) {
+        buffer.shader->wait();
+    }
+}
+
+bool Passes::ready() const
+{
+    for (const Buffer &buffer : buffers) {
+        if (!buffer.shader->linked) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Passes::building() const
+{
+    for (const Buffer &buffer : buffers) {
+        if (buffer.shader->building()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned Passes::builds() const
+{
+    unsigned count = 0;
+    for (const Buffer &buffer : buffers) {
+        count += buffer.shader->builds;
+    }
+    return count;
+}
+
+vector<string> Passes::sources() const
+{
+    vector<string> paths;
+    for (const Buffer &buffer : buffers) {
+        paths.push_back(buffer.shader->path);
+    }
+    return paths;
+}
+
+void Passes::resize(Buffer &buffer, unsigned width, unsigned height)
+{
+    buffer.width = width;
+    buffer.height = height;
+    glActiveTexture(GL_TEXTURE0);
+    for (unsigned i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, buffer.tex[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, GLsizei(width), GLsizei(height), 0,
+                     GL_RGBA, GL_HALF_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindFramebuffer(GL_FRAMEBUFFER, buffer.fbo[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               buffer.tex[i], 0);
+        // Feedback buffers start from black rather than undefined contents
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        il_error("Buffer %c incomplete: %#x", buffer.name, status);
+    }
+}
+
+bool Passes::dirty(Buffer &buffer, float time, const int mouse[4])
+{
+    Shader &shader = *buffer.shader;
+    // changed() also clears the flag, so it is asked first
+    bool dirty = shader.changed() || buffer.version == 0;
+    if (shader.iGlobalTime >= 0 && time != buffer.time) {
+        dirty = true;
+    }
+    if (shader.iMouse >= 0 && memcmp(mouse, buffer.mouse, sizeof(buffer.mouse)) != 0) {
+        dirty = true;
+    }
+    for (unsigned i = 0; i < 4; i++) {
+        if (buffer.inputs[i] >= 0 && buffers[size_t(buffer.inputs[i])].version != buffer.seen[i]) {
+            dirty = true;
+        }
+    }
+    return dirty;
+}
+
+void Passes::bind_inputs(const int inputs[4], Shader &shader)
+{
+    float resolution[4][3] = {};
+    for (unsigned i = 0; i < 4; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        if (inputs[i] < 0) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+            continue;
+        }
+        const Buffer &input = buffers[size_t(inputs[i])];
+        glBindTexture(GL_TEXTURE_2D, input.tex[input.current]);
+        resolution[i][0] = float(input.width);
+        resolution[i][1] = float(input.height);
+        resolution[i][2] = 1;
+    }
+    glUniform3fv(shader.iChannelResolution, 4, &resolution[0][0]);
+}
+
+void Passes::render(tgl_quad &quad, tgl_vao &vao, unsigned width, unsigned height, float time,
+                    int mouse[4])
+{
+    if (buffers.empty()) {
+        return;
+    }
+    poll();
+    tgl_vao_bind(&vao);
+    for (Buffer &buffer : buffers) {
+        Shader &shader = *buffer.shader;
+        if (!shader.linked) {
+            continue;
+        }
+        const unsigned w = buffer.fixed_width? buffer.fixed_width : width;
+        const unsigned h = buffer.fixed_height? buffer.fixed_height : height;
+        bool resized = w != buffer.width || h != buffer.height;
+        if (resized) {
+            resize(buffer, w, h);
+        }
+        if (!dirty(buffer, time, mouse) && !resized) {
+            skipped++;
+            continue;
+        }
+        const unsigned next = buffer.current ^ 1;
+        glBindFramebuffer(GL_FRAMEBUFFER, buffer.fbo[next]);
+        glViewport(0, 0, GLsizei(w), GLsizei(h));
+        shader.bind(w, h, time, mouse);
+        bind_inputs(buffer.inputs, shader);
+        tgl_quad_draw_once(&quad);
+
+        // Before the bump, so a buffer reading itself is dirty next frame
+        for (unsigned i = 0; i < 4; i++) {
+            if (buffer.inputs[i] >= 0) {
+                buffer.seen[i] = buffers[size_t(buffer.inputs[i])].version;
+            }
+        }
+        buffer.current = next;
+        buffer.version++;
+        buffer.time = time;
+        memcpy(buffer.mouse, mouse, sizeof(buffer.mouse));
+        rendered++;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, GLsizei(width), GLsizei(height));
+}
+
+void Passes::bind_image(Shader &image)
+{
+    if (!buffers.empty()) {
+        bind_inputs(image_inputs, image);
+    }
+}
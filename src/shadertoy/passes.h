@@ -0,0 +1,96 @@
+#ifndef DEMO_PASSES_H
+#define DEMO_PASSES_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <uv.h>
+
+#include "shader.h"
+#include "tgl/tgl.h"
+
+/* Buffer A-D passes feeding a shader's iChannel0-3, as on shadertoy.com,
+ * described by a manifest next to the shader, foo.passes for foo.frag:
+ *
+ *     # name  shader      inputs and options
+ *     A       noise.frag  size=256x256
+ *     B       sim.frag    iChannel0=A iChannel1=B
+ *     image               iChannel0=B
+ *
+ * Buffers render in order A to D into RGBA16F textures, each with a second
+ * one to ping-pong with, so a buffer reading itself or a later one sees the
+ * previous frame. Without size= a buffer follows the view's size. Buffer
+ * shaders are built with the image's vertex shader in the background, and
+ * reload like the image's; a buffer is skipped until its program is ready.
+ *
+ * A buffer is only rendered again when something it reads has changed: an
+ * input buffer rendered since it last did (so a buffer reading itself
+ * renders every frame), its program was reloaded, its size changed, or
+ * iGlobalTime or iMouse changed and the program uses them, which the GL
+ * reports through their uniform locations. Buffers holding noise or lookup
+ * tables then render once. */
+class Passes {
+public:
+    Passes(ilG_renderman *rm)
+        : rm(rm) {}
+
+    // Reads the image shader's manifest, if it has one, and starts the builds
+    bool load(const Shader &image, char **error);
+    // Reloads the buffers' files whenever they change
+    void watch(uv_loop_t *loop);
+    // Stops watching the buffers' files; run the loop before free()
+    void unwatch();
+    void free();
+    // Swaps in finished builds; render() does this too
+    void poll();
+    // Blocks until every buffer's build in flight is done
+    void wait();
+    // Whether every buffer's program has been built
+    bool ready() const;
+    // Whether any buffer's build is still in flight
+    bool building() const;
+    // Paths of the buffers' shaders
+    std::vector<std::string> sources() const;
+    // Sum of the buffers' Shader::builds, which grows on every reload
+    unsigned builds() const;
+
+    // Renders the buffers that need it, then restores the default framebuffer
+    void render(tgl_quad &quad, tgl_vao &vao, unsigned width, unsigned height, float time,
+                int mouse[4]);
+    // Binds the image's inputs; call after the image's Shader::bind
+    void bind_image(Shader &image);
+
+    bool empty() const {
+        return buffers.empty();
+    }
+
+    // Buffer renders done and skipped as unchanged
+    unsigned long rendered = 0, skipped = 0;
+
+private:
+    struct Buffer {
+        char name;
+        std::unique_ptr<Shader> shader;
+        // Index into buffers per channel, or -1
+        int inputs[4];
+        unsigned fixed_width = 0, fixed_height = 0;
+        unsigned width = 0, height = 0;
+        GLuint fbo[2] = {0, 0}, tex[2] = {0, 0};
+        // Texture holding the latest result
+        unsigned current = 0;
+        // Bumped by every render, and the inputs' at this buffer's last one
+        unsigned long version = 0, seen[4] = {0, 0, 0, 0};
+        float time = 0;
+        int mouse[4] = {0, 0, 0, 0};
+    };
+
+    void resize(Buffer &buffer, unsigned width, unsigned height);
+    bool dirty(Buffer &buffer, float time, const int mouse[4]);
+    void bind_inputs(const int inputs[4], Shader &shader);
+
+    ilG_renderman *rm;
+    std::vector<Buffer> buffers;
+    int image_inputs[4] = {-1, -1, -1, -1};
+};
+
+#endif
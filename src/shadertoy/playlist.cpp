@@ -0,0 +1,200 @@
+#include "playlist.h"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string.h>
+
+extern "C" {
+#include "util/log.h"
+}
+
+using namespace std;
+
+// Whether path is where name was found on the shader path
+static bool same_shader(const string &path, const string &name)
+{
+    return path == name || (path.size() > name.size()
+                            && path.compare(path.size() - name.size(), name.size(), name) == 0
+                            && (path[path.size() - name.size() - 1] == '/'
+                                || path[path.size() - name.size() - 1] == '\\'));
+}
+
+bool Playlist::scan(uv_loop_t *loop, const string &list, const char *dir,
+                    vector<string> &names, char **error)
+{
+    names.clear();
+    if (!list.empty()) {
+        ifstream in(list);
+        if (!in) {
+            *error = strdup((list + ": failed to open").c_str());
+            return false;
+        }
+        string line;
+        while (getline(in, line)) {
+            istringstream words(line.substr(0, line.find('#')));
+            string name;
+            if (words >> name) {
+                names.push_back(name);
+            }
+        }
+    } else {
+        uv_fs_t req;
+        int res = uv_fs_scandir(loop, &req, dir, 0, nullptr);
+        if (res < 0) {
+            *error = strdup((string(dir) + ": " + uv_strerror(res)).c_str());
+            uv_fs_req_cleanup(&req);
+            return false;
+        }
+        uv_dirent_t ent;
+        while (uv_fs_scandir_next(&req, &ent) != UV_EOF) {
+            const string name = ent.name;
+            if (ent.type != UV_DIRENT_DIR && name.size() > 5
+                && name.compare(name.size() - 5, 5, ".frag") == 0) {
+                names.push_back(name);
+            }
+        }
+        uv_fs_req_cleanup(&req);
+        sort(names.begin(), names.end());
+    }
+    if (names.empty()) {
+        *error = strdup(((list.empty()? string(dir) : list) + ": no shaders").c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Playlist::load(const vector<string> &names, Shader &first, Passes &first_passes,
+                    uv_loop_t *loop, char **error)
+{
+    if (!first.vertex()) {
+        *error = strdup("Playlist needs the vertex shader of the first one");
+        return false;
+    }
+    start = uv_hrtime();
+    Entry head;
+    head.shader = &first;
+    head.passes = &first_passes;
+    entries.push_back(move(head));
+    for (const string &name : names) {
+        if (same_shader(first.path, name)) {
+            continue;
+        }
+        Entry entry;
+        entry.own_shader.reset(new Shader(rm));
+        entry.own_passes.reset(new Passes(rm));
+        entry.shader = entry.own_shader.get();
+        entry.passes = entry.own_passes.get();
+        char *entry_error;
+        if (!entry.shader->open(name.c_str(), first.vertex(), &entry_error)
+            || !entry.passes->load(*entry.shader, &entry_error)) {
+            // One broken shader shouldn't take the rest down
+            il_warning("%s", entry_error);
+            ::free(entry_error);
+            entry.shader->free();
+            continue;
+        }
+        entries.push_back(move(entry));
+    }
+
+    set<string> buffers;
+    for (const Entry &entry : entries) {
+        for (const string &path : entry.passes->sources()) {
+            buffers.insert(path);
+        }
+    }
+    for (size_t i = entries.size(); i-- > 1;) {
+        if (buffers.count(entries[i].shader->path)) {
+            entries[i].passes->free();
+            entries[i].shader->free();
+            entries.erase(entries.begin() + long(i));
+        }
+    }
+    for (Entry &entry : entries) {
+        if (entry.own_shader) {
+            entry.shader->watch(loop);
+            entry.passes->watch(loop);
+        }
+    }
+    il_log("Playlist: building %zu shaders", entries.size());
+    return true;
+}
+
+void Playlist::unwatch()
+{
+    for (Entry &entry : entries) {
+        if (entry.own_shader) {
+            entry.shader->unwatch();
+            entry.passes->unwatch();
+        }
+    }
+}
+
+void Playlist::free()
+{
+    for (Entry &entry : entries) {
+        if (entry.own_shader) {
+            entry.passes->free();
+            entry.shader->free();
+        }
+    }
+    entries.clear();
+    current = 0;
+}
+
+bool Playlist::ready(const Entry &entry)
+{
+    return entry.shader->linked && entry.passes->ready();
+}
+
+bool Playlist::building(const Entry &entry)
+{
+    return entry.shader->building() || entry.passes->building();
+}
+
+void Playlist::poll()
+{
+    // The shown entry's passes are polled by Passes::render
+    entries[current].shader->poll();
+    // At most one background build is swapped in per frame, so builds that
+    // finish together don't all stall the same one
+    for (size_t i = 0; i < entries.size(); i++) {
+        Entry &entry = entries[i];
+        if (i == current || !building(entry)) {
+            continue;
+        }
+        entry.shader->poll();
+        entry.passes->poll();
+        if (!building(entry)) {
+            break;
+        }
+    }
+    if (settled) {
+        return;
+    }
+    size_t built = 0;
+    for (const Entry &entry : entries) {
+        if (building(entry)) {
+            return;
+        }
+        built += ready(entry);
+    }
+    settled = true;
+    il_log("Playlist: %zu of %zu shaders ready after %.1f ms", built, entries.size(),
+           (uv_hrtime() - start) / 1e6);
+}
+
+bool Playlist::advance(int step)
+{
+    const long n = long(entries.size());
+    for (long i = 1; i < n; i++) {
+        const long next = ((long(current) + step * i) % n + n) % n;
+        if (ready(entries[size_t(next)])) {
+            current = size_t(next);
+            il_log("Playing %s", shader().path.c_str());
+            return true;
+        }
+    }
+    return false;
+}
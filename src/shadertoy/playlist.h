@@ -0,0 +1,63 @@
+#ifndef DEMO_PLAYLIST_H
+#define DEMO_PLAYLIST_H
+
+#include <memory>
+#include <string>
+#include <uv.h>
+#include <vector>
+
+#include "passes.h"
+#include "shader.h"
+
+/* Kiosk mode: a list of shaders, each with its buffer passes, all of them
+ * built at startup with Shader::open. With parallel compile the driver works
+ * through them on its own threads; otherwise one is checked per frame, so the
+ * link stalls are spread out. Switching only moves to entries that are
+ * already built, so it never waits on the compiler. Shaders that another
+ * entry uses as a buffer pass are not entries of their own. */
+class Playlist {
+public:
+    Playlist(ilG_renderman *rm)
+        : rm(rm) {}
+
+    // Shaders named one per line in list, or every .frag in dir if list is empty
+    static bool scan(uv_loop_t *loop, const std::string &list, const char *dir,
+                     std::vector<std::string> &names, char **error);
+    // Starts building names; first, already loaded with its passes, is the entry of its name
+    bool load(const std::vector<std::string> &names, Shader &first, Passes &first_passes,
+              uv_loop_t *loop, char **error);
+    // Stops watching the entries' files; run the loop before free()
+    void unwatch();
+    void free();
+
+    // Swaps in finished builds, and reports when all of them have settled
+    void poll();
+    // Moves step entries at a time until one that is built; false if there is none
+    bool advance(int step);
+
+    Shader &shader() {
+        return *entries[current].shader;
+    }
+    Passes &passes() {
+        return *entries[current].passes;
+    }
+
+private:
+    struct Entry {
+        std::unique_ptr<Shader> own_shader;
+        std::unique_ptr<Passes> own_passes;
+        Shader *shader;
+        Passes *passes;
+    };
+
+    static bool ready(const Entry &entry);
+    static bool building(const Entry &entry);
+
+    ilG_renderman *rm;
+    std::vector<Entry> entries;
+    size_t current = 0;
+    uint64_t start = 0;
+    bool settled = false;
+};
+
+#endif
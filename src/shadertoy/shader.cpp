@@ -0,0 +1,399 @@
+#include "shader.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+extern "C" {
+#include "asset/node.h"
+#include "graphics/material.h"
+#include "util/log.h"
+}
+
+// Quiet period after the last file event before a reload, in milliseconds
+static const uint64_t reload_delay = 100;
+
+static bool read_file(const char *path, std::string &out)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    char buf[4096];
+    size_t len;
+    out.clear();
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out.append(buf, len);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static uint64_t fnv1a(const std::string &s)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : s) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string shader_log(GLuint shader)
+{
+    GLint len = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+    std::string log(size_t(len > 0? len : 1), '\0');
+    glGetShaderInfoLog(shader, GLsizei(log.size()), nullptr, &log[0]);
+    return log.c_str();
+}
+
+static std::string program_log(GLuint program)
+{
+    GLint len = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+    std::string log(size_t(len > 0? len : 1), '\0');
+    glGetProgramInfoLog(program, GLsizei(log.size()), nullptr, &log[0]);
+    return log.c_str();
+}
+
+static bool is_ident(char c)
+{
+    return c == '_' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/* Routes every gl_FragCoord through an offset uniform. The declarations go
+ * after the leading #version and #extension lines, which must come first. */
+static std::string offset_source(const std::string &source)
+{
+    size_t insert = 0;
+    while (insert < source.size()) {
+        size_t end = source.find('\n', insert);
+        end = end == std::string::npos? source.size() : end + 1;
+        size_t p = source.find_first_not_of(" \t\r", insert);
+        if (p < end && source[p] != '\n' && source.compare(p, 8, "#version") != 0
+            && source.compare(p, 10, "#extension") != 0 && source.compare(p, 2, "//") != 0) {
+            break;
+        }
+        insert = end;
+    }
+
+    static const char name[] = "gl_FragCoord";
+    const size_t len = sizeof(name) - 1;
+    std::string out = source.substr(0, insert);
+    const size_t header_lines = size_t(std::count(out.begin(), out.end(), '\n'));
+    if (!out.empty() && out.back() != '\n') {
+        out += '\n';
+    }
+    out += "uniform vec2 demo_FragOffset;\n"
+        "#define demo_FragCoord (gl_FragCoord + vec4(demo_FragOffset, 0.0, 0.0))\n";
+    /* Compile errors still point at the lines of the file on disk. Before
+     * GLSL 3.30, #line N numbers the next line N + 1 rather than N */
+    unsigned version = 110;
+    const size_t directive = out.find("#version");
+    if (directive != std::string::npos) {
+        sscanf(out.c_str() + directive + 8, "%u", &version);
+    }
+    const bool es = directive != std::string::npos
+        && out.find(" es", directive) < out.find('\n', directive);
+    const size_t next_line = version >= 330 || es? header_lines + 1 : header_lines;
+    out += "#line " + std::to_string(next_line) + "\n";
+    size_t at = insert;
+    while (true) {
+        size_t found = source.find(name, at);
+        if (found == std::string::npos) {
+            break;
+        }
+        bool whole = (found == 0 || !is_ident(source[found - 1]))
+            && (found + len == source.size() || !is_ident(source[found + len]));
+        out.append(source, at, found - at);
+        out += whole? "demo_FragCoord" : name;
+        at = found + len;
+    }
+    out.append(source, at, std::string::npos);
+    return out;
+}
+
+static void reload_cb(uv_timer_t *handle)
+{
+    reinterpret_cast<Shader*>(handle->data)->reload();
+}
+
+static void event_cb(uv_fs_event_t *handle, const char *filename, int events, int status)
+{
+    (void)events, (void)status, (void)filename;
+    // Restarting pushes the reload back until the writes settle
+    uv_timer_start(reinterpret_cast<uv_timer_t*>(handle->data), reload_cb, reload_delay, 0);
+}
+
+// Whether the driver can build programs off this thread, asking it to once
+static bool parallel_compile()
+{
+    static int parallel = -1;
+    if (parallel < 0) {
+        parallel = TGL_EXTENSION(KHR_parallel_shader_compile)
+            || TGL_EXTENSION(ARB_parallel_shader_compile);
+        if (TGL_EXTENSION(KHR_parallel_shader_compile)) {
+            // Let the driver pick how many threads to use
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        } else if (parallel) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        }
+    }
+    return parallel != 0;
+}
+
+static double ms_since(uint64_t start)
+{
+    return (uv_hrtime() - start) / 1e6;
+}
+
+bool Shader::load(const char *name, ilG_shaderid vert, char **error)
+{
+    ilA_file file;
+    if (!ilA_fileopen(&ilG_shaders, &file, name, -1)) {
+        ilA_printerror(&file.err);
+        *error = strdup((std::string(name) + ": not found").c_str());
+        return false;
+    }
+    il_log("Shader path: %s", file.name);
+    path = file.name;
+
+    ilG_material m;
+    ilG_material_init(&m);
+    ilG_material_name(&m, name);
+    ilG_material_arrayAttrib(&m, 0, "in_Position");
+    ilG_shader frag;
+    ilG_shader_load(&frag, file, GL_FRAGMENT_SHADER);
+    m.vert = vert;
+    m.frag = ilG_renderman_addShader(rm, frag);
+    mat = ilG_renderman_addMaterial(rm, m);
+    return compile(error);
+}
+
+bool Shader::open(const char *name, GLuint vert, char **error)
+{
+    ilA_file file;
+    if (!ilA_fileopen(&ilG_shaders, &file, name, -1)) {
+        ilA_printerror(&file.err);
+        *error = strdup((std::string(name) + ": not found").c_str());
+        return false;
+    }
+    path = file.name;
+    std::string source;
+    if (!read_file(path.c_str(), source)) {
+        *error = strdup((path + ": failed to read").c_str());
+        return false;
+    }
+    vert_shader = vert;
+    parallel = parallel_compile();
+    start_build(source);
+    return true;
+}
+
+void Shader::watch(uv_loop_t *loop)
+{
+    uv_timer_init(loop, &timer);
+    timer.data = this;
+    uv_fs_event_init(loop, &fsev);
+    fsev.data = &timer;
+    uv_fs_event_start(&fsev, event_cb, path.c_str(), 0);
+    watching = true;
+}
+
+void Shader::unwatch()
+{
+    if (!watching) {
+        return;
+    }
+    uv_fs_event_stop(&fsev);
+    uv_close(reinterpret_cast<uv_handle_t*>(&fsev), nullptr);
+    uv_timer_stop(&timer);
+    uv_close(reinterpret_cast<uv_handle_t*>(&timer), nullptr);
+    watching = false;
+}
+
+bool Shader::compile(char **error)
+{
+    ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
+    ilG_shader *vert = ilG_renderman_findShader(rm, mat->vert);
+    ilG_shader *frag = ilG_renderman_findShader(rm, mat->frag);
+    if (!ilG_shader_compile(frag, error)
+        || !ilG_material_link(mat, vert, frag, error)) {
+        return false;
+    }
+    linked = true;
+    program = material_program = mat->program;
+    locate();
+
+    GLuint shaders[2];
+    GLsizei count = 0;
+    glGetAttachedShaders(program, 2, &count, shaders);
+    for (GLsizei i = 0; i < count; i++) {
+        GLint type;
+        glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+        if (type == GL_VERTEX_SHADER) {
+            vert_shader = shaders[i];
+        }
+    }
+    std::string source;
+    if (!vert_shader || !read_file(path.c_str(), source)) {
+        il_warning("Vertex shader or source not found, reloading and offsets disabled");
+        return true;
+    }
+
+    parallel = parallel_compile();
+    // Replaces the material's program with the offset one right away
+    start_build(source);
+    finish();
+    swapped = false;
+    return true;
+}
+
+void Shader::reload()
+{
+    if (!vert_shader) {
+        return;
+    }
+    std::string source;
+    if (!read_file(path.c_str(), source)) {
+        il_warning("Failed to read %s", path.c_str());
+        return;
+    }
+    if (fnv1a(source) == (pending? pending_hash : hash)) {
+        return;
+    }
+    // A newer save supersedes a build still in flight
+    drop_pending();
+    start_build(source);
+}
+
+void Shader::start_build(const std::string &source)
+{
+    const std::string offset_text = offset_source(source);
+    const char *text = offset_text.c_str();
+    build_start = uv_hrtime();
+    pending_frag = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(pending_frag, 1, &text, nullptr);
+    glCompileShader(pending_frag);
+    compile_ms = ms_since(build_start);
+    const uint64_t link_start = uv_hrtime();
+    pending = glCreateProgram();
+    glAttachShader(pending, vert_shader);
+    glAttachShader(pending, pending_frag);
+    glBindAttribLocation(pending, 0, "in_Position");
+    glLinkProgram(pending);
+    link_ms = ms_since(link_start);
+    pending_hash = fnv1a(source);
+    pending_frames = 0;
+}
+
+void Shader::poll()
+{
+    if (!pending) {
+        return;
+    }
+    pending_frames++;
+    if (parallel) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(pending, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) {
+            return;
+        }
+    } else if (pending_frames < 2) {
+        return;
+    }
+    finish();
+}
+
+void Shader::wait()
+{
+    if (pending) {
+        finish();
+    }
+}
+
+void Shader::finish()
+{
+    // Without parallel compile these are where the build blocks
+    uint64_t start = uv_hrtime();
+    GLint compiled = GL_FALSE, ok = GL_FALSE;
+    glGetShaderiv(pending_frag, GL_COMPILE_STATUS, &compiled);
+    compile_ms += ms_since(start);
+    start = uv_hrtime();
+    glGetProgramiv(pending, GL_LINK_STATUS, &ok);
+    link_ms += ms_since(start);
+    ready_ms = ms_since(build_start);
+    // The same contents are not retried until they change again
+    hash = pending_hash;
+    if (!ok) {
+        std::string log = compiled? program_log(pending) : shader_log(pending_frag);
+        il_error("%s: %s failed: %s", path.c_str(), compiled? "link" : "compile", log.c_str());
+        drop_pending();
+        return;
+    }
+    if (program != material_program) {
+        glDeleteProgram(program);
+    }
+    program = pending;
+    // Stays alive while attached to the program
+    glDeleteShader(pending_frag);
+    pending = pending_frag = 0;
+    locate();
+    linked = swapped = true;
+    builds++;
+    il_log("%s: ready in %.1f ms after %u frames, blocked %.1f ms compiling, %.1f ms linking",
+           path.c_str(), ready_ms, pending_frames, compile_ms, link_ms);
+}
+
+void Shader::bind(unsigned width, unsigned height, float time, int mouse[4],
+                  float offset_x, float offset_y)
+{
+    glUseProgram(program);
+    glUniform2f(iResolution, GLfloat(width), GLfloat(height));
+    glUniform1f(iGlobalTime, time);
+    glUniform4iv(iMouse, 1, mouse);
+    glUniform2f(offset, offset_x, offset_y);
+}
+
+void Shader::free()
+{
+    drop_pending();
+    if (program != material_program) {
+        glDeleteProgram(program);
+    }
+    program = material_program;
+}
+
+bool Shader::changed()
+{
+    bool was = swapped;
+    swapped = false;
+    return was;
+}
+
+void Shader::locate()
+{
+    iResolution = glGetUniformLocation(program, "iResolution");
+    iGlobalTime = glGetUniformLocation(program, "iGlobalTime");
+    iMouse = glGetUniformLocation(program, "iMouse");
+    iChannelResolution = glGetUniformLocation(program, "iChannelResolution");
+    offset = glGetUniformLocation(program, "demo_FragOffset");
+    // iChannelN reads texture unit N
+    glUseProgram(program);
+    for (int i = 0; i < 4; i++) {
+        char name[] = "iChannel0";
+        name[8] = char('0' + i);
+        glUniform1i(glGetUniformLocation(program, name), i);
+    }
+}
+
+void Shader::drop_pending()
+{
+    if (pending) {
+        glDeleteProgram(pending);
+        glDeleteShader(pending_frag);
+    }
+    pending = pending_frag = 0;
+}
@@ -0,0 +1,109 @@
+#ifndef DEMO_SHADER_H
+#define DEMO_SHADER_H
+
+#include <stdint.h>
+#include <string>
+#include <uv.h>
+
+#include "tgl/tgl.h"
+
+extern "C" {
+#include "graphics/renderer.h"
+}
+
+/* Reloads stay off the frame's critical path: file events restart a short
+ * timer, so an editor's burst of writes makes one reload, and contents that
+ * hash the same as the last build are skipped. The new fragment shader is
+ * compiled and linked into a program of its own, which replaces the running
+ * one only once it has linked; until then, or if it fails, the old program
+ * keeps drawing. With KHR_parallel_shader_compile the driver builds it on its
+ * own threads and poll() only checks GL_COMPLETION_STATUS_KHR. Without it,
+ * the status is first read a frame after the link was issued, by which time
+ * drivers that defer compilation have usually finished.
+ *
+ * Programs are built from the file with every gl_FragCoord offset by a
+ * uniform, which lets callers shade part of a larger image (tiles) or shift
+ * samples within their pixels (jitter).
+ *
+ * open() skips the material and starts the first build the same way, so many
+ * shaders can compile in the background while another one draws; linked turns
+ * true once poll() has swapped the program in. */
+struct Shader {
+    Shader(ilG_renderman *rm)
+        : rm(rm) {}
+
+    ilG_matid mat;
+    ilG_renderman *rm;
+    bool linked = false;
+    std::string path;
+    /* The shadertoy.com uniforms:
+      uniform vec3      iResolution;           // viewport resolution (in pixels)
+      uniform float     iGlobalTime;           // shader playback time (in seconds)
+      uniform float     iChannelTime[4];       // channel playback time (in seconds)
+      uniform vec3      iChannelResolution[4]; // channel resolution (in pixels)
+      uniform vec4      iMouse;                // mouse pixel coords. xy: current (if MLB down), zw: click
+      uniform samplerXX iChannel0..3;          // input channel. XX = 2D/Cube
+      uniform vec4      iDate;                 // (year, month, day, time in seconds)
+      uniform float     iSampleRate;           // sound sample rate (i.e., 44100)
+    */
+    GLint iResolution, iGlobalTime, iMouse, iChannelResolution;
+    /* Of the last build: milliseconds this thread spent issuing and waiting on
+     * the compile and the link, and from issuing it to the program being
+     * swapped in. With parallel compile the first two stay near zero. */
+    double compile_ms = 0, link_ms = 0, ready_ms = 0;
+    // Programs swapped in so far, including the first
+    unsigned builds = 0;
+
+    // Finds name on the shader path and builds it, linked with vert
+    bool load(const char *name, ilG_shaderid vert, char **error);
+    // Initial, blocking build through the material
+    bool compile(char **error);
+    // Finds name and starts building it with a loaded shader's vertex shader
+    bool open(const char *name, GLuint vert, char **error);
+    // Reloads the file whenever it changes
+    void watch(uv_loop_t *loop);
+    // Stops watching; the loop has to run once more to close the handles
+    void unwatch();
+    // Rereads the file and starts building it if its contents changed
+    void reload();
+    // Swaps in a finished build; never blocks while it is still compiling
+    void poll();
+    // Finishes a build in flight, blocking until it is done
+    void wait();
+    // offset is added to gl_FragCoord, in pixels
+    void bind(unsigned width, unsigned height, float time, int mouse[4],
+              float offset_x = 0, float offset_y = 0);
+    // Deletes the reloaded programs; the material's own is left to the renderman
+    void free();
+    // Whether a reload was swapped in since the last call
+    bool changed();
+
+    GLuint vertex() const {
+        return vert_shader;
+    }
+    bool building() const {
+        return pending != 0;
+    }
+
+private:
+    void locate();
+    void drop_pending();
+    void start_build(const std::string &source);
+    // Checks a finished build and swaps it in if it linked
+    void finish();
+
+    // Program being drawn with, and the one the material owns
+    GLuint program = 0, material_program = 0;
+    GLuint vert_shader = 0;
+    GLint offset = -1;
+    // Build in flight, if any
+    GLuint pending = 0, pending_frag = 0;
+    uint64_t hash = 0, pending_hash = 0, build_start = 0;
+    unsigned pending_frames = 0;
+    bool parallel = false, swapped = false;
+    uv_fs_event_t fsev;
+    uv_timer_t timer;
+    bool watching = false;
+};
+
+#endif
@@ -2,8 +2,19 @@
 #include <SDL.h>
 #include <assert.h>
 #include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
 
 #include "Demo.h"
+#include "FrameScheduler.h"
+#include "offline.h"
+#include "passes.h"
+#include "playlist.h"
+#include "shader.h"
+#include "tiled.h"
+#include "upscaler.h"
 
 extern "C" {
 #include "tgl/tgl.h"
@@ -14,104 +25,43 @@ extern "C" {
 #include "util/log.h"
 }
 
-struct Shader {
-    Shader(ilG_renderman *rm)
-        : rm(rm) {}
-
-    ilG_matid mat;
-    ilG_renderman *rm;
-    bool linked = false;
-    /* The shadertoy.com uniforms:
-      uniform vec3      iResolution;           // viewport resolution (in pixels)
-      uniform float     iGlobalTime;           // shader playback time (in seconds)
-      uniform float     iChannelTime[4];       // channel playback time (in seconds)
-      uniform vec3      iChannelResolution[4]; // channel resolution (in pixels)
-      uniform vec4      iMouse;                // mouse pixel coords. xy: current (if MLB down), zw: click
-      uniform samplerXX iChannel0..3;          // input channel. XX = 2D/Cube
-      uniform vec4      iDate;                 // (year, month, day, time in seconds)
-      uniform float     iSampleRate;           // sound sample rate (i.e., 44100)
-    */
-    GLint iResolution, iGlobalTime, iMouse;
-
-    bool compile(char **error) {
-        ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
-        ilG_shader *vert = ilG_renderman_findShader(rm, mat->vert);
-        ilG_shader *frag = ilG_renderman_findShader(rm, mat->frag);
-        if (ilG_shader_compile(frag, error)
-            && ilG_material_link(mat, vert, frag, error)) {
-            linked = true;
-            iResolution = ilG_material_getLoc(mat, "iResolution");
-            iGlobalTime = ilG_material_getLoc(mat, "iGlobalTime");
-            iMouse = ilG_material_getLoc(mat, "iMouse");
-            return true;
-        }
-        return false;
-    }
-
-    void bind(unsigned width, unsigned height, float time, int mouse[4]) {
-        ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
-        ilG_material_bind(mat);
-        glUniform2f(iResolution, GLfloat(width), GLfloat(height));
-        glUniform1f(iGlobalTime, time);
-        glUniform4iv(iMouse, 1, mouse);
-    }
-};
-
-void event_cb(uv_fs_event_t *handle,
-              const char *filename,
-              int events,
-              int status)
-{
-    (void)events, (void)status, (void)filename;
-    auto &shader = *reinterpret_cast<Shader*>(handle->data);
-    char *error;
-    if (!shader.compile(&error)) {
-        il_error("Link failed: %s", error);
-        free(error);
-    } else {
-        il_log("Shader reloaded");
-    }
-}
-
 int main(int argc, char **argv)
 {
     demoLoad(argc, argv);
     Window window = createWindow("Shader Toy");
-    ilA_file file;
     uv_loop_t loop;
     ilG_renderman rm[1];
     Shader shader(rm);
+    Passes passes(rm);
+    Playlist playlist(rm);
     tgl_quad quad;
     tgl_vao vao;
-    int mouse[4];
+    int mouse[4] = {};
     bool paused = false;
-    uv_fs_event_t fsev;
 
     memset(rm, 0, sizeof(*rm));
 
     ilA_adddir(&demo_fs, "shadertoys", -1);
     ilG_shaders_addPath("shadertoys");
-    if (demo_shader.empty()) {
-        fprintf(stderr, "Pass a shader with -f\n");
-        return 1;
-    }
-    if (!ilA_fileopen(&ilG_shaders, &file, demo_shader.c_str(), -1)) {
-        ilA_printerror(&file.err);
-        return 1;
-    }
-    il_log("Shader path: %s", file.name);
-
     uv_loop_init(&loop);
-    uv_fs_event_init(&loop, &fsev);
-    fsev.data = &shader;
-    uv_fs_event_start(&fsev, event_cb, file.name, 0);
 
     char *error;
-    ilG_material m[1];
-    ilG_material_init(m);
-    ilG_material_name(m, "Shader Toy");
-    ilG_material_arrayAttrib(m, 0, "in_Position");
-    ilG_shader vert, frag;
+    std::vector<std::string> names;
+    if (demo_playlist) {
+        if (!Playlist::scan(&loop, demo_playlist_file, "shadertoys", names, &error)) {
+            il_error("%s", error);
+            free(error);
+            return 1;
+        }
+        if (demo_shader.empty()) {
+            demo_shader = names.front();
+        }
+    }
+    if (demo_shader.empty()) {
+        fprintf(stderr, "Pass a shader with -f, or --playlist\n");
+        return 1;
+    }
+    ilG_shader vert;
     if (!ilG_shader_file(&vert, "id2d.vert", GL_VERTEX_SHADER, &error)) {
         il_error("id2d.vert: %s", error);
         free(error);
@@ -122,39 +72,119 @@ int main(int argc, char **argv)
         free(error);
         return 1;
     }
-    ilG_shader_load(&frag, file, GL_FRAGMENT_SHADER);
-    m->vert = ilG_renderman_addShader(rm, vert);
-    m->frag = ilG_renderman_addShader(rm, frag);
-    shader.mat = ilG_renderman_addMaterial(rm, *m);
-    if (!shader.compile(&error)) {
+    const ilG_shaderid vert_id = ilG_renderman_addShader(rm, vert);
+    if (!shader.load(demo_shader.c_str(), vert_id, &error)) {
         il_error("%s", error);
         free(error);
         return 1;
     }
+    shader.watch(&loop);
     tgl_vao_init(&vao);
     tgl_vao_bind(&vao);
     tgl_quad_init(&quad, 0);
 
+    auto stop = [&]() {
+        shader.unwatch();
+        passes.unwatch();
+        playlist.unwatch();
+        uv_run(&loop, UV_RUN_DEFAULT);
+
+        playlist.free();
+        passes.free();
+        shader.free();
+        ilG_renderman_delMaterial(rm, shader.mat);
+        tgl_vao_free(&vao);
+        tgl_quad_free(&quad);
+        window.close();
+    };
+
+    if (!passes.load(shader, &error)) {
+        il_error("%s", error);
+        free(error);
+        stop();
+        return 1;
+    }
+    passes.watch(&loop);
+
+    if (!demo_output.empty()) {
+        SDL_HideWindow(window.window);
+        const std::string &out = demo_output;
+        const bool still = out.size() > 4 && out.compare(out.size() - 4, 4, ".png") == 0
+            && out.find('%') == std::string::npos;
+        std::string offline_error;
+        bool ok;
+        if (still) {
+            TiledSettings settings;
+            settings.output = out;
+            settings.width = demo_size.first;
+            settings.height = demo_size.second;
+            settings.tile = demo_tile;
+            settings.time = demo_time;
+            ok = render_tiled(shader, passes, quad, vao, settings, offline_error);
+        } else {
+            OfflineSettings settings;
+            settings.output = out;
+            settings.width = demo_size.first;
+            settings.height = demo_size.second;
+            settings.fps = demo_fps;
+            settings.duration = demo_duration;
+            ok = render_offline(shader, passes, quad, vao, settings, offline_error);
+        }
+        if (!ok) {
+            il_error("%s", offline_error.c_str());
+        }
+        stop();
+        return ok? 0 : 1;
+    }
+
+    Upscaler upscaler;
+    const bool scaled = demo_frame_budget > 0;
+    int last_mouse[4] = {};
+    if (scaled && !upscaler.build(rm, demo_frame_budget, &error)) {
+        il_error("%s", error);
+        free(error);
+        stop();
+        return 1;
+    }
+    if (demo_playlist && !playlist.load(names, shader, passes, &loop, &error)) {
+        il_error("%s", error);
+        free(error);
+        upscaler.free();
+        stop();
+        return 1;
+    }
+
     typedef std::chrono::steady_clock clock;
     typedef std::chrono::duration<double> duration;
-    clock::time_point start_real = clock::now();
+    clock::time_point start_real = clock::now(), shown = start_real;
     float mono_last = 0.0, mono_start = 0.0, speed = 1.0;
+    bool switched = false;
+    FrameScheduler frames(window);
+    unsigned builds = 0;
+    // Each playlist shader starts from the beginning
+    auto advance = [&](int step) {
+        if (playlist.advance(step)) {
+            start_real = shown = clock::now();
+            mono_start = mono_last = 0.0;
+            switched = true;
+            frames.damage();
+        }
+    };
     while (1) {
         uv_run(&loop, UV_RUN_NOWAIT);
+        if (demo_playlist) {
+            playlist.poll();
+        } else {
+            shader.poll();
+        }
 
         SDL_Event ev;
-        while (SDL_PollEvent(&ev)) {
+        while (frames.poll(ev)) {
             switch (ev.type) {
             case SDL_QUIT:
                 il_log("Stopping");
-                uv_fs_event_stop(&fsev);
-                uv_close(reinterpret_cast<uv_handle_t*>(&fsev), nullptr);
-                uv_run(&loop, UV_RUN_DEFAULT);
-
-                ilG_renderman_delMaterial(rm, shader.mat);
-                tgl_vao_free(&vao);
-                tgl_quad_free(&quad);
-                window.close();
+                upscaler.free();
+                stop();
                 return 0;
             case SDL_MOUSEMOTION:
                 mouse[0] = ev.motion.x;
@@ -188,11 +218,42 @@ int main(int argc, char **argv)
                     speed *= 2;
                     il_log("Speed: %f", speed);
                     break;
+                case SDLK_PAGEDOWN:
+                    if (demo_playlist) {
+                        advance(1);
+                    }
+                    break;
+                case SDLK_PAGEUP:
+                    if (demo_playlist) {
+                        advance(-1);
+                    }
+                    break;
                 }
                 break;
             }
         }
 
+        if (demo_playlist && demo_advance > 0
+            && duration(clock::now() - shown).count() >= demo_advance) {
+            // Stays on the same one if nothing else is built yet
+            shown = clock::now();
+            advance(1);
+        }
+        Shader &current = demo_playlist? playlist.shader() : shader;
+        Passes &current_passes = demo_playlist? playlist.passes() : passes;
+
+        // A paused image is only drawn again once something changes it
+        const unsigned now_builds = current.builds + current_passes.builds();
+        const bool rebuilt = now_builds != builds;
+        if (rebuilt) {
+            builds = now_builds;
+            frames.damage();
+        }
+        frames.animating = !paused || (scaled && !upscaler.converged());
+        if (!frames.draw()) {
+            continue;
+        }
+
         auto s = window.resize();
 
         float tf;
@@ -205,10 +266,37 @@ int main(int argc, char **argv)
             mono_start += float(delta.count() * speed);
             tf = mono_last = mono_start;
         }
-        shader.bind(s.first, s.second, tf, mouse);
+        if (scaled) {
+            // Anything that changes the image restarts accumulation
+            bool still = paused && !switched && !rebuilt && !current.changed()
+                && memcmp(mouse, last_mouse, sizeof(mouse)) == 0;
+            memcpy(last_mouse, mouse, sizeof(mouse));
+            switched = false;
+            Upscaler::View view;
+            if (upscaler.begin(unsigned(s.first), unsigned(s.second), still, view)) {
+                int view_mouse[4];
+                for (unsigned i = 0; i < 4; i++) {
+                    view_mouse[i] = int(mouse[i] * view.scale);
+                }
+                /* Buffers without a fixed size follow the view's, so heavy
+                 * ones are scaled too, and the GPU time begin() measures
+                 * covers them as well as the image */
+                current_passes.render(quad, vao, view.width, view.height, tf, view_mouse);
+                upscaler.bind();
+                current.bind(view.width, view.height, tf, view_mouse, view.jitter_x, view.jitter_y);
+                current_passes.bind_image(current);
+                tgl_vao_bind(&vao);
+                tgl_quad_draw_once(&quad);
+            }
+            upscaler.end();
+        } else {
+            current_passes.render(quad, vao, unsigned(s.first), unsigned(s.second), tf, mouse);
+            current.bind(s.first, s.second, tf, mouse);
+            current_passes.bind_image(current);
 
-        tgl_vao_bind(&vao);
-        tgl_quad_draw_once(&quad);
+            tgl_vao_bind(&vao);
+            tgl_quad_draw_once(&quad);
+        }
 
         window.swap();
     }
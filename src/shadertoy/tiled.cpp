@@ -0,0 +1,96 @@
+#include "tiled.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "PngStream.h"
+
+extern "C" {
+#include "util/log.h"
+}
+
+using namespace std;
+
+namespace {
+
+const int png_level = 6;
+
+}
+
+bool render_tiled(Shader &shader, Passes &passes, tgl_quad &quad, tgl_vao &vao,
+                  const TiledSettings &settings, string &error)
+{
+    typedef chrono::steady_clock clock;
+    typedef chrono::duration<double> duration;
+
+    if (!passes.empty()) {
+        // Buffers would have to be rendered at the whole image's size
+        error = "Tiled stills don't support buffer passes";
+        return false;
+    }
+    const unsigned width = settings.width, height = settings.height;
+    GLint max_size = 0, max_viewport[2] = {0, 0};
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_size);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+    unsigned tile = min(settings.tile, unsigned(min(max_size, min(max_viewport[0], max_viewport[1]))));
+    tile = min(tile, max(width, height));
+
+    GLuint fbo, color;
+    glGenRenderbuffers(1, &color);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, GLsizei(tile), GLsizei(tile));
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!ok) {
+        error = "Tile framebuffer incomplete";
+    }
+
+    PngStream png;
+    ok = ok && png.open(settings.output.c_str(), width, height, png_level, error);
+    const size_t stride = size_t(width) * 4;
+    vector<uint8_t> strip;
+    if (ok) {
+        strip.resize(stride * tile);
+    }
+    il_log("Rendering %ux%u in %u pixel tiles", width, height, tile);
+
+    int mouse[4] = {};
+    tgl_vao_bind(&vao);
+    // Tiles land side by side in the strip
+    glPixelStorei(GL_PACK_ROW_LENGTH, GLint(width));
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    clock::time_point start = clock::now();
+    unsigned rows = 0;
+    // GL rows run bottom up and PNG rows top down, so start at the top
+    for (unsigned top = height; ok && top > 0; top -= min(top, tile), rows++) {
+        const unsigned th = min(top, tile), y = top - th;
+        for (unsigned x = 0; x < width; x += tile) {
+            const unsigned tw = min(width - x, tile);
+            glViewport(0, 0, GLsizei(tw), GLsizei(th));
+            shader.bind(width, height, settings.time, mouse, float(x), float(y));
+            tgl_quad_draw_once(&quad);
+            // Waits for this tile alone, so no submission grows past one tile
+            glReadPixels(0, 0, GLsizei(tw), GLsizei(th), GL_RGBA, GL_UNSIGNED_BYTE, &strip[x * 4]);
+        }
+        for (unsigned row = th; ok && row > 0; row--) {
+            ok = png.row(&strip[(row - 1) * stride], error);
+        }
+        il_log("%u / %u rows", height - y, height);
+    }
+    ok = ok && png.close(error);
+    const double elapsed = duration(clock::now() - start).count();
+
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &color);
+    if (ok) {
+        il_log("Wrote %s in %.2f s, %u rows of tiles", settings.output.c_str(), elapsed, rows);
+    }
+    return ok;
+}
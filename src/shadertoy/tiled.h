@@ -0,0 +1,30 @@
+#ifndef DEMO_TILED_H
+#define DEMO_TILED_H
+
+#include <string>
+
+#include "passes.h"
+#include "shader.h"
+#include "tgl/tgl.h"
+
+struct TiledSettings {
+    std::string output;
+    unsigned width, height;
+    // Largest tile edge, clamped to what the GL can render to
+    unsigned tile;
+    float time;
+};
+
+/* Renders one frame of the shader into a PNG of any size, a tile at a time,
+ * so no single draw covers more than tile x tile pixels. Tiles are drawn
+ * into a tile-sized framebuffer with gl_FragCoord offset by each tile's
+ * position, and iResolution stays that of the whole image, so shaders see
+ * the coordinates they would untiled.
+ *
+ * Rows of tiles are rendered top down and read back into a strip one tile
+ * high, which is written to the PNG before the next row starts, so memory
+ * stays at width x tile pixels whatever the image's height. */
+bool render_tiled(Shader &shader, Passes &passes, tgl_quad &quad, tgl_vao &vao,
+                  const TiledSettings &settings, std::string &error);
+
+#endif
@@ -0,0 +1,213 @@
+#include "upscaler.h"
+
+#include <algorithm>
+#include <math.h>
+
+extern "C" {
+#include "graphics/material.h"
+#include "util/log.h"
+}
+
+enum {
+    TEX_SCENE,
+    TEX_HISTORY,
+};
+
+// Radical inverse of index in base, for jitter that covers the pixel evenly
+static float halton(unsigned index, unsigned base)
+{
+    float f = 1, r = 0;
+    while (index > 0) {
+        f /= base;
+        r += f * (index % base);
+        index /= base;
+    }
+    return r;
+}
+
+bool Upscaler::pass(Pass &pass, const char *name, const char *frag, const char *output,
+                    char **error)
+{
+    ilG_material m;
+    ilG_material_init(&m);
+    ilG_material_name(&m, name);
+    ilG_material_textureUnit(&m, TEX_SCENE, "tex_Scene");
+    ilG_material_textureUnit(&m, TEX_HISTORY, "tex_History");
+    ilG_material_fragData(&m, 0, output);
+    if (!ilG_renderman_addMaterialFromFile(rm, m, "deferred.vert", frag, &pass.mat, error)) {
+        return false;
+    }
+    pass.program = ilG_renderman_findMaterial(rm, pass.mat)->program;
+    return true;
+}
+
+bool Upscaler::build(ilG_renderman *rm, float budget, char **error)
+{
+    this->rm = rm;
+    this->budget = budget;
+    if (!pass(accumulate, "Upscale Accumulate", "upscale_accumulate.frag", "out_History", error)) {
+        return false;
+    }
+    if (!pass(present, "Upscale Present", "upscale_present.frag", "out_Color", error)) {
+        ilG_renderman_delMaterial(rm, accumulate.mat);
+        return false;
+    }
+    ilG_material *mat = ilG_renderman_findMaterial(rm, accumulate.mat);
+    acc_scene_size = ilG_material_getLoc(mat, "scene_size");
+    acc_jitter = ilG_material_getLoc(mat, "jitter");
+    acc_reset = ilG_material_getLoc(mat, "reset");
+
+    timed = epoxy_gl_version() >= 33 || TGL_EXTENSION(ARB_timer_query);
+    if (!timed) {
+        il_warning("No timer queries, resolution stays at %.0f%%", scale * 100);
+    }
+    tgl_vao_init(&empty);
+    glGenFramebuffers(1, &scene_fbo);
+    glGenFramebuffers(2, history_fbo);
+    glGenTextures(1, &scene_tex);
+    glGenTextures(2, history_tex);
+    built = true;
+    il_log("Dynamic resolution: %.1f ms GPU budget", budget);
+    return true;
+}
+
+void Upscaler::free()
+{
+    if (!built) {
+        return;
+    }
+    ilG_renderman_delMaterial(rm, accumulate.mat);
+    ilG_renderman_delMaterial(rm, present.mat);
+    tgl_vao_free(&empty);
+    timer.free();
+    glDeleteFramebuffers(1, &scene_fbo);
+    glDeleteFramebuffers(2, history_fbo);
+    glDeleteTextures(1, &scene_tex);
+    glDeleteTextures(2, history_tex);
+    width = height = 0;
+    built = false;
+}
+
+void Upscaler::resize(unsigned width, unsigned height)
+{
+    this->width = width;
+    this->height = height;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, scene_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, GLsizei(width), GLsizei(height), 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    // Linear for the bilinear upscale; the accumulation fetches texels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scene_tex, 0);
+    for (unsigned i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, history_tex[i]);
+        // Sums of many weighted samples need more than half floats
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, GLsizei(width), GLsizei(height), 0,
+                     GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, history_fbo[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               history_tex[i], 0);
+    }
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        il_error("Upscaler history incomplete: %#x", status);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    reset = true;
+}
+
+void Upscaler::control(double ms)
+{
+    gpu_ms = gpu_ms > 0? gpu_ms * .8 + ms * .2 : ms;
+    // Shading cost follows the pixel count, which is quadratic in scale
+    float target = scale * float(sqrt(budget / std::max(gpu_ms, .01)));
+    // Back off quickly, recover slowly so the scale doesn't oscillate
+    target = std::min(std::max(target, scale * .9f), scale * 1.05f);
+    target = std::min(std::max(target, min_scale), 1.f);
+    if (fabsf(target - scale) > .01f) {
+        scale = target;
+    }
+}
+
+bool Upscaler::begin(unsigned width, unsigned height, bool still, View &view)
+{
+    if (width != this->width || height != this->height) {
+        resize(width, height);
+    }
+    GLuint ns;
+    if (timer.poll(ns) && !still) {
+        control(ns / 1e6);
+    }
+    if (!still) {
+        reset = true;
+    }
+    drawing = reset || samples < converge;
+    if (!drawing) {
+        return false;
+    }
+    if (reset) {
+        samples = 0;
+        jitter_x = jitter_y = 0;
+    } else {
+        jitter_x = halton(samples + 1, 2) - .5f;
+        jitter_y = halton(samples + 1, 3) - .5f;
+    }
+    view_width = std::max(1u, unsigned(width * scale + .5f));
+    view_height = std::max(1u, unsigned(height * scale + .5f));
+    view.width = view_width;
+    view.height = view_height;
+    view.jitter_x = jitter_x;
+    view.jitter_y = jitter_y;
+    view.scale = float(view_width) / width;
+
+    bind();
+    if (timed) {
+        timer.begin();
+    }
+    return true;
+}
+
+void Upscaler::bind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+    glViewport(0, 0, GLsizei(view_width), GLsizei(view_height));
+}
+
+void Upscaler::end()
+{
+    glViewport(0, 0, GLsizei(width), GLsizei(height));
+    tgl_vao_bind(&empty);
+    if (drawing) {
+        if (timed) {
+            timer.end();
+        }
+        const unsigned next = current ^ 1;
+        glBindFramebuffer(GL_FRAMEBUFFER, history_fbo[next]);
+        glUseProgram(accumulate.program);
+        glUniform2f(acc_scene_size, GLfloat(view_width), GLfloat(view_height));
+        glUniform2f(acc_jitter, jitter_x, jitter_y);
+        glUniform1i(acc_reset, reset);
+        glActiveTexture(GL_TEXTURE0 + TEX_SCENE);
+        glBindTexture(GL_TEXTURE_2D, scene_tex);
+        glActiveTexture(GL_TEXTURE0 + TEX_HISTORY);
+        glBindTexture(GL_TEXTURE_2D, history_tex[current]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        current = next;
+        if (!reset) {
+            samples++;
+        }
+        reset = false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glUseProgram(present.program);
+    glActiveTexture(GL_TEXTURE0 + TEX_HISTORY);
+    glBindTexture(GL_TEXTURE_2D, history_tex[current]);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
@@ -0,0 +1,77 @@
+#ifndef DEMO_UPSCALER_H
+#define DEMO_UPSCALER_H
+
+#include "SampleCounter.h"
+#include "tgl/tgl.h"
+
+extern "C" {
+#include "graphics/renderer.h"
+}
+
+/* Dynamic resolution for the interactive view. The shader is drawn into the
+ * lower left corner of an offscreen target, scaled so its GPU time, measured
+ * with timer queries, stays under budget milliseconds; the scale is raised
+ * again as headroom appears.
+ *
+ * While the image animates, the samples are upscaled bilinearly. Once it is
+ * still (paused, mouse unmoved, no reload) samples are jittered within their
+ * pixels by a Halton sequence and accumulated into a full resolution history,
+ * each weighted by its distance to the output pixel's centre, so the image
+ * converges to full resolution. There is no motion to reproject in a
+ * shadertoy: any change restarts accumulation, and once converge samples have
+ * been taken the shader is no longer drawn at all.
+ *
+ * Per frame: begin(), and if it returns true draw the shader at the returned
+ * size and jitter; then end(), which presents to the default framebuffer. */
+class Upscaler {
+public:
+    struct View {
+        unsigned width, height;
+        float jitter_x, jitter_y;
+        // Factor from window to view pixels, for iMouse
+        float scale;
+    };
+
+    bool build(ilG_renderman *rm, float budget, char **error);
+    void free();
+
+    bool begin(unsigned width, unsigned height, bool still, View &view);
+    // Binds the view's target again, after buffer passes drew elsewhere
+    void bind();
+    void end();
+    // Whether a still image has taken all its samples, so drawing it changes nothing
+    bool converged() const {
+        return !reset && samples >= converge;
+    }
+
+    float budget, scale = 1.f, min_scale = .25f;
+    unsigned converge = 64;
+
+private:
+    struct Pass {
+        ilG_matid mat;
+        GLuint program;
+    };
+
+    bool pass(Pass &pass, const char *name, const char *frag, const char *output,
+              char **error);
+    void resize(unsigned width, unsigned height);
+    void control(double ms);
+
+    ilG_renderman *rm = nullptr;
+    Pass accumulate, present;
+    GLint acc_scene_size, acc_jitter, acc_reset;
+    tgl_vao empty;
+    SampleCounter timer = SampleCounter(GL_TIME_ELAPSED);
+    bool timed = false;
+    GLuint scene_fbo = 0, scene_tex = 0;
+    GLuint history_fbo[2] = {0, 0}, history_tex[2] = {0, 0};
+    unsigned width = 0, height = 0, view_width = 0, view_height = 0;
+    unsigned current = 0, samples = 0;
+    bool drawing = false, reset = true;
+    float jitter_x = 0, jitter_y = 0;
+    double gpu_ms = 0;
+    bool built = false;
+};
+
+#endif
@@ -2,9 +2,14 @@
 #include <time.h>
 #include <math.h>
 #include <chrono>
+#include <cstring>
 
 #include "Demo.h"
+#include "FrameScheduler.h"
+#include "GLState.h"
 #include "Graphics.h"
+#include "Mesh.h"
+#include "UniformRing.h"
 
 extern "C" {
 #include "asset/node.h"
@@ -25,52 +30,99 @@ extern "C" {
 
 struct Teapot {
     ilG_renderman *rm;
-    ilG_matid mat;
-    ilG_mesh mesh;
+    ilG_matid mat, batch_mat;
+    bool batched = false;
+    int group = -1;
+    Mesh mesh;
     ilG_tex tex;
-    GLuint mvp_loc, imt_loc;
 
     void free() {
         ilG_renderman_delMaterial(rm, mat);
-        ilG_mesh_free(&mesh);
+        if (batched) {
+            ilG_renderman_delMaterial(rm, batch_mat);
+        }
+        mesh.free();
         ilG_tex_free(&tex);
     }
-    void draw(il_mat mvp, il_mat imt) {
+    void draw(il_mat model, il_mat imt, unsigned changed = RenderQueue::CHANGED_ALL) {
         ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
-        ilG_material_bind(mat);
-        ilG_mesh_bind(&mesh);
-        ilG_tex_bind(&tex, 0);
-        ilG_material_bindMatrix(mat, mvp_loc, mvp);
-        ilG_material_bindMatrix(mat, imt_loc, imt);
-        ilG_mesh_draw(&mesh);
+        if (changed & RenderQueue::CHANGED_MATERIAL) {
+            demo_gl.material(mat);
+        }
+        if (changed & RenderQueue::CHANGED_MESH) {
+            mesh.bind();
+        }
+        if (changed & RenderQueue::CHANGED_TEXTURES) {
+            demo_gl.texture(0, &tex);
+        }
+        ObjectBlock block;
+        memset(&block, 0, sizeof(block));
+        block.model = model;
+        block.imt = imt;
+        demo_uniforms.bind(DEMO_OBJECT_BINDING, demo_uniforms.push(&block, sizeof(block)));
+        mesh.draw();
+    }
+    bool record(DrawBatch &batch, il_mat model, il_mat imt) {
+        if (!batched) {
+            return false;
+        }
+        if (group < 0) {
+            group = int(batch.group([this]() {
+                demo_gl.material(ilG_renderman_findMaterial(rm, batch_mat));
+                demo_gl.texture(0, &tex);
+            }));
+        }
+        DrawBatch::DrawData data;
+        memset(&data, 0, sizeof(data));
+        data.model = model;
+        data.imt = imt;
+        batch.add(unsigned(group), mesh, data);
+        return true;
     }
-    bool build(ilG_renderman *rm, char **error) {
+    bool build(ilG_renderman *rm, AssetLoader &loader, GBufferLayout layout, char **error) {
         this->rm = rm;
+        auto setup = [layout](ilG_material &m, const char *name) {
+            ilG_material_init(&m);
+            ilG_material_name(&m, name);
+            ilG_material_arrayAttrib(&m, ILG_MESH_POS, "in_Position");
+            ilG_material_arrayAttrib(&m, ILG_MESH_TEX, "in_Texcoord");
+            ilG_material_arrayAttrib(&m, ILG_MESH_NORM, "in_Normal");
+            ilG_material_arrayAttrib(&m, ILG_MESH_DIFFUSE, "in_Diffuse");
+            ilG_material_arrayAttrib(&m, ILG_MESH_SPECULAR, "in_Specular");
+            ilG_material_textureUnit(&m, 0, "tex");
+            if (layout == GBUFFER_COMPACT) {
+                Deferred::outputs(m);
+                return;
+            }
+            ilG_material_fragData(&m, ILG_GBUFFER_ALBEDO, "out_Albedo");
+            ilG_material_fragData(&m, ILG_GBUFFER_NORMAL, "out_Normal");
+            ilG_material_fragData(&m, ILG_GBUFFER_REFRACTION, "out_Refraction");
+            ilG_material_fragData(&m, ILG_GBUFFER_GLOSS, "out_Gloss");
+        };
+        const char *frag = layout == GBUFFER_COMPACT? "teapot_compact.frag" : "teapot.frag";
         ilG_material m;
-        ilG_material_init(&m);
-        ilG_material_name(&m, "Teapot Material");
-        ilG_material_arrayAttrib(&m, ILG_MESH_POS, "in_Position");
-        ilG_material_arrayAttrib(&m, ILG_MESH_TEX, "in_Texcoord");
-        ilG_material_arrayAttrib(&m, ILG_MESH_NORM, "in_Normal");
-        ilG_material_arrayAttrib(&m, ILG_MESH_DIFFUSE, "in_Diffuse");
-        ilG_material_arrayAttrib(&m, ILG_MESH_SPECULAR, "in_Specular");
-        ilG_material_textureUnit(&m, 0, "tex");
-        ilG_material_fragData(&m, ILG_GBUFFER_ALBEDO, "out_Albedo");
-        ilG_material_fragData(&m, ILG_GBUFFER_NORMAL, "out_Normal");
-        ilG_material_fragData(&m, ILG_GBUFFER_REFRACTION, "out_Refraction");
-        ilG_material_fragData(&m, ILG_GBUFFER_GLOSS, "out_Gloss");
-        if (!ilG_renderman_addMaterialFromFile(rm, m, "teapot.vert", "teapot.frag", &mat, error)) {
+        setup(m, "Teapot Material");
+        if (!ilG_renderman_addMaterialFromFile(rm, m, "teapot.vert", frag, &mat, error)) {
             return false;
         }
         ilG_material *mat = ilG_renderman_findMaterial(rm, this->mat);
-        mvp_loc = ilG_material_getLoc(mat, "mvp");
-        imt_loc = ilG_material_getLoc(mat, "imt");
-
-        if (!ilG_mesh_fromfile(&mesh, &demo_fs, "teapot.obj")) {
-            return false;
+        CameraBuffer::attach(mat);
+        UniformRing::attach(mat);
+
+        if (DrawBatch::supported()) {
+            setup(m, "Teapot Material (batched)");
+            ilG_material_arrayAttrib(&m, DEMO_DRAW_ID_ATTRIB, "in_DrawID");
+            ilG_material_textureUnit(&m, DEMO_DRAW_DATA_UNIT, "draws");
+            if (!ilG_renderman_addMaterialFromFile(rm, m, "teapot_batch.vert", frag,
+                                                   &batch_mat, error)) {
+                return false;
+            }
+            CameraBuffer::attach(ilG_renderman_findMaterial(rm, batch_mat));
+            batched = true;
         }
 
-        ilG_tex_loadfile(&tex, &demo_fs, "white-marble-texture.png");
+        loader.mesh(&mesh, "teapot.obj");
+        loader.texture(&tex, "white-marble-texture.png");
         return true;
     }
 };
@@ -81,11 +133,35 @@ struct Teapots : public Drawable {
 
     unsigned object;
     Teapot &teapot;
-
+    il_mat model, imt;
+
+    void enqueue(Graphics &graphics, RenderQueue &queue) override {
+        model = graphics.objmats(&object, ILG_MODEL, 1).front();
+        imt = graphics.objmats(&object, ILG_IMT, 1).front();
+        queue.push(RenderQueue::key(RenderQueue::PASS_OPAQUE, queue.id(&teapot.mat),
+                                    queue.id(&teapot.tex), queue.id(&teapot.mesh),
+                                    graphics.depth(model)), this);
+    }
+    void execute(Graphics &graphics, const RenderQueue::Item &item, unsigned changed) override {
+        (void)graphics;
+        (void)item;
+        teapot.draw(model, imt, changed);
+    }
+    bool occluder(const RenderQueue::Item &item, const Mesh *&mesh, il_mat &model) override {
+        (void)item;
+        mesh = &teapot.mesh;
+        model = this->model;
+        return true;
+    }
     void draw(Graphics &graphics) override {
-        auto mvp = graphics.objmats(&object, ILG_MVP, 1);
+        auto model = graphics.objmats(&object, ILG_MODEL, 1);
         auto imt = graphics.objmats(&object, ILG_IMT, 1);
-        teapot.draw(mvp.front(), imt.front());
+        teapot.draw(model.front(), imt.front());
+    }
+    bool record(Graphics &graphics, DrawBatch &batch) override {
+        auto model = graphics.objmats(&object, ILG_MODEL, 1);
+        auto imt = graphics.objmats(&object, ILG_IMT, 1);
+        return teapot.record(batch, model.front(), imt.front());
     }
     const char *name() override {
         return "Teapots";
@@ -108,11 +184,14 @@ int main(int argc, char **argv)
     graphics.drawables.push_back(&drawable);
 
     char *error;
-    if (!teapot.build(graphics.rm, &error)) {
+    if (!teapot.build(graphics.rm, graphics.loader, graphics.gbuffer, &error)) {
         il_error("Teapot: %s", error);
         free(error);
         return 1;
     }
+    if (!graphics.loader.wait()) {
+        return 1;
+    }
 
     il_pos_setPosition(&graphics.space.camera, il_vec3_new(0, 0, 20));
 
@@ -133,10 +212,11 @@ int main(int argc, char **argv)
     typedef std::chrono::steady_clock clock;
     typedef std::chrono::duration<double> duration;
 
+    FrameScheduler frames(window);
     clock::time_point start = clock::now();
     while (1) {
         SDL_Event ev;
-        while (SDL_PollEvent(&ev)) {
+        while (frames.poll(ev)) {
             switch (ev.type) {
             case SDL_QUIT:
                 il_log("Stopping");
@@ -144,6 +224,9 @@ int main(int argc, char **argv)
                 return 0;
             }
         }
+        if (!frames.draw()) {
+            continue;
+        }
 
         duration delta = clock::now() - start;
         const double secs = 5.0;